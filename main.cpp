@@ -28,6 +28,7 @@ using namespace glm;
 
 int main(int argc, char* argv[]) {
 	GLFWwindow* window = InitOpenGL("Voxel Render");
+	double shader_start = glfwGetTime();
 	Shader boundary_shader("boundary");
 	Shader screen_shader("editorlighting");
 	Shader mesh_shader("shaders/mesh_vert.glsl", "shaders/mesh_frag.glsl");
@@ -37,11 +38,28 @@ int main(int argc, char* argv[]) {
 	Shader voxbox_shader("shaders/voxbox_vert.glsl", "shaders/voxbox_frag.glsl");
 	Shader voxel_glass_shader("shaders/voxel_gm_vert.glsl", "shaders/voxel_glass_frag.glsl");
 	Shader voxel_gm_shader("shaders/voxel_gm_vert.glsl", "shaders/voxel_frag.glsl");
-	Shader voxel_hex_shader("shaders/voxel_hex_vert.glsl", "shaders/voxel_frag.glsl");
+	// Only the layouts are drawn, one program per HEX_SIDE and no base program
+	Shader voxel_hex_shaders[] = {
+		Shader("shaders/voxel_hex_vert.glsl", "shaders/voxel_frag.glsl", { "HEX_SIDE 0" }),
+		Shader("shaders/voxel_hex_vert.glsl", "shaders/voxel_frag.glsl", { "HEX_SIDE 1" }),
+		Shader("shaders/voxel_hex_vert.glsl", "shaders/voxel_frag.glsl", { "HEX_SIDE 2" }),
+		Shader("shaders/voxel_hex_vert.glsl", "shaders/voxel_frag.glsl", { "HEX_SIDE 3" }),
+	};
 	Shader voxel_rtx_shader("gbuffervox");
 	//Shader water_shader("shaders/water_vert.glsl", "shaders/water_frag.glsl");
 	Shader water_shader("gbufferwater");
 
+	// Compile-time permutations, built together with the base programs
+	const char* hex_sides[] = { "HEX_SIDE 0", "HEX_SIDE 1", "HEX_SIDE 2", "HEX_SIDE 3" };
+	for (int i = 0; i < 4; i++)
+		shadowmap_shader.getVariant({ "VOXEL", hex_sides[i] });
+	shadowmap_shader.getVariant({ "VOXEL" });
+	shadowmap_shader.getVariant({ "VOXBOX" });
+	voxel_gm_shader.getVariant({ "TRANSPARENT_GLASS" });
+	Shader::finishAll();
+	printf("[INFO] Shaders loaded in %.1f ms, program cache: %d hits, %d misses\n",
+		(glfwGetTime() - shader_start) * 1000.0, Shader::cache_stats.hits, Shader::cache_stats.misses);
+
 	map<const char*, Shader*> shaders = {
 		{"boundary_shader", &boundary_shader},
 		{"mesh_shader", &mesh_shader},
@@ -52,7 +70,10 @@ int main(int argc, char* argv[]) {
 		{"voxbox_shader", &voxbox_shader},
 		{"voxel_glass_shader", &voxel_glass_shader},
 		{"voxel_gm_shader", &voxel_gm_shader},
-		{"voxel_hex_shader", &voxel_hex_shader},
+		{"voxel_hex_shader_0", &voxel_hex_shaders[0]},
+		{"voxel_hex_shader_1", &voxel_hex_shaders[1]},
+		{"voxel_hex_shader_2", &voxel_hex_shaders[2]},
+		{"voxel_hex_shader_3", &voxel_hex_shaders[3]},
 		{"voxel_rtx_shader", &voxel_rtx_shader},
 		{"water_shader", &water_shader},
 	};
@@ -89,6 +110,11 @@ int main(int argc, char* argv[]) {
 	glFrontFace(GL_CCW);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	// Last state the shadow map was drawn with
+	int shadow_hex_orientation = -1;
+	vec3 shadow_model_position = model.position;
+	quat shadow_model_rotation = model.rotation;
+
 	// Handle screenshoot and fullscreen keys
 	glfwSetWindowUserPointer(window, &camera);
 	glfwSetKeyCallback(window, key_press_callback);
@@ -101,8 +127,12 @@ int main(int argc, char* argv[]) {
 		if (dt >= 1.0f) {
 			int fps = ceil((1.0f / dt) * counter);
 			float ms = dt / counter * 1000.0f;
-			char window_title[128];
-			sprintf(window_title, "OpenGL %s | FPS: %d | %.1f ms", glGetString(GL_VERSION), fps, ms);
+			const OcclusionStats& occlusion_stats = scene.getOcclusionStats();
+			const StateStats& state_stats = Shader::stats;
+			char window_title[192];
+			sprintf(window_title, "OpenGL %s | FPS: %d | %.1f ms | Occluded: %d/%d | Draws: %d | State: %d/%d",
+				glGetString(GL_VERSION), fps, ms, occlusion_stats.rejected, occlusion_stats.tested,
+				state_stats.draws, state_stats.changes, state_stats.changes + state_stats.skipped);
 			glfwSetWindowTitle(window, window_title);
 			prev_time = actual_time;
 			counter = 0;
@@ -119,18 +149,66 @@ int main(int argc, char* argv[]) {
 			glass.position = model.position;
 			glass.rotation = model.rotation;
 		}
+		scene.startOcclusion(camera.vp_matrix);
+		light.updateCascades(camera);
+
+		FrameData frame_data;
+		frame_data.vp_matrix = camera.vp_matrix;
+		for (int i = 0; i < SHADOW_CASCADES; i++)
+			frame_data.light_matrices[i] = light.getMatrix(i);
+		frame_data.camera_pos = camera.position;
+		frame_data.far_plane = camera.FAR_PLANE;
+		frame_data.light_pos = light.position;
+		frame_data.rnd_frame = RTX_Render::random_frame;
+		frame_data.pixel_size = vec2(1.0f / camera.screen_width, 1.0f / camera.screen_height);
+		frame_data.time = actual_time;
+		frame_data.inv_far = 1.0f / camera.FAR_PLANE;
+		Shader::pushFrame(frame_data);
 
+		Shader::stats = StateStats();
 		overlay.frame();
-		// Shadows
-		light.bindShadowMap(shadowmap_shader);
-		scene.draw(shadowmap_shader, camera, GREEDY);
-		shadowmap_shader.pushInt("side", overlay.hex_orientation);
-		scene.draw(shadowmap_shader, camera, HEXAGON);
-		scene.drawVoxbox(shadowmap_shader, camera);
-		scene.drawMesh(shadowmap_shader, camera);
-		model.draw(shadowmap_shader, camera);
-		glass.draw(shadowmap_shader, camera);
+		// Shadows, static casters are cached per cascade and the vehicle is drawn on top when it moves
+		const char* hex_side = hex_sides[overlay.hex_orientation];
+		HexRender::orientation = overlay.hex_orientation;
+		if (overlay.hex_orientation != shadow_hex_orientation)
+			light.invalidateShadows();
+		shadow_hex_orientation = overlay.hex_orientation;
+		bool dynamic_moved = model.position != shadow_model_position || model.rotation != shadow_model_rotation;
+		shadow_model_position = model.position;
+		shadow_model_rotation = model.rotation;
+
+		Shader& shadowmap_voxel = shadowmap_shader.getVariant({ "VOXEL" });
+		Shader& shadowmap_hex = shadowmap_shader.getVariant({ "VOXEL", hex_side });
+		Shader& shadowmap_voxbox = shadowmap_shader.getVariant({ "VOXBOX" });
+		for (int i = 0; i < SHADOW_CASCADES; i++) {
+			const Frustum& cascade_frustum = light.getFrustum(i);
+			if (light.isStaticDirty(i)) {
+				scene.cull(cascade_frustum);
+				light.bindStaticMap(shadowmap_shader, i);
+				shadowmap_voxel.use();
+				shadowmap_voxel.pushInt("uCascade", i);
+				scene.submitShadow(shadowmap_voxel, camera, OBJECT_GREEDY);
+				shadowmap_hex.use();
+				shadowmap_hex.pushInt("uCascade", i);
+				scene.submitShadow(shadowmap_hex, camera, OBJECT_HEXAGON);
+				shadowmap_shader.use();
+				shadowmap_shader.pushInt("uCascade", i);
+				scene.submitShadow(shadowmap_shader, camera, OBJECT_MESH);
+				scene.drawShadowQueue(camera);
+				shadowmap_voxbox.use();
+				shadowmap_voxbox.pushInt("uCascade", i);
+				scene.drawVoxboxDepth(shadowmap_voxbox);
+			}
+			if (light.bindShadowMap(shadowmap_shader, i, dynamic_moved)) {
+				shadowmap_shader.pushInt("uCascade", i);
+				if (IsInFrustum(cascade_frustum, model.getBounds()))
+					model.drawDepth(shadowmap_shader, camera);
+				if (IsInFrustum(cascade_frustum, glass.getBounds()))
+					glass.drawDepth(shadowmap_shader, camera);
+			}
+		}
 		light.unbindShadowMap(camera);
+		scene.cull(camera.getFrustum(), true);
 
 		screen.start();
 		//voxel_rtx_shader.use();
@@ -138,43 +216,43 @@ int main(int argc, char* argv[]) {
 		screen.end();
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		voxel_gm_shader.use();
-		voxel_gm_shader.pushInt("transparent_glass", overlay.transparent_glass);
-		light.pushUniforms(voxel_gm_shader);
-		scene.draw(voxel_gm_shader, camera, GREEDY);
+		// Scene objects of every renderer are submitted to one queue and drawn sorted by pass, shader and material
+		Shader& voxel_gm = overlay.transparent_glass ? voxel_gm_shader.getVariant({ "TRANSPARENT_GLASS" }) : voxel_gm_shader;
+		voxel_gm.use();
+		light.pushUniforms(voxel_gm);
+		scene.submit(voxel_gm, camera, GREEDY);
 
-		voxel_hex_shader.use();
-		voxel_hex_shader.pushInt("side", overlay.hex_orientation);
-		light.pushUniforms(voxel_hex_shader);
-		scene.draw(voxel_hex_shader, camera, HEXAGON);
+		Shader& voxel_hex = voxel_hex_shaders[overlay.hex_orientation];
+		voxel_hex.use();
+		light.pushUniforms(voxel_hex);
+		scene.submit(voxel_hex, camera, HEXAGON);
 
-		voxbox_shader.use();
-		light.pushUniforms(voxbox_shader);
-		scene.drawVoxbox(voxbox_shader, camera);
+		scene.submit(voxel_rtx_shader, camera, RTX);
 
 		mesh_shader.use();
 		light.pushUniforms(mesh_shader);
-		scene.drawMesh(mesh_shader, camera);
+		scene.submitMesh(mesh_shader, camera);
 		model.draw(mesh_shader, camera);
 		glass.draw(mesh_shader, camera);
 
+		if (overlay.transparent_glass)
+			scene.submitGlass(voxel_glass_shader, camera);
+		scene.drawQueue(camera, PASS_OPAQUE);
+
+		voxbox_shader.use();
+		light.pushUniforms(voxbox_shader);
+		scene.drawVoxbox(voxbox_shader, camera);
+
 		glEnable(GL_BLEND);
 		water_shader.use();
 		water_shader.pushFloat("uTime", actual_time);
 		screen.pushUniforms(water_shader);
 		scene.drawWater(water_shader, camera);
-
-		if (overlay.transparent_glass) {
-			voxel_glass_shader.use();
-			voxel_glass_shader.pushVec3("light_pos", light.position);
-			scene.draw(voxel_glass_shader, camera, GREEDY);
-		}
+		scene.drawQueue(camera, PASS_TRANSPARENT);
 		glDisable(GL_BLEND);
 
 		//screen_shader.use();
 		//screen.draw(screen_shader, camera);
-		voxel_rtx_shader.use();
-		scene.draw(voxel_rtx_shader, camera, RTX);
 
 		rope_shader.use();
 		scene.drawRope(rope_shader, camera);
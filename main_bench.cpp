@@ -0,0 +1,152 @@
+#include <tuple>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_set>
+
+#include "src/obj_loader.h"
+#include "src/vox_loader.h"
+#include "src/render_vox_hex.h"
+#include "src/schematic_voxelizer.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "lib/stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "lib/stb_image_write.h"
+
+using namespace std;
+
+// Hash set version that TrimVoxels replaced, kept to check that the output is identical
+static void TrimVoxelsReference(const vector<MV_Voxel>& voxels, vector<MV_Voxel>& trimmed) {
+	unordered_set<tuple<uint8_t, uint8_t, uint8_t>, VoxelHash> positions;
+	for (vector<MV_Voxel>::const_iterator it = voxels.begin(); it != voxels.end(); it++)
+		if (it->index != HOLE_INDEX)
+			positions.insert(make_tuple(it->x, it->y, it->z));
+
+	const int dx[] = { -1, 1, 0, 0, 0, 0 };
+	const int dy[] = { 0, 0, -1, 1, 0, 0 };
+	const int dz[] = { 0, 0, 0, 0, -1, 1 };
+	for (vector<MV_Voxel>::const_iterator it = voxels.begin(); it != voxels.end(); it++) {
+		if (it->index == HOLE_INDEX) continue;
+		bool is_exposed = false;
+		for (int i = 0; i < 6 && !is_exposed; i++) {
+			int nx = it->x + dx[i];
+			int ny = it->y + dy[i];
+			int nz = it->z + dz[i];
+			is_exposed = nx < 0 || ny < 0 || nz < 0 || nx > 255 || ny > 255 || nz > 255 ||
+			             positions.find(make_tuple(nx, ny, nz)) == positions.end();
+		}
+		if (is_exposed)
+			trimmed.push_back(*it);
+	}
+}
+
+// 256^3 shapes: a solid block, terrain from a height field and 50% random noise with a few holes
+static vector<MV_Voxel> GenerateShape(const char* name) {
+	const int SIZE = 256;
+	vector<MV_Voxel> voxels;
+	mt19937 random(1234);
+	for (int z = 0; z < SIZE; z++)
+		for (int y = 0; y < SIZE; y++)
+			for (int x = 0; x < SIZE; x++) {
+				bool solid = true;
+				uint8_t index = 1 + (x + y + z) % 200;
+				if (strcmp(name, "terrain") == 0)
+					solid = z < 128 + 40 * sinf(x * 0.05f) * cosf(y * 0.07f);
+				else if (strcmp(name, "noise") == 0) {
+					solid = random() % 2 == 0;
+					if (random() % 64 == 0) index = HOLE_INDEX;
+				}
+				if (solid) {
+					MV_Voxel voxel = { (uint8_t)x, (uint8_t)y, (uint8_t)z, index };
+					voxels.push_back(voxel);
+				}
+			}
+	return voxels;
+}
+
+template<typename Function>
+static double TimeMs(Function function, vector<MV_Voxel>& output, int runs) {
+	double best = 1e9;
+	for (int i = 0; i < runs; i++) {
+		output.clear();
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		function(output);
+		chrono::duration<double, milli> elapsed = chrono::high_resolution_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+// A red and a green full block side by side at one voxel per block, the palette is sorted by the median cut on red
+static bool CheckVoxelizeSchematic() {
+	BlockGrid grid;
+	grid.resize(2, 1, 1, 0);
+	grid.set(0, 0, 0, 1);
+	grid.set(1, 0, 0, 2);
+	vector<BlockModel> models(3);
+	vector<vector<VoxelBox> > block_boxes(3);
+	VoxelBox red = { ivec3(0, 0, 0), ivec3(16, 16, 16), vec4(1, 0, 0, 1) };
+	VoxelBox green = { ivec3(0, 0, 0), ivec3(16, 16, 16), vec4(0, 1, 0, 1) };
+	block_boxes[1].push_back(red);
+	block_boxes[2].push_back(green);
+
+	MV_Color palette[256];
+	vector<VoxelVolume> volumes;
+	VoxelizeSchematic(grid, models, block_boxes, 1, palette, volumes);
+	bool passed = volumes.size() == 1 && volumes[0].shape.voxels.size() == 2;
+	if (passed) {
+		const vector<MV_Voxel>& voxels = volumes[0].shape.voxels;
+		passed = voxels[0].x == 0 && voxels[0].index == 2 && voxels[1].x == 1 && voxels[1].index == 1 &&
+		         palette[1].r == 0 && palette[1].g == 255 && palette[2].r == 255 && palette[2].g == 0;
+	}
+	printf("[INFO] VoxelizeSchematic 2 block check | %s\n", passed ? "passed" : "FAILED");
+	return passed;
+}
+
+// Parse throughput of the vehicle mesh drawn by vox_render, best of a few loads
+static void BenchOBJ() {
+	const char* path = "meshes/LTM1300.obj";
+	OBJStats best;
+	best.seconds = 1e9;
+	for (int i = 0; i < 5; i++) {
+		vector<MeshVertex> vertices;
+		vector<GLuint> indices;
+		OBJStats stats;
+		if (!LoadOBJ(path, vertices, indices, stats)) {
+			printf("[Warning] OBJ benchmark skipped\n");
+			return;
+		}
+		if (stats.seconds < best.seconds)
+			best = stats;
+	}
+	double megabytes = best.file_size / (1024.0 * 1024.0);
+	printf("[INFO] OBJ %s %.1f MB | %7.2f ms | %6.0f MB/s | %d triangles, %d vertices (%.2f per triangle)\n", path,
+		megabytes, best.seconds * 1000.0, megabytes / std::max(best.seconds, 1e-6), best.triangles, best.vertices,
+		best.triangles > 0 ? (float)best.vertices / best.triangles : 0.0f);
+}
+
+// Microbenchmarks of exposed voxel extraction, best of a few runs for each shape, and of OBJ loading
+int main() {
+	const char* shapes[] = { "solid", "terrain", "noise" };
+	bool identical = true;
+	for (const char* name : shapes) {
+		vector<MV_Voxel> voxels = GenerateShape(name);
+		vector<MV_Voxel> reference, trimmed;
+		double reference_ms = TimeMs([&](vector<MV_Voxel>& out) { TrimVoxelsReference(voxels, out); }, reference, 1);
+		double trimmed_ms = TimeMs([&](vector<MV_Voxel>& out) { TrimVoxels(voxels, out); }, trimmed, 5);
+		bool same = reference.size() == trimmed.size() &&
+		            memcmp(reference.data(), trimmed.data(), trimmed.size() * sizeof(MV_Voxel)) == 0;
+		identical = identical && same;
+		printf("[INFO] %-8s %9d voxels -> %8d exposed | hash set %9.2f ms | bitmask %7.2f ms | %s\n", name, (int)voxels.size(),
+			(int)trimmed.size(), reference_ms, trimmed_ms, same ? "identical" : "MISMATCH");
+	}
+	if (!identical)
+		printf("[ERROR] TrimVoxels output differs from the reference\n");
+	BenchOBJ();
+	bool voxelized = CheckVoxelizeSchematic();
+	return identical && voxelized ? 0 : 1;
+}
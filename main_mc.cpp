@@ -1,7 +1,13 @@
 #include <map>
+#include <set>
 #include <vector>
 #include <fstream>
+#include <math.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <mutex>
+#include <algorithm>
 #include <unordered_set>
 
 #include <glm/glm.hpp>
@@ -14,7 +20,17 @@
 #include "src/utils.h"
 #include "src/camera.h"
 #include "src/shader.h"
+#include "src/vox_loader.h"
 #include "src/render_mesh.h"
+#include "src/mapped_file.h"
+#include "src/block_database.h"
+#include "src/worker_pool.h"
+#include "src/world_mesher.h"
+#include "src/shadow_volume.h"
+#include "src/render_vox_rtx.h"
+#include "src/postprocessing.h"
+#include "src/schematic_loader.h"
+#include "src/schematic_voxelizer.h"
 
 #include "mc_blocks.h"
 
@@ -48,30 +64,68 @@ static const GLuint quad_indices[] = {
 	1, 3, 2,
 };
 
+// Returns -1 for the null vector
+static int DirectionIndex(vec3 normal) {
+	ivec3 direction = ivec3(round(normal));
+	for (int i = 0; i < 6; i++)
+		if (direction == DIRECTIONS[i]) return i;
+	return -1;
+}
+
+static vec3 FaceNormal(string face) {
+	if (face == "east") return vec3(1, 0, 0);
+	if (face == "west") return vec3(-1, 0, 0);
+	if (face == "up") return vec3(0, 1, 0);
+	if (face == "down") return vec3(0, -1, 0);
+	if (face == "south") return vec3(0, 0, 1);
+	if (face == "north") return vec3(0, 0, -1);
+	return vec3(0, 0, 0);
+}
+
+// Resolved blocks, models and texture layers are cached in a flat binary file that is memory mapped on later runs
+static const char* DATABASE_PATH = "../minecraft/blocks.db";
+static const uint32_t DATABASE_MAGIC = 0x4244434D; // "MCDB"
+static const uint32_t DATABASE_VERSION = 2;
+
 class Quad {
 private:
-	//VAO vao;
-	GLuint texture;
+	int layer;
 	int texture_rotation = 0;
 	vec2 size = vec2(1, 1);
 	vec2 uv_min = vec2(0, 0);
 	vec2 uv_max = vec2(1, 1);
 	vec4 tint_color = vec4(1, 1, 1, 1);
+	vec3 cull_normal = vec3(0, 0, 0);
 
 	vec3 position = vec3(0, 0, 0);
 	quat rotation = quat(1, 0, 0, 0);
 	vec3 world_position = vec3(0, 0, 0);
 	quat world_rotation = quat(1, 0, 0, 0);
 public:
-	Quad(GLuint texture) {
-		this->texture = texture;
-		/*VBO vbo(quad_vertices, sizeof(quad_vertices));
-		EBO ebo(quad_indices, sizeof(quad_indices));
-		vao.linkAttrib(0, 2, GL_FLOAT, 4 * sizeof(GLfloat), (GLvoid*)0);
-		vao.linkAttrib(1, 2, GL_FLOAT, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
-		vao.unbind();
-		vbo.unbind();
-		ebo.unbind();*/
+	Quad(int layer) {
+		this->layer = layer;
+	}
+	Quad(DatabaseReader& reader) {
+		layer = reader.read<int32_t>();
+		texture_rotation = reader.read<int32_t>();
+		size = reader.read<vec2>();
+		uv_min = reader.read<vec2>();
+		uv_max = reader.read<vec2>();
+		tint_color = reader.read<vec4>();
+		cull_normal = reader.read<vec3>();
+		position = reader.read<vec3>();
+		rotation = reader.read<quat>();
+	}
+	void write(DatabaseWriter& writer) {
+		writer.write((int32_t)layer);
+		writer.write((int32_t)texture_rotation);
+		writer.write(size);
+		writer.write(uv_min);
+		writer.write(uv_max);
+		writer.write(tint_color);
+		writer.write(cull_normal);
+		writer.write(position);
+		writer.write(rotation);
 	}
 	void setSize(vec2 size) {
 		this->size = size;
@@ -94,27 +148,46 @@ public:
 	void setTint(vec4 color) {
 		tint_color = color;
 	}
-	void draw(Shader& shader, Camera& camera) {
-		shader.pushMatrix("camera", camera.vp_matrix);
-		shader.pushTexture2D("diffuse", texture, 0);
-		shader.pushVec2("size", size);
-		shader.pushVec4("tint_color", tint_color);
-		shader.pushVec2("uv_min", uv_min);
-		shader.pushVec2("uv_max", uv_max);
-		shader.pushInt("tex_rot", texture_rotation);
-
-		mat4 pos = translate(mat4(1.0f), position);
-		mat4 rot = mat4_cast(rotation);
-		mat4 w_pos = translate(mat4(1.0f), world_position);
-		mat4 w_rot = mat4_cast(world_rotation);
-		shader.pushMatrix("position", pos);
-		shader.pushMatrix("rotation", rot);
-		shader.pushMatrix("world_pos", w_pos);
-		shader.pushMatrix("world_rot", w_rot);
-
-		//vao.bind();
-		glDrawElements(GL_TRIANGLES, sizeof(quad_indices) / sizeof(GLuint), GL_UNSIGNED_INT, 0);
-		//vao.unbind();
+	void setCullNormal(vec3 normal) {
+		cull_normal = normal;
+	}
+	vec3 getCullNormal() {
+		return cull_normal;
+	}
+	int getLayer() {
+		return layer;
+	}
+	vec4 getTint() {
+		return tint_color;
+	}
+	// Same transform chain as the old per-quad vertex shader: world * local * corner
+	void bake(ChunkVertex* corners) {
+		for (int i = 0; i < 4; i++) {
+			vec2 corner = vec2(quad_vertices[i * 4], quad_vertices[i * 4 + 1]);
+			vec2 uv = vec2(quad_vertices[i * 4 + 2], quad_vertices[i * 4 + 3]);
+			if (texture_rotation == 90)
+				uv = vec2(1.0f - uv.y, uv.x);
+			else if (texture_rotation == 180)
+				uv = vec2(1.0f - uv.x, 1.0f - uv.y);
+			else if (texture_rotation == 270)
+				uv = vec2(uv.y, 1.0f - uv.x);
+
+			ChunkVertex vertex;
+			vec3 local = position + rotation * vec3(corner * size, 0.0f);
+			vertex.position = world_position + world_rotation * local;
+			vertex.uv = uv_min + (uv_max - uv_min) * uv;
+			vertex.layer = layer;
+			vertex.tint = tint_color;
+			corners[i] = vertex;
+		}
+	}
+	void bake(vector<ChunkVertex>& vertices, vector<GLuint>& indices) {
+		GLuint base = vertices.size();
+		ChunkVertex corners[4];
+		bake(corners);
+		vertices.insert(vertices.end(), corners, corners + 4);
+		for (unsigned int i = 0; i < sizeof(quad_indices) / sizeof(GLuint); i++)
+			indices.push_back(base + quad_indices[i]);
 	}
 };
 
@@ -124,15 +197,33 @@ private:
 	vec3 from, to;
 	vector<Quad*> quads;
 	quat parent_rot = quat(1, 0, 0, 0);
+	quat world_rotation = quat(1, 0, 0, 0);
 public:
 	Cuboid(vec3 from, vec3 to) {
 		this->from = from;
 		this->to = to;
 		this->size = to - from;
 	}
-	void addFace(string orientation, quat parent_rot, GLuint texture, vec4 uv, int tex_rot, bool tinted) {
+	Cuboid(DatabaseReader& reader) {
+		from = reader.read<vec3>();
+		to = reader.read<vec3>();
+		size = to - from;
+		parent_rot = reader.read<quat>();
+		uint32_t quad_count = reader.read<uint32_t>();
+		for (uint32_t i = 0; i < quad_count && !reader.failed; i++)
+			quads.push_back(new Quad(reader));
+	}
+	void write(DatabaseWriter& writer) {
+		writer.write(from);
+		writer.write(to);
+		writer.write(parent_rot);
+		writer.write((uint32_t)quads.size());
+		for (vector<Quad*>::iterator it = quads.begin(); it != quads.end(); it++)
+			(*it)->write(writer);
+	}
+	void addFace(string orientation, quat parent_rot, int layer, vec4 uv, int tex_rot, bool tinted, string cullface) {
 		this->parent_rot = parent_rot;
-		Quad* quad = new Quad(texture);
+		Quad* quad = new Quad(layer);
 		vec2 face_size = vec2(16, 16);
 		vec3 position = vec3(0, 0, 0);
 		quat rotation = quat(1, 0, 0, 0);
@@ -184,18 +275,51 @@ public:
 		quad->setTransform(position / 16.0f, rotation);
 		quad->setUV(vec2(uv.x, uv.y) / 16.0f, vec2(uv.z, uv.w) / 16.0f, tex_rot);
 		if (tinted) quad->setTint(vec4(0.57f, 0.74f, 0.35f, 1.0f));
+		quad->setCullNormal(FaceNormal(cullface));
 		quads.push_back(quad);
 	}
 	void setTransform(vec3 world_pos, quat world_rot) {
+		world_rotation = world_rot;
 		vec3 offset = (from + to) / 32.0f;
 		for (vector<Quad*>::iterator it = quads.begin(); it != quads.end(); it++) {
 			(*it)->setWorldPosition(world_pos + world_rot * offset - world_rot * vec3(0.5, 0.5, 0.5));
 			(*it)->setWorldRotation(world_rot * parent_rot);
 		}
 	}
-	void draw(Shader& shader, Camera& camera) {
+	void bake(vector<ChunkVertex>& vertices, vector<GLuint>& indices) {
 		for (vector<Quad*>::iterator it = quads.begin(); it != quads.end(); it++)
-			(*it)->draw(shader, camera);
+			(*it)->bake(vertices, indices);
+	}
+	// The cull side follows the block variant rotation but not the element rotation
+	void bake(vector<BlockFace>& faces) {
+		for (vector<Quad*>::iterator it = quads.begin(); it != quads.end(); it++) {
+			BlockFace face;
+			(*it)->bake(face.vertices);
+			face.cull_face = DirectionIndex(world_rotation * (*it)->getCullNormal());
+			faces.push_back(face);
+		}
+	}
+	// Element rotations are ignored, planes such as flower stems get one voxel of thickness
+	VoxelBox getVoxelBox(quat rotation, const vector<vec4>& layer_colors) {
+		vec3 a = rotation * (from - vec3(8, 8, 8)) + vec3(8, 8, 8);
+		vec3 b = rotation * (to - vec3(8, 8, 8)) + vec3(8, 8, 8);
+		VoxelBox box;
+		box.min = ivec3(clamp(round(min(a, b)), vec3(0), vec3(16)));
+		box.max = ivec3(clamp(round(max(a, b)), vec3(0), vec3(16)));
+		for (int i = 0; i < 3; i++) {
+			if (box.max[i] > box.min[i]) continue;
+			box.min[i] = std::min(box.min[i], 15);
+			box.max[i] = box.min[i] + 1;
+		}
+		box.color = vec4(0, 0, 0, 0);
+		for (vector<Quad*>::iterator it = quads.begin(); it != quads.end(); it++) {
+			int layer = (*it)->getLayer();
+			if (layer < 0 || layer >= (int)layer_colors.size()) continue;
+			box.color += vec4(vec3(layer_colors[layer]) * vec3((*it)->getTint()), layer_colors[layer].a);
+		}
+		if (!quads.empty())
+			box.color /= (float)quads.size();
+		return box;
 	}
 	~Cuboid() {
 		for (vector<Quad*>::iterator it = quads.begin(); it != quads.end(); it++)
@@ -203,14 +327,19 @@ public:
 	}
 };
 
-map<string, GLuint> texture_cache;
+// Path to texture array layer, every texture is loaded once all blocks are known
+map<string, int> texture_cache;
+vector<string> texture_paths;
+mutex texture_mutex; // Models are loaded on worker threads
 
 class MC_Block {
 private:
 	vector<Cuboid*> cuboids;
-	map<string, GLuint> textures;
+	map<string, int> textures;
+	vector<string> files; // Model and parent paths, only known when parsed from json
 
 	void loadFile(string path) {
+		files.push_back(path);
 		ifstream file(path);
 		if (!file.is_open()) {
 			printf("[ERROR] File %s not found\n", path.c_str());
@@ -232,8 +361,11 @@ private:
 					textures[it.key()] = textures[texture_path];
 				} else {
 					texture_path = "../minecraft/textures/" + texture_path + ".png";
-					if (texture_cache.find(texture_path) == texture_cache.end())
-						texture_cache[texture_path] = LoadTexture2D(texture_path.c_str());
+					lock_guard<mutex> lock(texture_mutex);
+					if (texture_cache.find(texture_path) == texture_cache.end()) {
+						texture_cache[texture_path] = texture_paths.size();
+						texture_paths.push_back(texture_path);
+					}
 					if (textures.find(it.key()) == textures.end())
 						textures[it.key()] = texture_cache[texture_path];
 				}
@@ -280,8 +412,9 @@ private:
 					printf("[Warning] Texture %s not found for face %s\n", texture_str.c_str(), face_name.c_str());
 					break;
 				}
-				GLuint texture_id = textures[texture_str];
+				int layer = textures[texture_str];
 				bool tinted = face_js.find("tintindex") != face_js.end();
+				string cullface = face_js.find("cullface") != face_js.end() ? face_js["cullface"].get<string>() : "";
 				vec4 uv = vec4(0, 0, 16, 16);
 				int texture_rotation = -1;
 				if (face_js.find("uv") != face_js.end()) {
@@ -291,7 +424,7 @@ private:
 				}
 				if (face_js.find("rotation") != face_js.end())
 					texture_rotation = face_js["rotation"];
-				cuboid->addFace(face_name, rotation, texture_id, uv, texture_rotation, tinted);
+				cuboid->addFace(face_name, rotation, layer, uv, texture_rotation, tinted, cullface);
 			}
 			cuboids.push_back(cuboid);
 		}
@@ -311,13 +444,34 @@ public:
 		string path = "../minecraft/models/" + string(block_id) + ".json";
 		loadFile(path);	
 	}
+	MC_Block(DatabaseReader& reader) {
+		uint32_t cuboid_count = reader.read<uint32_t>();
+		for (uint32_t i = 0; i < cuboid_count && !reader.failed; i++)
+			cuboids.push_back(new Cuboid(reader));
+	}
+	void write(DatabaseWriter& writer) {
+		writer.write((uint32_t)cuboids.size());
+		for (vector<Cuboid*>::iterator it = cuboids.begin(); it != cuboids.end(); it++)
+			(*it)->write(writer);
+	}
 	void setTransform(vec3 pos, quat rot) {
 		for (vector<Cuboid*>::iterator it = cuboids.begin(); it != cuboids.end(); it++)
 			(*it)->setTransform(pos, rot);
 	}
-	void draw(Shader& shader, Camera& camera) {
+	void bake(vector<ChunkVertex>& vertices, vector<GLuint>& indices) {
 		for (vector<Cuboid*>::iterator it = cuboids.begin(); it != cuboids.end(); it++)
-			(*it)->draw(shader, camera);
+			(*it)->bake(vertices, indices);
+	}
+	void bake(vector<BlockFace>& faces) {
+		for (vector<Cuboid*>::iterator it = cuboids.begin(); it != cuboids.end(); it++)
+			(*it)->bake(faces);
+	}
+	const vector<string>& getFiles() const {
+		return files;
+	}
+	void getVoxelBoxes(quat rotation, const vector<vec4>& layer_colors, vector<VoxelBox>& boxes) {
+		for (vector<Cuboid*>::iterator it = cuboids.begin(); it != cuboids.end(); it++)
+			boxes.push_back((*it)->getVoxelBox(rotation, layer_colors));
 	}
 	~MC_Block() {
 		for (vector<Cuboid*>::iterator it = cuboids.begin(); it != cuboids.end(); it++)
@@ -338,18 +492,86 @@ bool operator==(const VariantInfo& lhs, const VariantInfo& rhs) {
 */
 map<string, MC_Block*> blocks_cache;
 
+// Every required property must be set, values may list alternatives like "north|south"
+static bool MatchProperties(const map<string, string>& required, const map<string, string>& properties) {
+	for (map<string, string>::const_iterator it = required.begin(); it != required.end(); it++) {
+		map<string, string>::const_iterator property = properties.find(it->first);
+		if (property == properties.end()) return false;
+		string values = "|" + it->second + "|";
+		if (values.find("|" + property->second + "|") == string::npos) return false;
+	}
+	return true;
+}
+
+static map<string, string> ReadProperties(json properties_js) {
+	map<string, string> properties;
+	for (json::iterator it = properties_js.begin(); it != properties_js.end(); it++)
+		properties[it.key()] = it.value().is_string() ? it.value().get<string>() : it.value().dump();
+	return properties;
+}
+
+// Variant keys look like "facing=east,half=bottom", the empty key matches any state
+static map<string, string> ParseVariantKey(const string& key) {
+	map<string, string> properties;
+	size_t start = 0;
+	while (start < key.size()) {
+		size_t end = key.find(',', start);
+		if (end == string::npos) end = key.size();
+		size_t equals = key.find('=', start);
+		if (equals != string::npos && equals < end)
+			properties[key.substr(start, equals - start)] = key.substr(equals + 1, end - equals - 1);
+		start = end + 1;
+	}
+	return properties;
+}
+
+// Multipart "when" clause flattened to alternatives of required properties, no alternative means always
+typedef vector<map<string, string> > Condition;
+
+static Condition ReadCondition(json when_js) {
+	Condition condition;
+	if (when_js.is_null()) return condition;
+	if (when_js.find("OR") != when_js.end()) {
+		for (json::iterator it = when_js["OR"].begin(); it != when_js["OR"].end(); it++) {
+			Condition alternatives = ReadCondition(*it);
+			condition.insert(condition.end(), alternatives.begin(), alternatives.end());
+		}
+	} else if (when_js.find("AND") != when_js.end()) {
+		map<string, string> required;
+		for (json::iterator it = when_js["AND"].begin(); it != when_js["AND"].end(); it++) {
+			map<string, string> properties = ReadProperties(*it);
+			required.insert(properties.begin(), properties.end());
+		}
+		condition.push_back(required);
+	} else
+		condition.push_back(ReadProperties(when_js));
+	return condition;
+}
+
+static bool MatchCondition(const Condition& condition, const map<string, string>& properties) {
+	if (condition.empty()) return true;
+	for (Condition::const_iterator it = condition.begin(); it != condition.end(); it++)
+		if (MatchProperties(*it, properties)) return true;
+	return false;
+}
+
+static string BlockstatePath(const string& block_id) {
+	return "../minecraft/blockstates/" + block_id + ".json";
+}
+
 class BlockVariant {
 private:
 	vector<VariantInfo> variants;
 	vector<VariantInfo> multipart;
+	vector<map<string, string> > variant_properties; // Per variant, weighted alternatives share the same properties
+	vector<Condition> multipart_conditions;
+	vector<int> multipart_parts; // Alternatives of the same part share the part index
 
 	VariantInfo readVariant(json variant_js) {
 		const string MC_PREFIX = "minecraft:";
 		string block_id = variant_js["model"];
 		if (block_id.find(MC_PREFIX) == 0)
 			block_id = block_id.substr(MC_PREFIX.size());
-		if (blocks_cache.find(block_id) == blocks_cache.end())
-			blocks_cache[block_id] = new MC_Block(block_id.c_str());
 
 		quat rotation = quat(1, 0, 0, 0);
 		if (variant_js.find("x") != variant_js.end()) {
@@ -385,82 +607,554 @@ private:
 		json variants_js = block_js["variants"];
 		for (json::iterator it = variants_js.begin(); it != variants_js.end(); it++) {
 			json variant_js = it.value();
+			map<string, string> properties = ParseVariantKey(it.key());
 			if (variant_js.is_object()) {
 				VariantInfo info = readVariant(variant_js);
 				variants.push_back(info);	
+				variant_properties.push_back(properties);
 			} else if (variant_js.is_array()) {
 				for (json::iterator it = variant_js.begin(); it != variant_js.end(); it++) {
 					VariantInfo info = readVariant(*it);
 					variants.push_back(info);
+					variant_properties.push_back(properties);
 				}
 			}
 		}
 
 		json multipart_js = block_js["multipart"];
-		for (json::iterator it = multipart_js.begin(); it != multipart_js.end(); it++) {
+		int part = 0;
+		for (json::iterator it = multipart_js.begin(); it != multipart_js.end(); it++, part++) {
 			json part_js = it.value();
 			json variant_js = part_js["apply"];
+			Condition condition = ReadCondition(part_js.find("when") != part_js.end() ? part_js["when"] : json());
 			if (variant_js.is_object()) {
 				VariantInfo info = readVariant(variant_js);
 				multipart.push_back(info);	
+				multipart_conditions.push_back(condition);
+				multipart_parts.push_back(part);
 			} else if (variant_js.is_array()) {
 				for (json::iterator it = variant_js.begin(); it != variant_js.end(); it++) {
 					VariantInfo info = readVariant(*it);
 					multipart.push_back(info);
+					multipart_conditions.push_back(condition);
+					multipart_parts.push_back(part);
 				}
 			}
 		}
 	}
 public:
+	// Only parses the blockstate, the models it uses are loaded separately so this can run on any thread
 	BlockVariant(string block_id) {
-		string path = "../minecraft/blockstates/" + block_id + ".json";
-		loadFile(path);
+		loadFile(BlockstatePath(block_id));
+	}
+	BlockVariant(DatabaseReader& reader) {
+		uint32_t variant_count = reader.read<uint32_t>();
+		for (uint32_t i = 0; i < variant_count && !reader.failed; i++) {
+			VariantInfo info;
+			info.model = reader.readString();
+			info.rotation = reader.read<quat>();
+			variants.push_back(info);
+			variant_properties.push_back(reader.readProperties());
+		}
+		uint32_t part_count = reader.read<uint32_t>();
+		for (uint32_t i = 0; i < part_count && !reader.failed; i++) {
+			VariantInfo info;
+			info.model = reader.readString();
+			info.rotation = reader.read<quat>();
+			multipart.push_back(info);
+			multipart_parts.push_back(reader.read<int32_t>());
+			Condition condition(reader.read<uint32_t>());
+			for (Condition::iterator it = condition.begin(); it != condition.end() && !reader.failed; it++)
+				*it = reader.readProperties();
+			multipart_conditions.push_back(condition);
+		}
+	}
+	void write(DatabaseWriter& writer) {
+		writer.write((uint32_t)variants.size());
+		for (unsigned int i = 0; i < variants.size(); i++) {
+			writer.writeString(variants[i].model);
+			writer.write(variants[i].rotation);
+			writer.writeProperties(variant_properties[i]);
+		}
+		writer.write((uint32_t)multipart.size());
+		for (unsigned int i = 0; i < multipart.size(); i++) {
+			writer.writeString(multipart[i].model);
+			writer.write(multipart[i].rotation);
+			writer.write((int32_t)multipart_parts[i]);
+			writer.write((uint32_t)multipart_conditions[i].size());
+			for (Condition::iterator it = multipart_conditions[i].begin(); it != multipart_conditions[i].end(); it++)
+				writer.writeProperties(*it);
+		}
+	}
+	void getModels(set<string>& models) {
+		for (vector<VariantInfo>::iterator it = variants.begin(); it != variants.end(); it++)
+			models.insert(it->model);
+		for (vector<VariantInfo>::iterator it = multipart.begin(); it != multipart.end(); it++)
+			models.insert(it->model);
 	}
 	unsigned int getVariantCount() {
 		bool is_multipart = multipart.size() > 0;
 		return variants.size() + (is_multipart ? 1 : 0);
 	}
-	void draw(Shader& shader, Camera& camera, unsigned int index, vec3 pos) {
+	void bake(unsigned int index, vec3 pos, vector<ChunkVertex>& vertices, vector<GLuint>& indices) {
 		if (index < variants.size()) {
 			VariantInfo	info = variants[index];
 			MC_Block* block = blocks_cache[info.model];
 			block->setTransform(pos, info.rotation);
-			block->draw(shader, camera);
+			block->bake(vertices, indices);
 		} else {
 			for (vector<VariantInfo>::iterator it = multipart.begin(); it != multipart.end(); it++) {
 				VariantInfo	info = *it;
 				MC_Block* block = blocks_cache[info.model];
 				block->setTransform(pos, info.rotation);
-				block->draw(shader, camera);
+				block->bake(vertices, indices);
 			}
 		}
 	}
+	// Models of a block state, the first variant whose properties match or every multipart whose condition holds
+	vector<VariantInfo> resolve(const map<string, string>& properties) {
+		vector<VariantInfo> parts;
+		for (unsigned int i = 0; i < variants.size(); i++)
+			if (MatchProperties(variant_properties[i], properties)) {
+				parts.push_back(variants[i]);
+				return parts;
+			}
+		if (!variants.empty())
+			parts.push_back(variants[0]);
+		int last_part = -1;
+		for (unsigned int i = 0; i < multipart.size(); i++)
+			if (multipart_parts[i] != last_part && MatchCondition(multipart_conditions[i], properties)) {
+				parts.push_back(multipart[i]);
+				last_part = multipart_parts[i];
+			}
+		return parts;
+	}
 };
 
-int main(/*int argc, char* argv[]*/) {
+// Static geometry of a CHUNK_SIZE x CHUNK_SIZE column of preview cells or of a schematic grid chunk, drawn with one call
+static const int CHUNK_SIZE = 16;
+
+class Chunk {
+private:
+	VAO vao;
+	GLsizei index_count;
+public:
+	Chunk(const vector<ChunkVertex>& vertices, const vector<GLuint>& indices) {
+		index_count = indices.size();
+		VBO vbo(vertices);
+		EBO ebo(indices);
+		vao.linkAttrib(0, 3, GL_FLOAT, sizeof(ChunkVertex), (GLvoid*)offsetof(ChunkVertex, position));
+		vao.linkAttrib(1, 2, GL_FLOAT, sizeof(ChunkVertex), (GLvoid*)offsetof(ChunkVertex, uv));
+		vao.linkAttrib(2, 1, GL_FLOAT, sizeof(ChunkVertex), (GLvoid*)offsetof(ChunkVertex, layer));
+		vao.linkAttrib(3, 4, GL_FLOAT, sizeof(ChunkVertex), (GLvoid*)offsetof(ChunkVertex, tint));
+		vao.unbind();
+		vbo.unbind();
+		ebo.unbind();
+	}
+	void draw() {
+		vao.bind();
+		glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+		vao.unbind();
+	}
+};
+
+BlockModel BuildBlockModel(const vector<VariantInfo>& parts, const vector<bool>& opaque_layers) {
+	BlockModel model;
+	for (vector<VariantInfo>::const_iterator it = parts.begin(); it != parts.end(); it++) {
+		MC_Block* block = blocks_cache[it->model];
+		block->setTransform(vec3(0, 0, 0), it->rotation);
+		block->bake(model.faces);
+	}
+	bool opaque_sides[6] = { false, false, false, false, false, false };
+	for (vector<BlockFace>::iterator it = model.faces.begin(); it != model.faces.end(); it++)
+		ClassifyFace(*it, opaque_layers, opaque_sides);
+	model.opaque_cube = true;
+	for (int i = 0; i < 6; i++)
+		model.opaque_cube = model.opaque_cube && opaque_sides[i];
+	return model;
+}
+
+// Blockstates are parsed in parallel first, then every model they reference that is not cached yet
+void ResolveBlocks(const vector<string>& block_ids, map<string, BlockVariant*>& states) {
+	set<string> unique_ids;
+	for (vector<string>::const_iterator it = block_ids.begin(); it != block_ids.end(); it++)
+		if (states.find(*it) == states.end())
+			unique_ids.insert(*it);
+	vector<string> missing(unique_ids.begin(), unique_ids.end());
+	vector<BlockVariant*> variants(missing.size());
+	ParallelFor(missing.size(), [&](int i) { variants[i] = new BlockVariant(missing[i]); });
+
+	set<string> model_set;
+	for (vector<BlockVariant*>::iterator it = variants.begin(); it != variants.end(); it++)
+		(*it)->getModels(model_set);
+	vector<string> model_ids;
+	for (set<string>::iterator it = model_set.begin(); it != model_set.end(); it++)
+		if (blocks_cache.find(*it) == blocks_cache.end())
+			model_ids.push_back(*it);
+	vector<MC_Block*> models(model_ids.size());
+	ParallelFor(model_ids.size(), [&](int i) { models[i] = new MC_Block(model_ids[i].c_str()); });
+
+	for (unsigned int i = 0; i < model_ids.size(); i++)
+		blocks_cache[model_ids[i]] = models[i];
+	for (unsigned int i = 0; i < missing.size(); i++)
+		states[missing[i]] = variants[i];
+	printf("[INFO] Resolved %d blocks and %d models\n", (int)missing.size(), (int)model_ids.size());
+}
+
+// RGBA8 layers with the size of the first texture, the first ones may point into the mapped database
+struct TextureLayers {
+	int layer_size = 0;
+	const uint8_t* mapped = NULL;
+	int mapped_count = 0;
+	vector<vector<uint8_t> > decoded;
+	vector<bool> opaque;
+
+	int getCount() const {
+		return mapped_count + decoded.size();
+	}
+	const uint8_t* getLayer(int index) const {
+		if (index < mapped_count)
+			return mapped + (size_t)index * layer_size * layer_size * 4;
+		return decoded[index - mapped_count].data();
+	}
+};
+
+// Decodes the paths that have no layer yet, animated strips keep their first frame
+void DecodeTextures(const vector<string>& paths, TextureLayers& textures) {
+	int first = textures.getCount();
+	int count = (int)paths.size() - first;
+	if (count <= 0) return;
+
+	stbi_set_flip_vertically_on_load(true);
+	vector<uint8_t*> images(count);
+	vector<ivec2> sizes(count);
+	ParallelFor(count, [&](int i) {
+		int channels;
+		images[i] = stbi_load(paths[first + i].c_str(), &sizes[i].x, &sizes[i].y, &channels, STBI_rgb_alpha);
+	});
+	for (int i = 0; i < count; i++) {
+		if (images[i] == NULL)
+			printf("[Warning] Failed to load texture %s\n", paths[first + i].c_str());
+		else if (textures.layer_size == 0)
+			textures.layer_size = sizes[i].x;
+	}
+	if (textures.layer_size == 0)
+		textures.layer_size = 16;
+
+	int layer_size = textures.layer_size;
+	textures.decoded.resize(textures.decoded.size() + count);
+	vector<uint8_t> opaque(count, 0); // vector<bool> elements can not be written from several threads
+	ParallelFor(count, [&](int i) {
+		vector<uint8_t>& layer = textures.decoded[first - textures.mapped_count + i];
+		layer.assign(layer_size * layer_size * 4, 0);
+		if (images[i] == NULL) return;
+		// Nearest resampling of the top square, rows are flipped so it is at the end of the data
+		int width = sizes[i].x;
+		int frame = std::min(width, sizes[i].y);
+		int first_row = sizes[i].y - frame;
+		for (int y = 0; y < layer_size; y++)
+			for (int x = 0; x < layer_size; x++) {
+				int sx = x * width / layer_size;
+				int sy = first_row + y * frame / layer_size;
+				memcpy(&layer[(y * layer_size + x) * 4], &images[i][(sy * width + sx) * 4], 4);
+			}
+		stbi_image_free(images[i]);
+		opaque[i] = 1;
+		for (unsigned int j = 3; j < layer.size() && opaque[i]; j += 4)
+			opaque[i] = layer[j] == 255;
+	});
+	textures.opaque.insert(textures.opaque.end(), opaque.begin(), opaque.end());
+}
+
+GLuint UploadTextureArray(const TextureLayers& textures) {
+	int layer_size = std::max(textures.layer_size, 1);
+	GLuint texture_id;
+	glGenTextures(1, &texture_id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture_id);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, layer_size, layer_size, std::max(textures.getCount(), 1), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	for (int i = 0; i < textures.getCount(); i++)
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, layer_size, layer_size, 1, GL_RGBA, GL_UNSIGNED_BYTE, textures.getLayer(i));
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return texture_id;
+}
+
+// ----------------------------------------------------------------------------
+
+// FNV-1a of the block list, the database is rebuilt when it or one of the files it was built from changes
+static uint64_t HashBlockList(const vector<string>& block_ids) {
+	uint64_t hash = 14695981039346656037ull;
+	for (vector<string>::const_iterator it = block_ids.begin(); it != block_ids.end(); it++)
+		for (unsigned int i = 0; i <= it->size(); i++) {
+			hash ^= i < it->size() ? (uint8_t)(*it)[i] : 0;
+			hash *= 1099511628211ull;
+		}
+	return hash;
+}
+
+void SaveBlockDatabase(uint64_t hash, const map<string, BlockVariant*>& states, const TextureLayers& textures) {
+	FILE* file = fopen(DATABASE_PATH, "wb");
+	if (file == NULL) {
+		printf("[Warning] Could not write %s\n", DATABASE_PATH);
+		return;
+	}
+	DatabaseWriter writer(file);
+	writer.write(DATABASE_MAGIC);
+	writer.write(DATABASE_VERSION);
+	writer.write(hash);
+
+	vector<string> assets(texture_paths.begin(), texture_paths.end());
+	for (map<string, MC_Block*>::iterator it = blocks_cache.begin(); it != blocks_cache.end(); it++)
+		assets.insert(assets.end(), it->second->getFiles().begin(), it->second->getFiles().end());
+	for (map<string, BlockVariant*>::const_iterator it = states.begin(); it != states.end(); it++)
+		assets.push_back(BlockstatePath(it->first));
+	writer.writeAssets(assets);
+
+	writer.write((uint32_t)textures.getCount());
+	for (int i = 0; i < textures.getCount(); i++)
+		writer.writeString(texture_paths[i]);
+	writer.write((int32_t)textures.layer_size);
+	for (int i = 0; i < textures.getCount(); i++)
+		writer.write((uint8_t)textures.opaque[i]);
+	for (int i = 0; i < textures.getCount(); i++)
+		writer.writeData(textures.getLayer(i), textures.layer_size * textures.layer_size * 4);
+
+	writer.write((uint32_t)blocks_cache.size());
+	for (map<string, MC_Block*>::iterator it = blocks_cache.begin(); it != blocks_cache.end(); it++) {
+		writer.writeString(it->first);
+		it->second->write(writer);
+	}
+	writer.write((uint32_t)states.size());
+	for (map<string, BlockVariant*>::const_iterator it = states.begin(); it != states.end(); it++) {
+		writer.writeString(it->first);
+		it->second->write(writer);
+	}
+	fclose(file);
+	printf("[INFO] Wrote block database %s\n", DATABASE_PATH);
+}
+
+// Texture layers point into the mapping, so the file has to stay open until they are uploaded
+bool LoadBlockDatabase(MappedFile& file, uint64_t hash, map<string, BlockVariant*>& states, TextureLayers& textures) {
+	if (!file.open(DATABASE_PATH))
+		return false;
+	DatabaseReader reader(file.data, file.size);
+	if (reader.read<uint32_t>() != DATABASE_MAGIC || reader.read<uint32_t>() != DATABASE_VERSION || reader.read<uint64_t>() != hash ||
+		!reader.readAssets()) {
+		printf("[INFO] Block database %s is out of date\n", DATABASE_PATH);
+		return false;
+	}
+
+	uint32_t texture_count = reader.read<uint32_t>();
+	vector<string> paths;
+	for (uint32_t i = 0; i < texture_count && !reader.failed; i++)
+		paths.push_back(reader.readString());
+	int layer_size = reader.read<int32_t>();
+	const char* opaque = reader.readData(texture_count);
+	const char* pixels = reader.readData((size_t)texture_count * layer_size * layer_size * 4);
+
+	map<string, MC_Block*> models;
+	uint32_t model_count = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < model_count && !reader.failed; i++) {
+		string model_id = reader.readString();
+		models[model_id] = new MC_Block(reader);
+	}
+	map<string, BlockVariant*> variants;
+	uint32_t variant_count = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < variant_count && !reader.failed; i++) {
+		string block_id = reader.readString();
+		variants[block_id] = new BlockVariant(reader);
+	}
+	if (reader.failed) {
+		printf("[Warning] Block database %s is truncated\n", DATABASE_PATH);
+		for (map<string, MC_Block*>::iterator it = models.begin(); it != models.end(); it++)
+			delete it->second;
+		for (map<string, BlockVariant*>::iterator it = variants.begin(); it != variants.end(); it++)
+			delete it->second;
+		return false;
+	}
+
+	for (unsigned int i = 0; i < paths.size(); i++) {
+		texture_cache[paths[i]] = i;
+		texture_paths.push_back(paths[i]);
+	}
+	textures.layer_size = layer_size;
+	textures.mapped = (const uint8_t*)pixels;
+	textures.mapped_count = texture_count;
+	textures.opaque.assign(opaque, opaque + texture_count);
+	blocks_cache.insert(models.begin(), models.end());
+	states.insert(variants.begin(), variants.end());
+	return true;
+}
+
+int main(int argc, char* argv[]) {
 	GLFWwindow* window = InitOpenGL("Minecraft Renderer");
 	Shader mc_shader("shaders/minecraft_vert.glsl", "shaders/minecraft_frag.glsl");
+	Shader voxel_rtx_shader("gbuffervox");
+	Shader lighting_shader("editorlighting");
+	Shader ambient_light_shader("ambientlight");
+	Shader denoise_shader("denoise");
+	Shader screen_shader("screen");
+	Shader::finishAll();
+
+	// Without a schematic every variant of every block is shown, with 1 or 16 voxels per block it is ray marched
+	Schematic schematic;
+	bool has_schematic = argc > 1 && schematic.load(argv[1]);
+	int voxels_per_block = argc > 2 ? atoi(argv[2]) : 0;
+	if (voxels_per_block != 0 && voxels_per_block != 1 && voxels_per_block != 16) {
+		printf("[Warning] %d voxels per block is not supported, use 1 or 16\n", voxels_per_block);
+		voxels_per_block = 0;
+	}
+	bool voxel_mode = has_schematic && voxels_per_block > 0;
+
+	double start_time = glfwGetTime();
+	map<string, BlockVariant*> states;
+	TextureLayers textures;
+	MappedFile database;
+	uint64_t hash = HashBlockList(MC_BLOCKS);
+	if (LoadBlockDatabase(database, hash, states, textures)) {
+		printf("[INFO] Loaded %d blocks from %s\n", (int)states.size(), DATABASE_PATH);
+	} else {
+		ResolveBlocks(MC_BLOCKS, states);
+		DecodeTextures(texture_paths, textures);
+		SaveBlockDatabase(hash, states, textures);
+	}
 
 	vector<BlockVariant*> block_variants;
-	for (vector<string>::iterator it = MC_BLOCKS.begin(); it != MC_BLOCKS.end(); it++) {
-		printf("[INFO] Loading block %s\n", it->c_str());
-		block_variants.push_back(new BlockVariant(*it));
+	vector<vector<VariantInfo> > palette_parts;
+	if (has_schematic) {
+		// Blocks outside the known list are resolved from their json
+		vector<string> block_ids;
+		for (vector<BlockState>::iterator it = schematic.palette.begin(); it != schematic.palette.end(); it++)
+			if (!it->name.empty() && it->name != "air" && it->name != "cave_air" && it->name != "void_air")
+				block_ids.push_back(it->name);
+		ResolveBlocks(block_ids, states);
+		DecodeTextures(texture_paths, textures);
+		for (vector<BlockState>::iterator it = schematic.palette.begin(); it != schematic.palette.end(); it++) {
+			vector<VariantInfo> parts;
+			if (states.find(it->name) != states.end())
+				parts = states[it->name]->resolve(it->properties);
+			palette_parts.push_back(parts);
+		}
+	} else {
+		for (vector<string>::iterator it = MC_BLOCKS.begin(); it != MC_BLOCKS.end(); it++)
+			block_variants.push_back(states[*it]);
 	}
+	printf("[INFO] Blocks ready in %.2f s\n", glfwGetTime() - start_time);
 
-	Camera camera(vec3(0, 2.5, 10));
+	vec3 camera_position = vec3(0, 2.5, 10);
+	if (voxel_mode) // Voxels are 0.1 m and the build is centered on the origin
+		camera_position = vec3(0.0f, 0.1f * voxels_per_block * schematic.blocks.getSizeY() + 5.0f, 0.05f * voxels_per_block * schematic.blocks.getSizeZ() + 10.0f);
+	else if (has_schematic)
+		camera_position = vec3(0.5f * schematic.blocks.getSizeX(), schematic.blocks.getSizeY() + 10.0f, schematic.blocks.getSizeZ() + 10.0f);
+	Camera camera(camera_position);
 	glfwSetWindowUserPointer(window, &camera);
 	glfwSetKeyCallback(window, key_press_callback);
 
-	VAO vao;
-	VBO vbo(quad_vertices, sizeof(quad_vertices));
-	EBO ebo(quad_indices, sizeof(quad_indices));
-	vao.linkAttrib(0, 2, GL_FLOAT, 4 * sizeof(GLfloat), (GLvoid*)0);
-	vao.linkAttrib(1, 2, GL_FLOAT, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
-	vao.unbind();
-	vbo.unbind();
-	ebo.unbind();
+	GLuint texture_array = UploadTextureArray(textures);
+	printf("[INFO] Loaded %d block textures\n", textures.getCount());
+
+	vector<Chunk*> chunks;
+	vector<RTX_Render*> voxel_renders;
+	ShadowVolume* shadow_volume = NULL;
+	unsigned int quad_count = 0;
+	if (voxel_mode) {
+		double start_time = glfwGetTime();
+		RTX_Render::initTextures();
+		vector<BlockModel> models;
+		vector<vector<VoxelBox> > block_boxes;
+		vector<const uint8_t*> layers;
+		for (int i = 0; i < textures.getCount(); i++)
+			layers.push_back(textures.getLayer(i));
+		vector<vec4> layer_colors = AverageLayerColors(layers, textures.layer_size);
+		for (vector<vector<VariantInfo> >::iterator it = palette_parts.begin(); it != palette_parts.end(); it++) {
+			models.push_back(BuildBlockModel(*it, textures.opaque));
+			vector<VoxelBox> boxes;
+			for (vector<VariantInfo>::iterator part = it->begin(); part != it->end(); part++)
+				blocks_cache[part->model]->getVoxelBoxes(part->rotation, layer_colors, boxes);
+			block_boxes.push_back(boxes);
+		}
+
+		const BlockGrid& grid = schematic.blocks;
+		MV_Color palette[256];
+		TD_Material materials[256];
+		vector<VoxelVolume> volumes;
+		VoxelizeSchematic(grid, models, block_boxes, voxels_per_block, palette, volumes);
+		int palette_id = VoxRender::getIndex(palette, materials);
+
+		// The shadow volume is one byte per voxel, larger builds are only shadowed near the center
+		const float MAX_SHADOW_WIDTH = 102.4f, MAX_SHADOW_HEIGHT = 25.6f;
+		vec3 size = 0.1f * vec3(ivec3(grid.getSizeX(), grid.getSizeY(), grid.getSizeZ()) * voxels_per_block);
+		if (size.x > MAX_SHADOW_WIDTH || size.y > MAX_SHADOW_HEIGHT || size.z > MAX_SHADOW_WIDTH)
+			printf("[Warning] The build is %.1f x %.1f x %.1f m, the shadow volume is clamped\n", size.x, size.y, size.z);
+		shadow_volume = new ShadowVolume(std::min(size.x, MAX_SHADOW_WIDTH), std::min(size.y, MAX_SHADOW_HEIGHT), std::min(size.z, MAX_SHADOW_WIDTH));
+
+		unsigned int voxel_count = 0;
+		for (vector<VoxelVolume>::iterator it = volumes.begin(); it != volumes.end(); it++) {
+			RTX_Render* render = new RTX_Render(it->shape, palette_id);
+			render->setTransform(vec3(it->origin.x, -(it->origin.z + it->shape.sizey), it->origin.y), quat(1, 0, 0, 0));
+			render->setWorldTransform(vec3(-0.5f * size.x, 0.0f, -0.5f * size.z), quat(1, 0, 0, 0));
+			render->generateMatrixAndOBB();
+			shadow_volume->addShape(it->shape, render->volume_matrix);
+			voxel_renders.push_back(render);
+			voxel_count += it->shape.voxels.size();
+		}
+		shadow_volume->updateTexture();
+		printf("[INFO] Converted %d voxels into %d volumes in %.2f s\n", voxel_count, (int)voxel_renders.size(), glfwGetTime() - start_time);
+	} else if (has_schematic) {
+		vector<BlockModel> models;
+		for (vector<vector<VariantInfo> >::iterator it = palette_parts.begin(); it != palette_parts.end(); it++)
+			models.push_back(BuildBlockModel(*it, textures.opaque));
+
+		// Only allocated grid chunks hold blocks
+		const BlockGrid& grid = schematic.blocks;
+		vector<ivec3> mesh_chunks;
+		for (int cy = 0; cy < grid.getChunksY(); cy++)
+			for (int cz = 0; cz < grid.getChunksZ(); cz++)
+				for (int cx = 0; cx < grid.getChunksX(); cx++)
+					if (grid.hasChunk(cx, cy, cz))
+						mesh_chunks.push_back(ivec3(cx, cy, cz));
 
-	vao.bind();
+		double start_time = glfwGetTime();
+		WorldMesher mesher(grid, models);
+		vector<ChunkGeometry> geometry;
+		mesher.mesh(mesh_chunks, geometry);
+		for (vector<ChunkGeometry>::iterator it = geometry.begin(); it != geometry.end(); it++) {
+			if (it->indices.empty()) continue;
+			chunks.push_back(new Chunk(it->vertices, it->indices));
+			quad_count += it->indices.size() / 6;
+		}
+		printf("[INFO] Meshed %d grid chunks in %.2f s\n", (int)mesh_chunks.size(), glfwGetTime() - start_time);
+	} else {
+		// Variants are laid out in a grid of WIDTH cells, two meters apart
+		const int WIDTH = 64;
+		map<pair<int, int>, pair<vector<ChunkVertex>, vector<GLuint> > > chunk_geometry;
+		unsigned int i = 0;
+		for (vector<BlockVariant*>::iterator it = block_variants.begin(); it != block_variants.end(); it++) {
+			for (unsigned int j = 0; j < (*it)->getVariantCount(); j++) {
+				int cell_x = i % WIDTH;
+				int cell_z = i / WIDTH;
+				pair<vector<ChunkVertex>, vector<GLuint> >& geometry = chunk_geometry[make_pair(cell_x / CHUNK_SIZE, cell_z / CHUNK_SIZE)];
+				(*it)->bake(j, vec3(2.0f * cell_x, 0.0f, -2.0f * cell_z), geometry.first, geometry.second);
+				i++;
+			}
+		}
+		for (map<pair<int, int>, pair<vector<ChunkVertex>, vector<GLuint> > >::iterator it = chunk_geometry.begin(); it != chunk_geometry.end(); it++) {
+			if (it->second.second.empty()) continue;
+			chunks.push_back(new Chunk(it->second.first, it->second.second));
+			quad_count += it->second.second.size() / 6;
+		}
+	}
+	if (!voxel_mode)
+		printf("[INFO] Baked %d quads into %d chunks\n", quad_count, (int)chunks.size());
+
+	// Voxel path: G-buffer, shadow volume ambient light and denoise, lit albedo multiplied by the ambient light
+	Screen framebuffer;
+	SimpleScreen fb_light(vec2(0, 0), vec2(1, 1), true);
+	HistoryBuffer fb_denoise;
+	int target_width = 0, target_height = 0;
+	mat4 old_vp_matrix = camera.vp_matrix;
 
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_MULTISAMPLE);
@@ -475,24 +1169,92 @@ int main(/*int argc, char* argv[]*/) {
 			glfwSetWindowShouldClose(window, true);
 		camera.handleInputs(window);
 
+		if (voxel_mode) {
+			if (camera.render_width != target_width || camera.render_height != target_height) {
+				target_width = camera.render_width;
+				target_height = camera.render_height;
+				framebuffer.resize(target_width, target_height);
+				fb_light.resize(target_width, target_height);
+				fb_denoise.resize(target_width, target_height);
+			}
+			RTX_Render::random_frame = (RTX_Render::random_frame + 1) % 60;
+
+			FrameData frame_data;
+			frame_data.vp_matrix = camera.vp_matrix;
+			for (int i = 0; i < SHADOW_CASCADES; i++)
+				frame_data.light_matrices[i] = mat4(1.0f);
+			frame_data.camera_pos = camera.position;
+			frame_data.far_plane = camera.FAR_PLANE;
+			frame_data.light_pos = vec3(0, 0, 0);
+			frame_data.rnd_frame = RTX_Render::random_frame;
+			frame_data.pixel_size = vec2(1.0f / camera.render_width, 1.0f / camera.render_height);
+			frame_data.time = glfwGetTime();
+			frame_data.inv_far = 1.0f / camera.FAR_PLANE;
+			Shader::pushFrame(frame_data);
+
+			glClearColor(0, 0, 0, 1);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			framebuffer.start();
+			voxel_rtx_shader.use();
+			voxel_rtx_shader.pushMatrix("uOldVpMatrix", old_vp_matrix);
+			Frustum frustum = camera.getFrustum();
+			for (vector<RTX_Render*>::iterator it = voxel_renders.begin(); it != voxel_renders.end(); it++)
+				if (IsInFrustum(frustum, (*it)->getBounds()))
+					(*it)->draw(voxel_rtx_shader, camera);
+			framebuffer.end();
+			old_vp_matrix = camera.vp_matrix;
+
+			fb_light.start();
+			ambient_light_shader.use();
+			framebuffer.pushUniforms(ambient_light_shader);
+			shadow_volume->draw(ambient_light_shader, camera);
+			fb_light.end();
+
+			fb_denoise.start();
+			denoise_shader.use();
+			denoise_shader.pushTexture2D("uNew", fb_light.getTexture(), 5);
+			denoise_shader.pushTexture2D("uOld", fb_denoise.getHistory(), 6);
+			framebuffer.pushUniforms(denoise_shader);
+			shadow_volume->draw(denoise_shader, camera);
+			fb_denoise.end();
+
+			lighting_shader.use();
+			framebuffer.draw(lighting_shader, camera);
+
+			glDisable(GL_DEPTH_TEST);
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_DST_COLOR, GL_ZERO);
+			screen_shader.use();
+			fb_denoise.draw(screen_shader, camera);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDisable(GL_BLEND);
+			glEnable(GL_DEPTH_TEST);
+
+			fb_denoise.swap();
+			glfwSwapBuffers(window);
+			continue;
+		}
+
 		glClearColor(0.35, 0.54, 0.8, 1);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		glEnable(GL_BLEND);
 		mc_shader.use();
-		unsigned int i = 0;
-		const int WIDTH = 64;
-		for (vector<BlockVariant*>::iterator it = block_variants.begin(); it != block_variants.end(); it++) {
-			for (unsigned int j = 0; j < (*it)->getVariantCount(); j++) {
-				(*it)->draw(mc_shader, camera, j, vec3(2.0f * (i % WIDTH), 0.0f, -2.0f * (i / WIDTH)));
-				i++;
-			}
-		}
+		mc_shader.pushMatrix("camera", camera.vp_matrix);
+		mc_shader.pushTexture2DArray("diffuse", texture_array, 0);
+		for (vector<Chunk*>::iterator it = chunks.begin(); it != chunks.end(); it++)
+			(*it)->draw();
 		glDisable(GL_BLEND);
 
 		glfwSwapBuffers(window);
 	}
 
+	for (vector<Chunk*>::iterator it = chunks.begin(); it != chunks.end(); it++)
+		delete *it;
+	for (vector<RTX_Render*>::iterator it = voxel_renders.begin(); it != voxel_renders.end(); it++)
+		delete *it;
+	delete shadow_volume;
 	glfwDestroyWindow(window);
 	glfwTerminate();
 	return 0;
@@ -11,6 +11,8 @@
 #include "src/utils.h"
 #include "src/shader.h"
 #include "src/skybox.h"
+#include "src/gpu_timer.h"
+#include "src/dynamic_resolution.h"
 #include "src/render_mesh.h"
 #include "src/scene_loader.h"
 #include "src/postprocessing.h"
@@ -33,6 +35,10 @@ int main(int argc, char* argv[]) {
 	Shader ambient_light_shader("ambientlight");
 	Shader voxbox_shader("shaders/voxbox_vert.glsl", "shaders/voxbox_frag.glsl");
 	Shader denoise_shader("denoise");
+	Shader upscale_shader("upscale");
+	Shader downsample_shader("downsample");
+	Shader upsample_shader("upsample");
+	Shader::finishAll();
 
 	Camera camera;
 	Screen framebuffer;
@@ -51,16 +57,25 @@ int main(int argc, char* argv[]) {
 	SimpleScreen screen4(vec2(0.75, -0.75), vec2(0.25, 0.25), false);
 	screen4.setTexture(framebuffer.depth_texture, 1);
 
+	// Ambient light is traced at 1/light_divisor of the render resolution, L cycles 1, 2 and 4
+	int light_divisor = 2;
+	bool light_key_down = false;
+	LowResGBuffer low_gbuffer;
+	low_gbuffer.resize(WINDOW_WIDTH, WINDOW_HEIGHT, light_divisor);
 	SimpleScreen fb_light(vec2(0, 0), vec2(1, 1), true);
-	SimpleScreen fb_denoise(vec2(0, 0), vec2(1, 1), true);
-	GLuint old_texture;
-	glGenTextures(1, &old_texture);
-	glBindTexture(GL_TEXTURE_2D, old_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
+	fb_light.resize(low_gbuffer.getWidth(), low_gbuffer.getHeight());
+	SimpleScreen fb_upsample(vec2(0, 0), vec2(1, 1), true);
+	HistoryBuffer fb_denoise;
+
+	// Scaled passes render at camera.render_width x render_height, the upscale output is at screen size
+	GpuTimer timer;
+	DynamicResolution resolution(1000.0f / 60.0f);
+	HistoryBuffer fb_output;
+	int target_width = WINDOW_WIDTH;
+	int target_height = WINDOW_HEIGHT;
+	mat4 old_vp_matrix = camera.vp_matrix;
+	double prev_time = glfwGetTime();
+	unsigned int counter = 0;
 
 	glfwSetWindowUserPointer(window, &camera);
 	glfwSetKeyCallback(window, key_press_callback);
@@ -77,44 +92,140 @@ int main(int argc, char* argv[]) {
 		if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 			glfwSetWindowShouldClose(window, true);
 		camera.handleInputs(window);
+		scene.cull(camera.getFrustum());
+
+		bool light_key = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+		if (light_key && !light_key_down)
+			light_divisor = light_divisor == 4 ? 1 : light_divisor * 2;
+		light_key_down = light_key;
+
+		timer.nextFrame();
+		if (resolution.update(timer.getTotal()))
+			camera.setRenderScale(resolution.getScale());
+		if (camera.render_width != target_width || camera.render_height != target_height) {
+			target_width = camera.render_width;
+			target_height = camera.render_height;
+			framebuffer.resize(target_width, target_height);
+			fb_upsample.resize(target_width, target_height);
+			fb_denoise.resize(target_width, target_height);
+			screen1.setTexture(framebuffer.color_texture);
+			screen2.setTexture(framebuffer.normal_texture);
+			screen3.setTexture(framebuffer.material_texture);
+			screen4.setTexture(framebuffer.depth_texture, 1);
+		}
+		fb_output.resize(camera.screen_width, camera.screen_height);
+		low_gbuffer.resize(target_width, target_height, light_divisor);
+		fb_light.resize(low_gbuffer.getWidth(), low_gbuffer.getHeight());
+
+		double actual_time = glfwGetTime();
+		counter++;
+		if (actual_time - prev_time >= 1.0) {
+			char window_title[256];
+			sprintf(window_title, "Shadow Volume | %.1f ms | Scale: %.0f%% | Light 1/%d | GPU: %.2f ms (G-buffer %.2f, Downsample %.2f, Light %.2f, Upsample %.2f, Denoise %.2f, Upscale %.2f)",
+				(actual_time - prev_time) / counter * 1000.0, camera.render_scale * 100.0f, light_divisor, timer.getTotal(),
+				timer.getTime("G-buffer"), timer.getTime("Downsample"), timer.getTime("Ambient light"), timer.getTime("Upsample"),
+				timer.getTime("Denoise"), timer.getTime("Upscale"));
+			glfwSetWindowTitle(window, window_title);
+			prev_time = actual_time;
+			counter = 0;
+		}
 
 		RTX_Render::random_frame++;
 		RTX_Render::random_frame %= 60;
 
+		FrameData frame_data;
+		frame_data.vp_matrix = camera.vp_matrix;
+		for (int i = 0; i < SHADOW_CASCADES; i++)
+			frame_data.light_matrices[i] = mat4(1.0f);
+		frame_data.camera_pos = camera.position;
+		frame_data.far_plane = camera.FAR_PLANE;
+		frame_data.light_pos = vec3(0, 0, 0);
+		frame_data.rnd_frame = RTX_Render::random_frame;
+		frame_data.pixel_size = vec2(1.0f / camera.render_width, 1.0f / camera.render_height);
+		frame_data.time = glfwGetTime();
+		frame_data.inv_far = 1.0f / camera.FAR_PLANE;
+		Shader::pushFrame(frame_data);
+
 		//glClearColor(0.35, 0.54, 0.8, 1);
 		glClearColor(0, 0, 0, 1);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		timer.begin("G-buffer");
 		framebuffer.start();
 		voxel_rtx_shader.use();
-		scene.draw(voxel_rtx_shader, camera, RTX);
+		voxel_rtx_shader.pushMatrix("uOldVpMatrix", old_vp_matrix);
+		scene.submit(voxel_rtx_shader, camera, RTX);
+		scene.drawQueue(camera, PASS_OPAQUE);
 
 		voxbox_shader.use();
+		voxbox_shader.pushMatrix("uOldVpMatrix", old_vp_matrix);
 		scene.drawVoxbox(voxbox_shader, camera);
 		framebuffer.end();
+		timer.end();
+		old_vp_matrix = camera.vp_matrix;
 
 		//lighting_shader.use();
 		//framebuffer.draw(lighting_shader, camera);
 
-		glCopyImageSubData(fb_denoise.getTexture(), GL_TEXTURE_2D, 0, 0, 0, 0,
-			old_texture, GL_TEXTURE_2D, 0, 0, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, 1);
+		if (light_divisor > 1) {
+			timer.begin("Downsample");
+			downsample_shader.use();
+			low_gbuffer.downsample(downsample_shader, framebuffer);
+			timer.end();
+		}
 
+		timer.begin("Ambient light");
 		fb_light.start();
 		ambient_light_shader.use();
 		framebuffer.pushUniforms(ambient_light_shader);
+		if (light_divisor > 1)
+			low_gbuffer.pushUniforms(ambient_light_shader);
 		scene.drawShadowVolume(ambient_light_shader, camera);
 		fb_light.end();
-
+		timer.end();
+
+		// Back to render resolution, guided by the full resolution depth and normals
+		GLuint light_texture = fb_light.getTexture();
+		if (light_divisor > 1) {
+			timer.begin("Upsample");
+			fb_upsample.start();
+			glDisable(GL_DEPTH_TEST);
+			upsample_shader.use();
+			upsample_shader.pushFloat("uNear", camera.NEAR_PLANE);
+			upsample_shader.pushFloat("uFar", camera.FAR_PLANE);
+			framebuffer.pushUniforms(upsample_shader);
+			upsample_shader.pushTexture2D("uLowNormal", low_gbuffer.normal_texture, 5);
+			upsample_shader.pushTexture2D("uLowDepth", low_gbuffer.depth_texture, 6);
+			fb_light.draw(upsample_shader, camera);
+			glEnable(GL_DEPTH_TEST);
+			fb_upsample.end();
+			timer.end();
+			light_texture = fb_upsample.getTexture();
+		}
+
+		timer.begin("Denoise");
 		fb_denoise.start();
 		denoise_shader.use();
-		denoise_shader.pushTexture2D("uNew", fb_light.getTexture(), 5);
-		denoise_shader.pushTexture2D("uOld", old_texture, 6);
+		denoise_shader.pushTexture2D("uNew", light_texture, 5);
+		denoise_shader.pushTexture2D("uOld", fb_denoise.getHistory(), 6);
 		framebuffer.pushUniforms(denoise_shader);
 		scene.drawShadowVolume(denoise_shader, camera);
 		fb_denoise.end();
+		timer.end();
+
+		// Temporal upscale to the output resolution, reprojected with the G-buffer motion vectors
+		timer.begin("Upscale");
+		fb_output.start();
+		upscale_shader.use();
+		upscale_shader.pushTexture2D("uMotion", framebuffer.motion_texture, 1);
+		upscale_shader.pushTexture2D("uHistory", fb_output.getHistory(), 2);
+		upscale_shader.pushFloat("uHistoryWeight", fb_output.isValid() && camera.render_scale < 1.0f ? 0.9f : 0.0f);
+		fb_denoise.draw(upscale_shader, camera);
+		fb_output.end();
+		timer.end();
 
 		screen_shader.use();
-		fb_denoise.draw(screen_shader, camera);
+		fb_output.draw(screen_shader, camera);
 
 		glDisable(GL_DEPTH_TEST);
 		screen_shader.use();
@@ -124,6 +235,8 @@ int main(int argc, char* argv[]) {
 		screen4.draw(screen_shader, camera);
 		glEnable(GL_DEPTH_TEST);
 
+		fb_denoise.swap();
+		fb_output.swap();
 		glfwSwapBuffers(window);
 	}
 
@@ -45,8 +45,23 @@ const float alpha1 = 0.618034005;
 const vec2 alpha2 = vec2(0.75487762, 0.56984027);
 const vec3 alpha3 = vec3(0.819172502, 0.671043575, 0.549700439);
 
-void blueNoiseInit(vec2 texCoord) {
-	blueNoiseTc = (texCoord / uPixelSize) / 512.0;
+vec3 decodeNormal(vec2 e) {
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+// Depth buffer value to linear depth divided by the far plane
+float getLinearDepth(float depth) {
+	float z = depth * 2.0 - 1.0;
+	return 2.0 * uNear / (uFar + uNear - z * (uFar - uNear));
+}
+
+// Indexed by the target pixel so the pattern stays blue when rendering below the G-buffer resolution
+void blueNoiseInit(vec2 fragCoord) {
+	blueNoiseTc = fragCoord / 512.0;
 }
 
 float blueNoise() {
@@ -98,7 +113,7 @@ bool blockedInScreenspace(vec3 start, vec3 dir) {
 	vec4 p = uVpMatrix * vec4(mid, 1.0);
 	vec2 tc = (p.xy / p.w) * 0.5 + vec2(0.5);
 	float pDepth = p.w * invFar * 0.99;
-	float linearDepth = texture(uDepth, tc).r;
+	float linearDepth = getLinearDepth(texture(uDepth, tc).r);
 	return pDepth > linearDepth && pDepth < linearDepth + thickness;
 }
 
@@ -276,12 +291,12 @@ float raycastDirectional(vec3 pos, vec3 normal, vec3 dir, float dist) {
 }
 
 void main() {
-	float depth = texture(uDepth, vTexCoord).r;
-	vec3 normal = texture(uNormal, vTexCoord).xyz;
+	float depth = getLinearDepth(texture(uDepth, vTexCoord).r);
+	vec3 normal = decodeNormal(texture(uNormal, vTexCoord).xy);
 	vec3 pos = uCameraPos + vFarVec * depth;
 	vec4 hpos = uVpMatrix * vec4(pos, 1.0);
 
-	blueNoiseInit(vTexCoord);
+	blueNoiseInit(gl_FragCoord.xy);
 	FragColor += ambientLight(pos, normal);
 	gl_FragDepth = (1.0 / hpos.w - 1.0 / uNear) / (1.0 / uFar - 1.0 / uNear);
 }
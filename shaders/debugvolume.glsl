@@ -29,11 +29,19 @@ void main() {
 
 #ifdef FRAGMENT
 layout(location = 0) out vec3 outputColor;
-layout(location = 1) out vec3 outputNormal;
+layout(location = 1) out vec2 outputNormal;
 layout(location = 2) out float outputDepth;
 
 in vec3 vFarVec;
 
+// Octahedral mapping of a unit normal, remapped to [0, 1] for the RG8 target
+vec2 encodeNormal(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.xy * 0.5 + 0.5;
+}
+
 float raycastShadowVolume(vec3 origin, vec3 dir, float dist, out int normal) {
 	origin -= uVolOffset;
 	vec3 invDir = vec3(1.0) / (abs(dir) + vec3(0.00001));
@@ -156,7 +164,7 @@ void main() {
 	vec4 hpos = uVpMatrix * hitPos;
 
 	outputColor = ((normal + 1.0f) / 2.0f) * l;
-	outputNormal = normal;
+	outputNormal = encodeNormal(normal);
 	outputDepth = hpos.w / uFar;
 	gl_FragDepth = (1.0 / hpos.w - 1.0 / uNear) / (1.0 / uFar - 1.0 / uNear);
 
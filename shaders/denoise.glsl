@@ -16,6 +16,7 @@ uniform sampler2D uOld;
 uniform sampler2D uNormal;
 uniform sampler2D uDepth;
 
+uniform float uNear;
 uniform float uFar;
 uniform vec3 uCameraPos;
 uniform mat4 uVpMatrix;
@@ -33,6 +34,20 @@ vec2 blueNoiseTc;
 const float alpha1 = 0.618034005;
 const vec2 alpha2 = vec2(0.75487762, 0.56984027);
 
+vec3 decodeNormal(vec2 e) {
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+// Depth buffer value to linear depth divided by the far plane
+float getLinearDepth(float depth) {
+	float z = depth * 2.0 - 1.0;
+	return 2.0 * uNear / (uFar + uNear - z * (uFar - uNear));
+}
+
 void blueNoiseInit(vec2 texCoord) {
 	blueNoiseTc = (texCoord / uPixelSize) / 512.0;
 }
@@ -58,17 +73,17 @@ float calculatePixelMaxVelocity(vec2 pixelSize) {
 }
 
 void main() {
-	float linearDepth = texture(uDepth, vTexCoord).r;
+	float linearDepth = getLinearDepth(texture(uDepth, vTexCoord).r);
 	if (linearDepth > 0.9) {
 		FragColor = vec4(0.0);
 		return;
 	}
 
-	float depth1 = texture(uDepth, vTexCoord + vec2(0.0f, uPixelSize.y)).r;
+	float depth1 = getLinearDepth(texture(uDepth, vTexCoord + vec2(0.0f, uPixelSize.y)).r);
 	vec2 texCoord = linearDepth > depth1 ? vTexCoord : vTexCoord + vec2(0.0f, uPixelSize.y);
 
 	vec2 motion = vec2(0.0f);
-	vec3 normal = texture(uNormal, vTexCoord).rgb;
+	vec3 normal = decodeNormal(texture(uNormal, vTexCoord).xy);
 
 	vec3 pixRay = computePixelDir(vTexCoord);
 	vec3 position = pixRay * linearDepth;
@@ -99,11 +114,11 @@ void main() {
 		float hitDepth = dot(precalc, hitPoint);
 
 		// Check depth
-		float d = texture(uDepth, tc).r;
+		float d = getLinearDepth(texture(uDepth, tc).r);
 		t *= step(abs(d - hitDepth), 8.0 / 65535.0);
 
 		// Also check normal
-		vec3 n = texture(uNormal, tc).rgb;
+		vec3 n = decodeNormal(texture(uNormal, tc).xy);
 		t *= step(0.9, dot(normal, n));
 
 		vec4 col = texture(uNew, tc);
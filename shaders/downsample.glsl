@@ -0,0 +1,38 @@
+#ifdef VERTEX
+layout(location = 0) in vec2 aPosition;
+
+void main() {
+	gl_Position = vec4(aPosition, 0.0, 1.0);
+}
+#endif
+
+#ifdef FRAGMENT
+uniform sampler2D uNormal;
+uniform sampler2D uDepth;
+uniform int uDivisor;
+
+layout(location = 0) out vec2 outputNormal;
+layout(location = 1) out float outputDepth;
+
+void main() {
+	ivec2 size = textureSize(uDepth, 0);
+	ivec2 base = ivec2(gl_FragCoord.xy) * uDivisor;
+
+	// Depth buffer values keep their order, alternate the nearest and farthest sample in a checkerboard so both sides of an edge are kept
+	bool nearest = ((int(gl_FragCoord.x) + int(gl_FragCoord.y)) & 1) == 0;
+	ivec2 best = min(base, size - 1);
+	float bestDepth = texelFetch(uDepth, best, 0).r;
+	for (int y = 0; y < uDivisor; y++) {
+		for (int x = 0; x < uDivisor; x++) {
+			ivec2 tc = min(base + ivec2(x, y), size - 1);
+			float depth = texelFetch(uDepth, tc, 0).r;
+			if (nearest ? depth < bestDepth : depth > bestDepth) {
+				bestDepth = depth;
+				best = tc;
+			}
+		}
+	}
+	outputNormal = texelFetch(uNormal, best, 0).xy;
+	outputDepth = bestDepth;
+}
+#endif
@@ -31,14 +31,28 @@ void main() {
 #endif
 
 #ifdef FRAGMENT
+vec3 decodeNormal(vec2 e) {
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+// Depth buffer value to linear depth divided by the far plane
+float getLinearDepth(float depth) {
+	float z = depth * 2.0 - 1.0;
+	return 2.0 * uNear / (uFar + uNear - z * (uFar - uNear));
+}
+
 in vec2 vTexCoord;
 in vec3 vFarVec;
 
 out vec4 FragColor;
 
 void main() {
-	float depth = texture(uDepth, vTexCoord).r;
-	vec3 normal = texture(uNormal, vTexCoord).xyz;
+	float depth = getLinearDepth(texture(uDepth, vTexCoord).r);
+	vec3 normal = decodeNormal(texture(uNormal, vTexCoord).xy);
 	vec3 pos = uCameraPos + vFarVec * depth;
 	vec4 hpos = uVpMatrix * vec4(pos, 1.0);
 
@@ -70,7 +84,7 @@ void main() {
 			vec2 tc = hp.xy / hp.w * 0.5 + 0.5;
 
 			float probeDepth = hp.w;
-			float sceneDepth = texture(uDepth, tc).r * uFar;
+			float sceneDepth = getLinearDepth(texture(uDepth, tc).r) * uFar;
 
 			d *= 1.0 - r1;
 			if (probeDepth > sceneDepth * 1.01 && probeDepth < sceneDepth + rad)
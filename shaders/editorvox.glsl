@@ -34,13 +34,20 @@ void main() {
 
 #ifdef FRAGMENT
 layout(location = 0) out vec3 outputColor;
-layout(location = 1) out vec3 outputNormal;
-layout(location = 4) out float outputDepth;
+layout(location = 1) out vec2 outputNormal;
 
 in vec3 vWorldPos;
 in vec3 vLocalPos;
 in vec3 vLocalCameraPos;
 
+// Octahedral mapping of a unit normal, remapped to [0, 1] for the RG8 target
+vec2 encodeNormal(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.xy * 0.5 + 0.5;
+}
+
 float raycastVolume(vec3 origin, vec3 dir, float dist, int mip, out int normal, out uint value) {
 	float mipScale = float(1 << mip);
 	float texelSize = uVolTexelSize * mipScale;
@@ -164,8 +171,7 @@ void main() {
 		color *= uMultColor;
 
 		outputColor = color.rgb;
-		outputNormal = hitNormal;
-		outputDepth = hpos.w / uFar;
+		outputNormal = encodeNormal(normalize(hitNormal));
 		gl_FragDepth = (1.0 / hpos.w - 1.0 / uNear) / (1.0 / uFar - 1.0 / uNear);
 	} else
 		discard;
@@ -1,12 +1,34 @@
-uniform float uFar;
-uniform float uInvFar;
-
-uniform vec3 uCameraPos;
-uniform mat4 uVpMatrix;
-uniform mat4 uVpInvMatrix;
+#ifdef FRAGMENT
+#extension GL_ARB_conservative_depth : enable
+#endif
 
-uniform float uRndFrame;
-uniform vec2 uPixelSize;
+layout(std140) uniform FrameData {
+	mat4 uVpMatrix;
+	mat4 uLightMatrices[4];
+	vec3 uCameraPos;
+	float uFar;
+	vec3 uLightPos;
+	float uRndFrame;
+	vec2 uPixelSize;
+	float uTime;
+	float uInvFar;
+};
+
+layout(std140) uniform ObjectData {
+	mat4 position;
+	mat4 rotation;
+	mat4 world_pos;
+	mat4 world_rot;
+	vec3 uObjSize;
+	float scale;
+	vec3 base_color;
+	int uPalette;
+	vec4 uTextureTile;
+	vec3 uVolResolution;
+	float uAlpha;
+};
+
+uniform mat4 uOldVpMatrix;
 uniform sampler2D uBlueNoise;
 
 vec2 blueNoiseTc;
@@ -33,20 +55,26 @@ uniform sampler2D uNormalMap;
 uniform sampler2D uWindowAlbedo;
 uniform sampler2D uWindowNormal;
 
-uniform mat4 uVolMatrix;
-
-uniform vec4 uTextureTile;
+// Editor only, zero unless set by name
 uniform vec3 uTextureParams;
-uniform int uPalette;
 uniform float uEmissive;
-uniform vec4 uVoxelSize;
-uniform vec3 uObjSize;
+uniform float uHighlight;
 
 uniform usampler3D uVolTex;
 
 uniform bool uHasAlpha;
-uniform float uHighlight;
-uniform float uAlpha;
+
+// Same as VoxRender::volume_matrix: world transform * z up to y up * scaled local transform
+mat4 volMatrix;
+vec4 voxelSize;
+
+void initVolume() {
+	const mat4 toWorld = mat4(1.0, 0.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 0.0, 1.0);
+	voxelSize = vec4(uVolResolution, 0.1 * scale);
+	mat4 localPos = position;
+	localPos[3].xyz *= voxelSize.w;
+	volMatrix = world_pos * world_rot * toWorld * localPos * rotation;
+}
 
 #ifdef VERTEX
 layout(location = 0) in vec3 aPosition;
@@ -55,27 +83,34 @@ out vec3 vLocalCameraPos;
 out vec3 vLocalPos;
 
 void main() {
-	vec4 worldPos = uVolMatrix * vec4(aPosition * uObjSize * uVoxelSize.w, 1.0);
-	mat3 volMatrixInv = transpose(mat3(uVolMatrix));
-	vLocalCameraPos = volMatrixInv * (uCameraPos - uVolMatrix[3].xyz);
-	vLocalPos = volMatrixInv * (worldPos.xyz - uVolMatrix[3].xyz);
+	initVolume();
+	vec4 worldPos = volMatrix * vec4(aPosition * uObjSize * voxelSize.w, 1.0);
+	mat3 volMatrixInv = transpose(mat3(volMatrix));
+	vLocalCameraPos = volMatrixInv * (uCameraPos - volMatrix[3].xyz);
+	vLocalPos = volMatrixInv * (worldPos.xyz - volMatrix[3].xyz);
 	gl_Position = uVpMatrix * worldPos;
 }
 #endif
 
 #ifdef FRAGMENT
 layout(location = 0) out vec4 outputColor;
-layout(location = 1) out vec3 outputNormal;
+layout(location = 1) out vec2 outputNormal;
 layout(location = 2) out vec4 outputMaterial;
-layout(location = 4) out float outputDepth;
+layout(location = 3) out vec2 outputMotion;
+#ifdef GL_ARB_conservative_depth
+// Hits are always behind the rasterized box faces, keeps early depth rejection enabled
+layout(depth_greater) out float gl_FragDepth;
+#endif
 
 in vec3 vLocalCameraPos;
 in vec3 vLocalPos;
 
-vec3 computePixelDir(vec2 texCoord) {
-	vec4 aa = vec4(texCoord * 2.0 - vec2(1.0), 1.0, 1.0);
-	aa = uVpInvMatrix * aa;
-	return aa.xyz / aa.w - uCameraPos;
+// Octahedral mapping of a unit normal, remapped to [0, 1] for the RG8 target
+vec2 encodeNormal(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.xy * 0.5 + 0.5;
 }
 
 float raycastVolume(vec3 origin, vec3 dir, float dist, out uint index, out vec3 coord, out int normal, out vec4 color) {
@@ -89,8 +124,8 @@ float raycastVolume(vec3 origin, vec3 dir, float dist, out uint index, out vec3
 	float t = 0.0;
 	while (t < dist) {
 		float mipScale = float(1 << mip);
-		float voxSize = uVoxelSize.w * mipScale;
-		vec3 voxRes = uVoxelSize.xyz / mipScale;
+		float voxSize = voxelSize.w * mipScale;
+		vec3 voxRes = voxelSize.xyz / mipScale;
 		vec3 tDelta = invDir * voxSize;
 		vec3 tPos = (origin + t * dir) / voxSize;
 		vec3 ti = floor(tPos);
@@ -106,7 +141,7 @@ float raycastVolume(vec3 origin, vec3 dir, float dist, out uint index, out vec3
 					color = texelFetch(uColor, ivec2(a, uPalette), 0);
 					if (opaque || color.a == 1.0) {
 						index = a;
-						coord = floor(ti * uVoxelSize.xyz);
+						coord = floor(ti * voxelSize.xyz);
 						normal = int(cmp.y + cmp.z * 2.0);
 						return t;
 					}
@@ -153,6 +188,7 @@ vec2 getTile(vec2 tc, float tile, vec2 tileCount) {
 }
 
 void main() {
+	initVolume();
 	vec2 tc = gl_FragCoord.xy * uPixelSize.rg;
 
 	if (uAlpha < 1.0) {
@@ -161,9 +197,9 @@ void main() {
 			discard;
 	}
 
-	vec3 pixDir = computePixelDir(tc);
+	// No depth prepass, the ray is only bounded by the box
 	float depth = 500; //texture(uDepth, tc).r;
-	float currentMinDepth = length(pixDir * depth * uFar);
+	float currentMinDepth = depth * uFar;
 
 	vec3 localPos = vLocalCameraPos;
 	vec3 localDir = vLocalPos - vLocalCameraPos;
@@ -172,7 +208,7 @@ void main() {
 		discard;
 
 	localDir /= maxDist;
-	float minDist = distanceToBox(localPos, localDir, uObjSize * uVoxelSize.w);
+	float minDist = distanceToBox(localPos, localDir, uObjSize * voxelSize.w);
 
 	if (minDist > currentMinDepth)
 		discard;
@@ -204,7 +240,7 @@ void main() {
 		emissiveMaterial *= 32.0 * uEmissive;
 		vec4 tt = index == 254u ? vec4(12.0, 0.0, 1.0, 0.0) : uTextureTile;
 
-		vec4 worldPos4 = uVolMatrix * vec4(localPos, 1.0);
+		vec4 worldPos4 = volMatrix * vec4(localPos, 1.0);
 		vec2 depth = (uVpMatrix * worldPos4).zw;
 
 		if (color.a < 1.0) {
@@ -223,7 +259,7 @@ void main() {
 			}
 
 			const float noiseNormalMaxDist = 64.0f;
-			localNormal += noiseNormal * 0.2 * smoothstep(0.0f, uVoxelSize.w * noiseNormalMaxDist, depth.y);
+			localNormal += noiseNormal * 0.2 * smoothstep(0.0f, voxelSize.w * noiseNormalMaxDist, depth.y);
 			localNormal = normalize(localNormal);
 
 			vec3 noise = texture(uWindowAlbedo, ntc * 0.2).xyz - vec3(0.5);
@@ -268,14 +304,14 @@ void main() {
 		color.rgb += vec3(uHighlight) * 0.3;
 		emissiveMaterial += uHighlight * 0.3;
 
-		vec4 worldNormal4 = uVolMatrix * vec4(localNormal, 0.0);
-		float linearDepth = (uVpMatrix * worldPos4).w;
+		vec4 worldNormal4 = volMatrix * vec4(localNormal, 0.0);
 
 		outputColor = vec4(pow(color.rgb, vec3(1 / 2.2)), 1.0);
-		//outputNormal = worldNormal4.xyz * 0.5 + vec3(0.5);
-		outputNormal = worldNormal4.xyz;
+		outputNormal = encodeNormal(normalize(worldNormal4.xyz));
 		outputMaterial = vec4(material.xyz, emissiveMaterial / 32.0);
-		outputDepth = linearDepth * uInvFar;
+		vec4 clipPos = uVpMatrix * worldPos4;
+		vec4 oldClipPos = uOldVpMatrix * worldPos4;
+		outputMotion = (clipPos.xy / clipPos.w - oldClipPos.xy / oldClipPos.w) * 0.5;
 		gl_FragDepth = depth.x / depth.y * 0.5f + 0.5f;
 	} else
 		discard;
@@ -16,6 +16,12 @@ vec2 blueNoiseTc;
 const float alpha1 = 0.618034005;
 const vec2 alpha2 = vec2(0.75487762, 0.56984027);
 
+// Depth buffer value to linear depth divided by the far plane
+float getLinearDepth(float depth) {
+	float z = depth * 2.0 - 1.0;
+	return 2.0 * uNear / (uFar + uNear - z * (uFar - uNear));
+}
+
 void blueNoiseInit(vec2 texCoord) {
 	blueNoiseTc = (texCoord / uPixelSize) / 512.0;
 }
@@ -70,14 +76,22 @@ void main() {
 
 #ifdef FRAGMENT
 layout(location = 0) out vec4 outputColor;
-layout(location = 1) out vec3 outputNormal;
+layout(location = 1) out vec2 outputNormal;
 layout(location = 2) out vec4 outputMaterial;
-layout(location = 3) out vec3 outputMotion;
+layout(location = 3) out vec2 outputMotion;
 
 in vec4 vCurrentPos;
 in vec4 vOldPos;
 in vec3 vPosition;
 
+// Octahedral mapping of a unit normal, remapped to [0, 1] for the RG8 target
+vec2 encodeNormal(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.xy * 0.5 + 0.5;
+}
+
 float ring(vec2 ringPos, float radius, vec2 pos) {
 	vec2 dir = ringPos - pos;
 	float dist = dot(dir, dir);
@@ -153,7 +167,7 @@ void main() {
 	vec3 surfacePos = vPosition;
 	vec4 surfaceHPos = uMvpMatrix * vec4(surfacePos, 1.0);
 	float newZ = surfaceHPos.w * uInvFar;
-	float depth = texture(uDepth, texCoord).r;
+	float depth = getLinearDepth(texture(uDepth, texCoord).r);
 	vec3 hitPos = vPosition + vec3(0, -h, 0);
 
 	float dx = dFdx(h);
@@ -172,7 +186,7 @@ void main() {
 	vec2 distort = normal.xz * 0.003 / depth;
 	vec2 orgTc = texCoord;
 	texCoord += distort + (blueNoise2() - vec2(0.5)) * 0.002 * min(uVisibility, waterDepth);
-	float ddepth = texture(uDepth, texCoord).r;
+	float ddepth = getLinearDepth(texture(uDepth, texCoord).r);
 	if (ddepth < newZ) {
 		texCoord = orgTc;
 		ddepth = depth;
@@ -200,8 +214,8 @@ void main() {
 
 	outputColor = vec4(pow(color.rgb, vec3(1 / 2.2)), 1.0);
 	outputMaterial = vec4(0.02, 1.0, 0.0, 0.0);
-	outputNormal = normal;
-	outputMotion = vec3(tcCurrent - tcOld, 1.0);
+	outputNormal = encodeNormal(normal);
+	outputMotion = tcCurrent - tcOld;
 	gl_FragDepth = (uNear / newZ - uFar) / (uNear - uFar);
 }
 #endif
@@ -1,38 +1,66 @@
 #version 410 core
 
-uniform vec3 camera_pos;
-uniform vec3 light_pos;
-uniform sampler2D shadowMap;
+uniform sampler2DArray shadowMap;
 uniform sampler2D tex0; // diffuse
 uniform sampler2D tex1; // specular
 uniform sampler2D tex2; // normal
 
+layout(std140) uniform FrameData {
+	mat4 camera;
+	mat4 lightMatrices[4];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
+
+layout(std140) uniform ObjectData {
+	mat4 position;
+	mat4 rotation;
+	mat4 world_pos;
+	mat4 world_rot;
+	vec3 size;
+	float scale;
+	vec3 base_color;
+	int uPalette;
+};
+
 in vec3 vNormal;
 in vec2 vTexCoord;
 in vec3 vFragPosition;
-in vec4 vFragPosLight;
+in vec4 vWorldPos;
 
 out vec4 FragColor;
 
 float calculateShadow() {
+	// First cascade that contains the fragment, they are ordered outwards from the camera
+	int cascade = -1;
+	vec3 lightCoords;
+	for (int i = 0; i < 4 && cascade < 0; i++) {
+		vec4 fragPosLight = lightMatrices[i] * vWorldPos;
+		lightCoords = (fragPosLight.xyz / fragPosLight.w + 1.0f) / 2.0f;
+		if (all(greaterThanEqual(lightCoords, vec3(0.0f))) && all(lessThanEqual(lightCoords, vec3(1.0f))))
+			cascade = i;
+	}
+	if (cascade < 0) return 0.0f;
+
 	float shadow = 0.0f;
-	vec3 lightCoords = vFragPosLight.xyz / vFragPosLight.w;
-	if (lightCoords.z <= 1.0f) {
-		lightCoords = (lightCoords + 1.0f) / 2.0f;
-		float currentDepth = lightCoords.z;
-		float bias = max(0.0025f * (1.0f - dot(vNormal, normalize(light_pos))), 0.0005f);
-
-		int sampleRadius = 4;
-		vec2 pixelSize = 1.0f / textureSize(shadowMap, 0);
-		for (int y = -sampleRadius; y <= sampleRadius; y++) {
-			for (int x = -sampleRadius; x <= sampleRadius; x++) {
-				float closestDepth = texture(shadowMap, lightCoords.xy + vec2(x, y) * pixelSize).r;
-				if (currentDepth > closestDepth + bias)
-					shadow += 1.0f;	 
-			}
+	float currentDepth = lightCoords.z;
+	float bias = max(0.0025f * (1.0f - dot(vNormal, normalize(light_pos))), 0.0005f);
+
+	int sampleRadius = 4;
+	vec2 pixelSize = 1.0f / vec2(textureSize(shadowMap, 0).xy);
+	for (int y = -sampleRadius; y <= sampleRadius; y++) {
+		for (int x = -sampleRadius; x <= sampleRadius; x++) {
+			float closestDepth = texture(shadowMap, vec3(lightCoords.xy + vec2(x, y) * pixelSize, cascade)).r;
+			if (currentDepth > closestDepth + bias)
+				shadow += 1.0f;
 		}
-		shadow /= pow(sampleRadius * 2.0f + 1.0f, 2.0f);
 	}
+	shadow /= pow(sampleRadius * 2.0f + 1.0f, 2.0f);
 	shadow *= 0.5f;
 	return shadow;
 }
@@ -3,15 +3,33 @@ layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
 
-uniform mat4 camera;
-uniform mat4 position;
-uniform mat4 rotation;
-uniform mat4 lightMatrix;
+layout(std140) uniform FrameData {
+	mat4 camera;
+	mat4 lightMatrices[4];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
+
+layout(std140) uniform ObjectData {
+	mat4 position;
+	mat4 rotation;
+	mat4 world_pos;
+	mat4 world_rot;
+	vec3 size;
+	float scale;
+	vec3 base_color;
+	int uPalette;
+};
 
 out vec3 vNormal;
 out vec2 vTexCoord;
 out vec3 vFragPosition;
-out vec4 vFragPosLight;
+out vec4 vWorldPos; // Homogeneous, w is not always 1
 
 void main() {
 	vec4 worldPosition = position * rotation * vec4(aPosition, 1.0f);
@@ -20,6 +38,6 @@ void main() {
 	vNormal = normalize(normal.xyz);
 	vTexCoord = aTexCoord;
 	vFragPosition = worldPosition.xyz;
-	vFragPosLight = lightMatrix * worldPosition;
+	vWorldPos = worldPosition;
 	gl_Position = camera * worldPosition;
 }
@@ -1,13 +1,13 @@
 #version 410 core
-uniform sampler2D diffuse;
-uniform vec4 tint_color;
+uniform sampler2DArray diffuse;
 
-in vec2 vTexCoord;
+in vec3 vTexCoord;
+in vec4 vTint;
 
 out vec4 FragColor;
 
 void main() {
-	vec4 color = texture(diffuse, vTexCoord) * tint_color;
+	vec4 color = texture(diffuse, vTexCoord) * vTint;
 	if (color.a < 0.1f) discard;
 	FragColor = color;
 }
@@ -1,8 +1,8 @@
 #version 410 core
-uniform vec3 color;
+in vec3 vColor;
 
 out vec4 FragColor;
 
 void main() {
-	FragColor = vec4(color, 1.0f);
+	FragColor = vec4(vColor, 1.0f);
 }
@@ -1,11 +1,22 @@
 #version 410 core
-layout(location = 0) in vec3 aPosition;
+layout(location = 0) in vec3 aPosition; // World space
+layout(location = 1) in vec3 aColor;
 
-uniform mat4 camera;
-uniform mat4 position;
-uniform mat4 rotation;
+layout(std140) uniform FrameData {
+	mat4 camera;
+	mat4 lightMatrices[4];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
+
+out vec3 vColor;
 
 void main() {
-	vec4 worldPosition = position * rotation * vec4(aPosition, 1.0f);
-	gl_Position = camera * worldPosition;
+	vColor = aColor;
+	gl_Position = camera * vec4(aPosition, 1.0f);
 }
@@ -1,17 +1,50 @@
 #version 410 core
 layout(location = 0) in vec3 aPosition;
+#if defined(VOXBOX)
+layout(location = 2) in vec3 aInstancePosition;
+layout(location = 3) in vec4 aInstanceRotation; // Quaternion x, y, z, w
+layout(location = 4) in vec3 aInstanceSize;
+#else
 layout(location = 3) in vec3 aOffset;
+#endif
 
-uniform int side;
-uniform vec3 size;
-uniform float scale;
-uniform mat4 position;
-uniform mat4 rotation;
-uniform mat4 world_pos;
-uniform mat4 world_rot;
-uniform mat4 lightMatrix;
+// Permutations: VOXEL (greedy and hexagon, with HEX_SIDE), VOXBOX, none for meshes
+// Hexagon orientation: 0 cube, 1 top, 2 front, 3 side
+#ifndef HEX_SIDE
+#define HEX_SIDE 0
+#endif
 
-const float three_halves = sqrt(3);
+uniform int uCascade;
+
+layout(std140) uniform FrameData {
+	mat4 camera;
+	mat4 lightMatrices[4];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
+
+layout(std140) uniform ObjectData {
+	mat4 position;
+	mat4 rotation;
+	mat4 world_pos;
+	mat4 world_rot;
+	vec3 size;
+	float scale;
+	vec3 base_color;
+	int uPalette;
+};
+
+#if defined(VOXBOX)
+vec3 rotate(vec4 q, vec3 v) {
+	return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+#else
+const float three_halves = 1.5; // Column spacing, hexagons with unit sides tile every 1.5
 const float two_plus_two = 5;
 
 vec3 getHexPos(int side) {
@@ -36,20 +69,17 @@ vec3 getHexPos(int side) {
 	}
 	return pos;
 }
+#endif
 
 void main() {
-	// Mesh
+#if defined(VOXEL)
+	vec4 pos = position * rotation * vec4(getHexPos(HEX_SIDE), 1.0f);
+	vec4 worldPosition = world_pos * world_rot * vec4(pos.x, pos.z, -pos.y, 10.0f / scale);
+#elif defined(VOXBOX)
+	vec4 worldPosition = vec4(aInstancePosition + rotate(aInstanceRotation, aPosition * aInstanceSize * 0.1f), 1.0f);
+#else
 	vec4 worldPosition = position * rotation * vec4(aPosition, 1.0f);
+#endif
 
-	// Voxbox
-	if (size.x != 0.0f)
-		worldPosition = position * rotation * vec4(aPosition * size, 10.0f);
-
-	// Voxel
-	if (scale > 0.0f) {
-		vec4 pos = position * rotation * vec4(getHexPos(side), 1.0f);
-		worldPosition = world_pos * world_rot * vec4(pos.x, pos.z, -pos.y, 10.0f / scale);
-	}
-
-	gl_Position = lightMatrix * worldPosition;
+	gl_Position = lightMatrices[uCascade] * worldPosition;
 }
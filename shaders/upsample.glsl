@@ -0,0 +1,81 @@
+#ifdef VERTEX
+layout(location = 0) in vec2 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+
+uniform vec2 uPosition;
+uniform vec2 uSize;
+
+out vec2 vTexCoord;
+
+void main() {
+	vTexCoord = aTexCoord;
+	gl_Position = vec4(uPosition + aPosition * uSize, 0.0, 1.0);
+}
+#endif
+
+#ifdef FRAGMENT
+uniform sampler2D uTexture;	  // Low resolution
+uniform sampler2D uLowNormal; // Low resolution
+uniform sampler2D uLowDepth;  // Low resolution
+uniform sampler2D uNormal;
+uniform sampler2D uDepth;
+uniform float uNear;
+uniform float uFar;
+
+in vec2 vTexCoord;
+out vec4 FragColor;
+
+vec3 decodeNormal(vec2 e) {
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+// Depth buffer value to linear depth divided by the far plane
+float getLinearDepth(float depth) {
+	float z = depth * 2.0 - 1.0;
+	return 2.0 * uNear / (uFar + uNear - z * (uFar - uNear));
+}
+
+// Joint bilateral upsample, the bilinear weights of the 4 nearest low resolution texels
+// are scaled down where their depth or normal differs from the full resolution pixel
+void main() {
+	float depth = getLinearDepth(texture(uDepth, vTexCoord).r);
+	vec3 normal = decodeNormal(texture(uNormal, vTexCoord).xy);
+
+	ivec2 size = textureSize(uTexture, 0);
+	vec2 pos = vTexCoord * vec2(size) - 0.5;
+	ivec2 base = ivec2(floor(pos));
+	vec2 f = pos - vec2(base);
+	float bilinear[4] = float[4]((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+	ivec2 offsets[4] = ivec2[4](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+
+	vec4 sum = vec4(0.0);
+	float total = 0.0;
+	vec4 closest = vec4(0.0);
+	float closestDiff = 1e9;
+	for (int i = 0; i < 4; i++) {
+		ivec2 tc = clamp(base + offsets[i], ivec2(0), size - 1);
+		vec4 color = texelFetch(uTexture, tc, 0);
+		float sampleDepth = getLinearDepth(texelFetch(uLowDepth, tc, 0).r);
+		vec3 sampleNormal = decodeNormal(texelFetch(uLowNormal, tc, 0).xy);
+
+		float diff = abs(sampleDepth - depth);
+		float w = bilinear[i] + 1e-3;
+		w *= exp(-diff / (depth * 0.02 + 1e-4));
+		w *= pow(max(dot(normal, sampleNormal), 0.0), 16.0);
+		sum += color * w;
+		total += w;
+
+		if (diff < closestDiff) {
+			closestDiff = diff;
+			closest = color;
+		}
+	}
+
+	// No texel lies on the same surface, fall back to the one nearest in depth
+	FragColor = total > 1e-4 ? sum / total : closest;
+}
+#endif
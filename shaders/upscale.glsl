@@ -0,0 +1,59 @@
+#ifdef VERTEX
+layout(location = 0) in vec2 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+
+uniform vec2 uPosition;
+uniform vec2 uSize;
+
+out vec2 vTexCoord;
+
+void main() {
+	vTexCoord = aTexCoord;
+	gl_Position = vec4(uPosition + aPosition * uSize, 0.0, 1.0);
+}
+#endif
+
+#ifdef FRAGMENT
+uniform sampler2D uTexture; // Render resolution
+uniform sampler2D uMotion;	// Render resolution, current minus previous texture coordinates
+uniform sampler2D uHistory; // Output resolution, last upscaled frame
+uniform float uHistoryWeight;
+
+in vec2 vTexCoord;
+out vec4 FragColor;
+
+void main() {
+	ivec2 size = textureSize(uTexture, 0);
+	vec2 pos = vTexCoord * vec2(size) - 0.5;
+	ivec2 base = ivec2(floor(pos));
+	vec2 f = pos - vec2(base);
+
+	// Bilinear sample of the current frame
+	vec4 c00 = texelFetch(uTexture, clamp(base, ivec2(0), size - 1), 0);
+	vec4 c10 = texelFetch(uTexture, clamp(base + ivec2(1, 0), ivec2(0), size - 1), 0);
+	vec4 c01 = texelFetch(uTexture, clamp(base + ivec2(0, 1), ivec2(0), size - 1), 0);
+	vec4 c11 = texelFetch(uTexture, clamp(base + ivec2(1, 1), ivec2(0), size - 1), 0);
+	vec4 current = mix(mix(c00, c10, f.x), mix(c01, c11, f.x), f.y);
+
+	// Color range of the 3x3 neighborhood, clamping rejects history that was disoccluded or changed
+	ivec2 nearest = clamp(ivec2(vTexCoord * vec2(size)), ivec2(0), size - 1);
+	vec4 mi = vec4(1e9);
+	vec4 ma = vec4(-1e9);
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			vec4 c = texelFetch(uTexture, clamp(nearest + ivec2(x, y), ivec2(0), size - 1), 0);
+			mi = min(mi, c);
+			ma = max(ma, c);
+		}
+	}
+
+	vec2 motion = texelFetch(uMotion, nearest, 0).rg;
+	vec2 oldTexCoord = vTexCoord - motion;
+	float weight = uHistoryWeight;
+	if (any(lessThan(oldTexCoord, vec2(0.0))) || any(greaterThan(oldTexCoord, vec2(1.0))))
+		weight = 0.0;
+
+	vec4 history = clamp(texture(uHistory, oldTexCoord), mi, ma);
+	FragColor = mix(current, history, weight);
+}
+#endif
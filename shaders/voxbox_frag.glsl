@@ -1,56 +1,77 @@
 #version 410 core
-uniform vec3 color;
-uniform vec3 light_pos;
-uniform sampler2D shadowMap;
+uniform sampler2DArray shadowMap;
+uniform mat4 uOldVpMatrix;
+
+layout(std140) uniform FrameData {
+	mat4 camera;
+	mat4 lightMatrices[4];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
 
 in vec3 vNormal;
-in vec4 vFragPosLight;
+in vec3 vColor;
+in vec4 vWorldPos;
 
 //out vec4 FragColor;
 layout(location = 0) out vec4 outputColor;
-layout(location = 1) out vec3 outputNormal;
+layout(location = 1) out vec2 outputNormal;
 layout(location = 2) out vec4 outputMaterial;
-layout(location = 4) out float outputDepth;
+layout(location = 3) out vec2 outputMotion;
 
 float calculateShadow() {
+	// First cascade that contains the fragment, they are ordered outwards from the camera
+	int cascade = -1;
+	vec3 lightCoords;
+	for (int i = 0; i < 4 && cascade < 0; i++) {
+		vec4 fragPosLight = lightMatrices[i] * vWorldPos;
+		lightCoords = (fragPosLight.xyz / fragPosLight.w + 1.0f) / 2.0f;
+		if (all(greaterThanEqual(lightCoords, vec3(0.0f))) && all(lessThanEqual(lightCoords, vec3(1.0f))))
+			cascade = i;
+	}
+	if (cascade < 0) return 0.0f;
+
 	float shadow = 0.0f;
-	vec3 lightCoords = vFragPosLight.xyz / vFragPosLight.w;
-	if (lightCoords.z <= 1.0f) {
-		lightCoords = (lightCoords + 1.0f) / 2.0f;
-		float currentDepth = lightCoords.z;
-		float bias = max(0.0025f * (1.0f - dot(vNormal, normalize(light_pos))), 0.0005f);
-
-		int sampleRadius = 4;
-		vec2 pixelSize = 1.0f / textureSize(shadowMap, 0);
-		for (int y = -sampleRadius; y <= sampleRadius; y++) {
-			for (int x = -sampleRadius; x <= sampleRadius; x++) {
-				float closestDepth = texture(shadowMap, lightCoords.xy + vec2(x, y) * pixelSize).r;
-				if (currentDepth > closestDepth + bias)
-					shadow += 1.0f;	 
-			}
+	float currentDepth = lightCoords.z;
+	float bias = max(0.0025f * (1.0f - dot(vNormal, normalize(light_pos))), 0.0005f);
+
+	int sampleRadius = 4;
+	vec2 pixelSize = 1.0f / vec2(textureSize(shadowMap, 0).xy);
+	for (int y = -sampleRadius; y <= sampleRadius; y++) {
+		for (int x = -sampleRadius; x <= sampleRadius; x++) {
+			float closestDepth = texture(shadowMap, vec3(lightCoords.xy + vec2(x, y) * pixelSize, cascade)).r;
+			if (currentDepth > closestDepth + bias)
+				shadow += 1.0f;
 		}
-		shadow /= pow(sampleRadius * 2.0f + 1.0f, 2.0f);
 	}
+	shadow /= pow(sampleRadius * 2.0f + 1.0f, 2.0f);
 	shadow *= 0.5f;
 	return shadow;
 }
 
-float uNear = 0.1f;
-float uFar = 500.0f;
-
-float getLinearDepth(float depth) {
-    float z = depth * 2.0 - 1.0; // Convert [0,1] to NDC [-1,1]
-    return (2.0 * uNear * uFar) / (uFar + uNear - z * (uFar - uNear));
+// Octahedral mapping of a unit normal, remapped to [0, 1] for the RG8 target
+vec2 encodeNormal(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.xy * 0.5 + 0.5;
 }
 
 void main() {
 	float shadow = calculateShadow();
 	float l = 0.6f + 0.4f * max(0.0f, dot(vNormal, normalize(light_pos)));
 
-	outputColor = vec4(color * l * (1.0f - shadow), 1.0f);
-	outputNormal = vNormal;
-	outputDepth = getLinearDepth(gl_FragCoord.z) / uFar;
+	outputColor = vec4(vColor * l * (1.0f - shadow), 1.0f);
+	outputNormal = encodeNormal(normalize(vNormal));
 	outputMaterial = vec4(0.0f);
+	vec4 clipPos = camera * vWorldPos;
+	vec4 oldClipPos = uOldVpMatrix * vWorldPos;
+	outputMotion = (clipPos.xy / clipPos.w - oldClipPos.xy / oldClipPos.w) * 0.5f;
 
 	// Debug normals
 	//FragColor = vec4((vNormal + 1.0f) / 2.0f, 1.0f);
@@ -1,20 +1,35 @@
 #version 410 core
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec3 aInstancePosition;
+layout(location = 3) in vec4 aInstanceRotation; // Quaternion x, y, z, w
+layout(location = 4) in vec3 aInstanceSize;	// Voxels, 10 per meter
+layout(location = 5) in vec3 aInstanceColor;
 
-uniform vec3 size;
-uniform mat4 camera;
-uniform mat4 position;
-uniform mat4 rotation;
-uniform mat4 lightMatrix;
+layout(std140) uniform FrameData {
+	mat4 camera;
+	mat4 lightMatrices[4];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
 
 out vec3 vNormal;
-out vec4 vFragPosLight;
+out vec3 vColor;
+out vec4 vWorldPos; // Homogeneous, w is not always 1
+
+vec3 rotate(vec4 q, vec3 v) {
+	return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
 
 void main() {
-	vec4 worldPosition = position * rotation * vec4(aPosition * size, 10.0f);
-	vec4 normal = rotation * vec4(aNormal, 1.0f);
-	vNormal = normalize(normal.xyz);
-	vFragPosLight = lightMatrix * worldPosition;
+	vec4 worldPosition = vec4(aInstancePosition + rotate(aInstanceRotation, aPosition * aInstanceSize * 0.1f), 1.0f);
+	vNormal = normalize(rotate(aInstanceRotation, aNormal));
+	vColor = aInstanceColor;
+	vWorldPos = worldPosition;
 	gl_Position = camera * worldPosition;
 }
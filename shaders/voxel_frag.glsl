@@ -1,35 +1,62 @@
 #version 410 core
-uniform int uPalette;
 uniform sampler2D uColor;
-uniform sampler2D shadowMap;
-uniform vec3 light_pos;
-uniform bool transparent_glass;
+uniform sampler2DArray shadowMap;
+
+layout(std140) uniform FrameData {
+	mat4 camera;
+	mat4 lightMatrices[4];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
+
+layout(std140) uniform ObjectData {
+	mat4 position;
+	mat4 rotation;
+	mat4 world_pos;
+	mat4 world_rot;
+	vec3 size;
+	float scale;
+	vec3 base_color;
+	int uPalette;
+};
 
 in vec3 vNormal;
 in float vTexCoord;
-in vec4 vFragPosLight;
+in vec4 vWorldPos;
 
 out vec4 FragColor;
 
 float calculateShadow() {
+	// First cascade that contains the fragment, they are ordered outwards from the camera
+	int cascade = -1;
+	vec3 lightCoords;
+	for (int i = 0; i < 4 && cascade < 0; i++) {
+		vec4 fragPosLight = lightMatrices[i] * vWorldPos;
+		lightCoords = (fragPosLight.xyz / fragPosLight.w + 1.0f) / 2.0f;
+		if (all(greaterThanEqual(lightCoords, vec3(0.0f))) && all(lessThanEqual(lightCoords, vec3(1.0f))))
+			cascade = i;
+	}
+	if (cascade < 0) return 0.0f;
+
 	float shadow = 0.0f;
-	vec3 lightCoords = vFragPosLight.xyz / vFragPosLight.w;
-	if (lightCoords.z <= 1.0f) {
-		lightCoords = (lightCoords + 1.0f) / 2.0f;
-		float currentDepth = lightCoords.z;
-		float bias = max(0.0025f * (1.0f - dot(vNormal, normalize(light_pos))), 0.0005f);
-
-		int sampleRadius = 4;
-		vec2 pixelSize = 1.0f / textureSize(shadowMap, 0);
-		for (int y = -sampleRadius; y <= sampleRadius; y++) {
-			for (int x = -sampleRadius; x <= sampleRadius; x++) {
-				float closestDepth = texture(shadowMap, lightCoords.xy + vec2(x, y) * pixelSize).r;
-				if (currentDepth > closestDepth + bias)
-					shadow += 1.0f;	 
-			}
+	float currentDepth = lightCoords.z;
+	float bias = max(0.0025f * (1.0f - dot(vNormal, normalize(light_pos))), 0.0005f);
+
+	int sampleRadius = 4;
+	vec2 pixelSize = 1.0f / vec2(textureSize(shadowMap, 0).xy);
+	for (int y = -sampleRadius; y <= sampleRadius; y++) {
+		for (int x = -sampleRadius; x <= sampleRadius; x++) {
+			float closestDepth = texture(shadowMap, vec3(lightCoords.xy + vec2(x, y) * pixelSize, cascade)).r;
+			if (currentDepth > closestDepth + bias)
+				shadow += 1.0f;
 		}
-		shadow /= pow(sampleRadius * 2.0f + 1.0f, 2.0f);
 	}
+	shadow /= pow(sampleRadius * 2.0f + 1.0f, 2.0f);
 	shadow *= 0.5f;
 	return shadow;
 }
@@ -39,7 +66,9 @@ void main() {
 	float l = 0.6f + 0.4f * max(0.0f, dot(vNormal, normalize(light_pos)));
 	vec4 color = texelFetch(uColor, ivec2(vTexCoord + 0.5, uPalette), 0);
 
-	if (transparent_glass && color.a < 1.0f) discard;
+#ifdef TRANSPARENT_GLASS
+	if (color.a < 1.0f) discard;
+#endif
 	FragColor = vec4(color.rgb * l * (1.0f - shadow), 1.0f);
 
 	// Debug normals
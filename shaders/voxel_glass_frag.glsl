@@ -1,8 +1,29 @@
 #version 410 core
-uniform int uPalette;
 uniform sampler2D uColor;
-uniform sampler2D shadowMap;
-uniform vec3 light_pos;
+uniform sampler2DArray shadowMap;
+
+layout(std140) uniform FrameData {
+	mat4 camera;
+	mat4 lightMatrices[4];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
+
+layout(std140) uniform ObjectData {
+	mat4 position;
+	mat4 rotation;
+	mat4 world_pos;
+	mat4 world_rot;
+	vec3 size;
+	float scale;
+	vec3 base_color;
+	int uPalette;
+};
 
 in vec3 vNormal;
 in float vTexCoord;
@@ -4,20 +4,39 @@ layout(location = 1) in vec3 aNormal;
 layout(location = 2) in float aTexCoord;
 layout(location = 3) in vec3 aOffset;
 
-uniform int side;
-uniform mat4 camera;
-uniform float scale;
-uniform mat4 position;
-uniform mat4 rotation;
-uniform mat4 world_pos;
-uniform mat4 world_rot;
-uniform mat4 lightMatrix;
+// Hexagon orientation: 0 cube, 1 top, 2 front, 3 side
+#ifndef HEX_SIDE
+#define HEX_SIDE 0
+#endif
+
+layout(std140) uniform FrameData {
+	mat4 camera;
+	mat4 lightMatrices[4];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
+
+layout(std140) uniform ObjectData {
+	mat4 position;
+	mat4 rotation;
+	mat4 world_pos;
+	mat4 world_rot;
+	vec3 size;
+	float scale;
+	vec3 base_color;
+	int uPalette;
+};
 
 out vec3 vNormal;
 out float vTexCoord;
-out vec4 vFragPosLight;
+out vec4 vWorldPos; // Homogeneous, w is not always 1
 
-const float three_halves = sqrt(3);
+const float three_halves = 1.5; // Column spacing, hexagons with unit sides tile every 1.5
 const float two_plus_two = 5;
 
 vec3 getHexPos(int side) {
@@ -55,14 +74,14 @@ vec3 getHexNormal(int side) {
 }
 
 void main() {
-	vec4 pos = position * rotation * vec4(getHexPos(side), 1.0f);
+	vec4 pos = position * rotation * vec4(getHexPos(HEX_SIDE), 1.0f);
 	vec4 worldPosition = world_pos * world_rot * vec4(pos.x, pos.z, -pos.y, 10.0f / scale);
 
-	vec4 local_normal = rotation * vec4(getHexNormal(side), 1.0f);
+	vec4 local_normal = rotation * vec4(getHexNormal(HEX_SIDE), 1.0f);
 	vec4 normal = world_rot * vec4(local_normal.x, local_normal.z, -local_normal.y, 1.0f);
 	
 	vNormal = normalize(normal.xyz);
 	vTexCoord = aTexCoord;
-	vFragPosLight = lightMatrix * worldPosition;
+	vWorldPos = worldPosition;
 	gl_Position = camera * worldPosition;
 }
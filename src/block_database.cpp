@@ -0,0 +1,89 @@
+#include <filesystem>
+
+#include "block_database.h"
+
+// Size and modification time, a missing file is stamped with zeros
+static void StampAsset(const string& path, uint64_t& size, int64_t& mtime) {
+	error_code error;
+	size = filesystem::file_size(path, error);
+	if (error) {
+		size = 0;
+		mtime = 0;
+		return;
+	}
+	mtime = filesystem::last_write_time(path, error).time_since_epoch().count();
+	if (error)
+		mtime = 0;
+}
+
+void DatabaseWriter::writeData(const void* data, size_t size) {
+	fwrite(data, 1, size, file);
+}
+
+void DatabaseWriter::writeString(const string& value) {
+	write((uint32_t)value.size());
+	writeData(value.data(), value.size());
+}
+
+void DatabaseWriter::writeProperties(const map<string, string>& properties) {
+	write((uint32_t)properties.size());
+	for (map<string, string>::const_iterator it = properties.begin(); it != properties.end(); it++) {
+		writeString(it->first);
+		writeString(it->second);
+	}
+}
+
+// Source files the database was built from, it is rebuilt when one of them changes
+void DatabaseWriter::writeAssets(const vector<string>& paths) {
+	write((uint32_t)paths.size());
+	for (vector<string>::const_iterator it = paths.begin(); it != paths.end(); it++) {
+		uint64_t size;
+		int64_t mtime;
+		StampAsset(*it, size, mtime);
+		writeString(*it);
+		write(size);
+		write(mtime);
+	}
+}
+
+const char* DatabaseReader::readData(size_t length) {
+	if (failed || length > size - pos) {
+		failed = true;
+		return NULL;
+	}
+	const char* value = data + pos;
+	pos += length;
+	return value;
+}
+
+string DatabaseReader::readString() {
+	uint32_t length = read<uint32_t>();
+	const char* bytes = readData(length);
+	return bytes != NULL ? string(bytes, length) : "";
+}
+
+map<string, string> DatabaseReader::readProperties() {
+	map<string, string> properties;
+	uint32_t count = read<uint32_t>();
+	for (uint32_t i = 0; i < count && !failed; i++) {
+		string key = readString();
+		properties[key] = readString();
+	}
+	return properties;
+}
+
+// Returns false if any asset changed size or modification time since writeAssets
+bool DatabaseReader::readAssets() {
+	uint32_t count = read<uint32_t>();
+	bool current = true;
+	for (uint32_t i = 0; i < count && current && !failed; i++) {
+		string path = readString();
+		uint64_t size = read<uint64_t>();
+		int64_t mtime = read<int64_t>();
+		uint64_t current_size;
+		int64_t current_mtime;
+		StampAsset(path, current_size, current_mtime);
+		current = current && size == current_size && mtime == current_mtime;
+	}
+	return current && !failed;
+}
@@ -0,0 +1,50 @@
+#ifndef BLOCK_DATABASE_H
+#define BLOCK_DATABASE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+using namespace std;
+
+// Flat binary serialization of the resolved block models, read back from a memory mapping
+class DatabaseWriter {
+private:
+	FILE* file;
+public:
+	DatabaseWriter(FILE* file) : file(file) {}
+	template<typename T> void write(const T& value) {
+		fwrite(&value, sizeof(T), 1, file);
+	}
+	void writeData(const void* data, size_t size);
+	void writeString(const string& value);
+	void writeProperties(const map<string, string>& properties);
+	void writeAssets(const vector<string>& paths);
+};
+
+// Reads past the end return zeros and set failed
+class DatabaseReader {
+private:
+	const char* data;
+	size_t size;
+	size_t pos = 0;
+public:
+	bool failed = false;
+	DatabaseReader(const char* data, size_t size) : data(data), size(size) {}
+	const char* readData(size_t length);
+	template<typename T> T read() {
+		T value = T();
+		const char* bytes = readData(sizeof(T));
+		if (bytes != NULL)
+			memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
+	string readString();
+	map<string, string> readProperties();
+	bool readAssets();
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include <math.h>
+#include <numeric>
+#include <algorithm>
+
+#include "bvh.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+enum CullResult : uint8_t {
+	OUTSIDE,
+	INTERSECT,
+	INSIDE,
+};
+
+// Frustum planes in SoA layout, padded to 8 with planes that accept everything
+struct FrustumPlanes {
+	alignas(16) float nx[8], ny[8], nz[8], d[8];
+	alignas(16) float ax[8], ay[8], az[8];
+};
+
+static void LoadPlanes(const Frustum& frustum, FrustumPlanes& planes) {
+	const Plane* source[] = {
+		&frustum.near, &frustum.far,
+		&frustum.left, &frustum.right,
+		&frustum.top, &frustum.bottom
+	};
+	for (int i = 0; i < 8; i++) {
+		vec3 normal = i < 6 ? source[i]->normal : vec3(0, 0, 0);
+		planes.nx[i] = normal.x;
+		planes.ny[i] = normal.y;
+		planes.nz[i] = normal.z;
+		planes.d[i] = i < 6 ? source[i]->distance : 1.0f;
+		planes.ax[i] = fabsf(normal.x);
+		planes.ay[i] = fabsf(normal.y);
+		planes.az[i] = fabsf(normal.z);
+	}
+}
+
+// Center-extent test, the box is outside if it is behind any plane
+// and inside if it is in front of all of them
+static CullResult TestAABB(const FrustumPlanes& planes, const AABB& box) {
+	vec3 c = box.center();
+	vec3 e = box.extent();
+#ifdef BVH_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+	const __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+	int outside = 0, intersect = 0;
+	for (int i = 0; i < 8; i += 4) {
+		__m128 dist = _mm_add_ps(_mm_mul_ps(_mm_load_ps(planes.nx + i), cx), _mm_load_ps(planes.d + i));
+		dist = _mm_add_ps(dist, _mm_mul_ps(_mm_load_ps(planes.ny + i), cy));
+		dist = _mm_add_ps(dist, _mm_mul_ps(_mm_load_ps(planes.nz + i), cz));
+		__m128 radius = _mm_mul_ps(_mm_load_ps(planes.ax + i), ex);
+		radius = _mm_add_ps(radius, _mm_mul_ps(_mm_load_ps(planes.ay + i), ey));
+		radius = _mm_add_ps(radius, _mm_mul_ps(_mm_load_ps(planes.az + i), ez));
+		outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+		intersect |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), zero));
+	}
+	if (outside != 0) return OUTSIDE;
+	if (intersect != 0) return INTERSECT;
+	return INSIDE;
+#else
+	CullResult result = INSIDE;
+	for (int i = 0; i < 6; i++) {
+		float dist = planes.nx[i] * c.x + planes.ny[i] * c.y + planes.nz[i] * c.z + planes.d[i];
+		float radius = planes.ax[i] * e.x + planes.ay[i] * e.y + planes.az[i] * e.z;
+		if (dist + radius < 0) return OUTSIDE;
+		if (dist - radius < 0) result = INTERSECT;
+	}
+	return result;
+#endif
+}
+
+void BVH::build(const vector<AABB>& object_bounds) {
+	int object_count = object_bounds.size();
+	bounds = object_bounds;
+	indices.resize(object_count);
+	iota(indices.begin(), indices.end(), 0);
+	nodes.clear();
+	if (object_count == 0) return;
+
+	nodes.reserve(2 * object_count);
+	nodes.push_back({ AABB(), -1, 0, object_count });
+	split(0);
+}
+
+// Median split along the longest axis of the centroids
+void BVH::split(int node_index) {
+	int first = nodes[node_index].first;
+	int count = nodes[node_index].count;
+
+	AABB centroids;
+	for (int i = first; i < first + count; i++) {
+		nodes[node_index].bounds.grow(bounds[indices[i]]);
+		centroids.grow(bounds[indices[i]].center());
+	}
+	if (count <= MAX_LEAF_SIZE) return;
+
+	vec3 size = centroids.max - centroids.min;
+	int axis = 0;
+	if (size.y > size.x) axis = 1;
+	if (size.z > size[axis]) axis = 2;
+	if (size[axis] <= 0) return;
+
+	int middle = first + count / 2;
+	nth_element(indices.begin() + first, indices.begin() + middle, indices.begin() + first + count,
+		[&](int a, int b) { return bounds[a].center()[axis] < bounds[b].center()[axis]; });
+
+	int left = nodes.size();
+	nodes[node_index].left = left;
+	nodes.push_back({ AABB(), -1, first, middle - first });
+	nodes.push_back({ AABB(), -1, middle, first + count - middle });
+	split(left);
+	split(left + 1);
+}
+
+// Children are always stored after their parent, update bottom-up
+void BVH::refit(const vector<AABB>& object_bounds) {
+	bounds = object_bounds;
+	for (int i = nodes.size() - 1; i >= 0; i--) {
+		BVHNode& node = nodes[i];
+		node.bounds = AABB();
+		if (node.left == -1) {
+			for (int j = node.first; j < node.first + node.count; j++)
+				node.bounds.grow(bounds[indices[j]]);
+		} else {
+			node.bounds.grow(nodes[node.left].bounds);
+			node.bounds.grow(nodes[node.left + 1].bounds);
+		}
+	}
+}
+
+void BVH::query(const Frustum& frustum, vector<int>& visible) {
+	visible.clear();
+	if (nodes.empty()) return;
+
+	FrustumPlanes planes;
+	LoadPlanes(frustum, planes);
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty()) {
+		const BVHNode& node = nodes[stack.back()];
+		stack.pop_back();
+
+		CullResult result = TestAABB(planes, node.bounds);
+		if (result == OUTSIDE)
+			continue;
+		if (result == INSIDE) { // Accept the whole subtree
+			visible.insert(visible.end(), indices.begin() + node.first, indices.begin() + node.first + node.count);
+		} else if (node.left == -1) {
+			for (int i = node.first; i < node.first + node.count; i++)
+				if (TestAABB(planes, bounds[indices[i]]) != OUTSIDE)
+					visible.push_back(indices[i]);
+		} else {
+			stack.push_back(node.left);
+			stack.push_back(node.left + 1);
+		}
+	}
+}
+
+int BVH::getObjectCount() const {
+	return bounds.size();
+}
@@ -0,0 +1,36 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+
+#include "camera.h"
+
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+struct BVHNode {
+	AABB bounds;
+	int left;  // Right child is left + 1, -1 for leaves
+	int first; // Objects in the subtree are indices[first, first + count)
+	int count;
+};
+
+// Bounding volume hierarchy over the world bounds of the scene objects
+class BVH {
+private:
+	vector<BVHNode> nodes;
+	vector<int> indices;
+	vector<AABB> bounds;
+	vector<int> stack;
+	static const int MAX_LEAF_SIZE = 4;
+	void split(int node_index);
+public:
+	void build(const vector<AABB>& object_bounds);
+	void refit(const vector<AABB>& object_bounds);
+	void query(const Frustum& frustum, vector<int>& visible);
+	int getObjectCount() const;
+};
+
+#endif
@@ -8,6 +8,8 @@
 Camera::Camera(vec3 pos) {
 	screen_width = WINDOW_WIDTH;
 	screen_height = WINDOW_HEIGHT;
+	render_width = screen_width;
+	render_height = screen_height;
 	position = pos;
 	direction = vec3(0, 0, -1);
 	updateMatrix();
@@ -16,9 +18,16 @@ Camera::Camera(vec3 pos) {
 void Camera::updateScreenSize(int width, int height) {
 	screen_width = width;
 	screen_height = height;
+	setRenderScale(render_scale);
 	updateMatrix();
 }
 
+void Camera::setRenderScale(float scale) {
+	render_scale = scale;
+	render_width = std::max(1, (int)(screen_width * scale + 0.5f));
+	render_height = std::max(1, (int)(screen_height * scale + 0.5f));
+}
+
 void Camera::updateMatrix() {
 	mat4 view = lookAt(position, position + direction, up);
 	mat4 projection = perspective(radians(FOV), (float)screen_width / screen_height, NEAR_PLANE, FAR_PLANE);
@@ -87,19 +96,56 @@ void Camera::handleInputs(GLFWwindow* window) {
 	updateMatrix();
 }
 
-bool Camera::isInFrustum(vector<vec3> corners) {
-	vector<Plane> planes = {
-		frustum.near, frustum.far,
-		frustum.left, frustum.right,
-		frustum.top, frustum.bottom
+const Frustum& Camera::getFrustum() const {
+	return frustum;
+}
+
+bool Camera::isInFrustum(const vector<vec3>& corners) const {
+	const Plane* planes[] = {
+		&frustum.near, &frustum.far,
+		&frustum.left, &frustum.right,
+		&frustum.top, &frustum.bottom
 	};
-	for (vector<Plane>::iterator plane = planes.begin(); plane != planes.end(); plane++) {
-		int outside_count = 0;
-		for (vector<vec3>::iterator corner = corners.begin(); corner != corners.end(); corner++) {
-			float dist = dot(plane->normal, *corner) + plane->distance;
+	for (int i = 0; i < 6; i++) {
+		unsigned int outside_count = 0;
+		for (vector<vec3>::const_iterator corner = corners.begin(); corner != corners.end(); corner++) {
+			float dist = dot(planes[i]->normal, *corner) + planes[i]->distance;
 			if (dist < 0) outside_count++;
 		}
-		if (outside_count == 8)
+		if (outside_count == corners.size())
+			return false;
+	}
+	return true;
+}
+
+// Gribb & Hartmann, works for perspective and orthographic projections
+Frustum ExtractFrustum(const mat4& vp_matrix) {
+	vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = vec4(vp_matrix[0][i], vp_matrix[1][i], vp_matrix[2][i], vp_matrix[3][i]);
+
+	Frustum frustum;
+	frustum.left = Plane(row[3] + row[0]);
+	frustum.right = Plane(row[3] - row[0]);
+	frustum.bottom = Plane(row[3] + row[1]);
+	frustum.top = Plane(row[3] - row[1]);
+	frustum.near = Plane(row[3] + row[2]);
+	frustum.far = Plane(row[3] - row[2]);
+	return frustum;
+}
+
+// Conservative, the box is only rejected if it is fully behind one plane
+bool IsInFrustum(const Frustum& frustum, const AABB& box) {
+	const Plane* planes[] = {
+		&frustum.near, &frustum.far,
+		&frustum.left, &frustum.right,
+		&frustum.top, &frustum.bottom
+	};
+	vec3 center = box.center();
+	vec3 extent = box.extent();
+	for (int i = 0; i < 6; i++) {
+		float radius = dot(extent, abs(planes[i]->normal));
+		if (dot(planes[i]->normal, center) + planes[i]->distance < -radius)
 			return false;
 	}
 	return true;
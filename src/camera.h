@@ -1,6 +1,7 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <float.h>
 #include <vector>
 
 #include "shader.h"
@@ -20,6 +21,12 @@ struct Plane {
 		this->normal = normalize(normal);
 		this->distance = -dot(this->normal, point);
 	}
+	// From the plane equation ax + by + cz + d = 0
+	Plane(const vec4& coefficients) {
+		float length = glm::length(vec3(coefficients));
+		this->normal = vec3(coefficients) / length;
+		this->distance = coefficients.w / length;
+	}
 };
 
 struct Frustum {
@@ -31,6 +38,29 @@ struct Frustum {
 	Plane bottom;
 };
 
+struct AABB {
+	vec3 min = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	vec3 max = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	void grow(const vec3& point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+	void grow(const AABB& other) {
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+	vec3 center() const {
+		return 0.5f * (min + max);
+	}
+	vec3 extent() const {
+		return 0.5f * (max - min);
+	}
+};
+
+Frustum ExtractFrustum(const mat4& vp_matrix);
+bool IsInFrustum(const Frustum& frustum, const AABB& box);
+
 class Camera {
 private:
 	float speed = 0.1;
@@ -44,13 +74,17 @@ public:
 	const float FAR_PLANE = 500;
 	const vec3 up = vec3(0, 1, 0);
 	int screen_width, screen_height;
+	int render_width, render_height; // Internal resolution of the scaled passes
+	float render_scale = 1.0f;
 	bool fullscreen = false;
 	vec3 position, direction;
 	mat4 vp_matrix = mat4(1.0);
 	Camera(vec3 position = vec3(0, 1.8, 0));
 	void updateScreenSize(int width, int height);
+	void setRenderScale(float scale);
 	void handleInputs(GLFWwindow* window);
-	bool isInFrustum(vector<vec3> corners);
+	const Frustum& getFrustum() const;
+	bool isInFrustum(const vector<vec3>& corners) const;
 };
 
 #endif
@@ -0,0 +1,40 @@
+#include <math.h>
+#include <algorithm>
+
+#include "dynamic_resolution.h"
+
+DynamicResolution::DynamicResolution(float target_ms) {
+	this->target_ms = target_ms;
+}
+
+// Cost is assumed proportional to the pixel count, the scale drops at once to the estimate that meets the
+// target but only grows one step at a time with some headroom, so it doesn't oscillate. Returns true on change
+bool DynamicResolution::update(double gpu_ms) {
+	if (gpu_ms <= 0) return false;
+	accumulated += gpu_ms;
+	if (++samples < SAMPLES) return false;
+	average_ms = accumulated / samples;
+	accumulated = 0;
+	samples = 0;
+
+	float new_scale = scale;
+	if (average_ms > target_ms) {
+		float estimate = scale * sqrtf(target_ms / average_ms);
+		new_scale = std::min(scale - STEP, floorf(estimate / STEP + 0.001f) * STEP);
+	} else if (average_ms < target_ms * 0.8f) {
+		new_scale = scale + STEP;
+	}
+	new_scale = std::max(MIN_SCALE, std::min(MAX_SCALE, roundf(new_scale / STEP) * STEP));
+	if (fabsf(new_scale - scale) < STEP * 0.5f)
+		return false;
+	scale = new_scale;
+	return true;
+}
+
+float DynamicResolution::getScale() const {
+	return scale;
+}
+
+double DynamicResolution::getAverage() const {
+	return average_ms;
+}
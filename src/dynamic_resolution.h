@@ -0,0 +1,23 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+// Picks the render scale that keeps the measured GPU frame time under the target
+class DynamicResolution {
+private:
+	static const int SAMPLES = 30; // Frames averaged before each decision
+	const float STEP = 0.05f;
+	const float MIN_SCALE = 0.5f;
+	const float MAX_SCALE = 1.0f;
+	float target_ms;
+	float scale = 1.0f;
+	double accumulated = 0;
+	int samples = 0;
+	double average_ms = 0;
+public:
+	DynamicResolution(float target_ms);
+	bool update(double gpu_ms);
+	float getScale() const;
+	double getAverage() const;
+};
+
+#endif
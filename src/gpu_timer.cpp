@@ -0,0 +1,69 @@
+#include <string.h>
+
+#include "gpu_timer.h"
+
+TimedPass& GpuTimer::getPass(const char* name) {
+	for (vector<TimedPass>::iterator it = passes.begin(); it != passes.end(); it++)
+		if (strcmp(it->name, name) == 0)
+			return *it;
+	TimedPass pass;
+	pass.name = name;
+	pass.ms = 0;
+	glGenQueries(TIMER_FRAMES * 2, &pass.queries[0][0]);
+	for (int i = 0; i < TIMER_FRAMES; i++)
+		pass.pending[i] = false;
+	passes.push_back(pass);
+	return passes.back();
+}
+
+// Passes can't be nested
+void GpuTimer::begin(const char* name) {
+	TimedPass& pass = getPass(name);
+	current = &pass - &passes[0];
+	glQueryCounter(pass.queries[frame][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::end() {
+	if (current < 0) return;
+	TimedPass& pass = passes[current];
+	glQueryCounter(pass.queries[frame][1], GL_TIMESTAMP);
+	pass.pending[frame] = true;
+	current = -1;
+}
+
+// Reads the oldest frame before its queries are reused, it was submitted TIMER_FRAMES - 1 frames ago
+void GpuTimer::nextFrame() {
+	frame = (frame + 1) % TIMER_FRAMES;
+	for (vector<TimedPass>::iterator it = passes.begin(); it != passes.end(); it++) {
+		if (!it->pending[frame]) continue;
+		GLuint64 start, stop;
+		glGetQueryObjectui64v(it->queries[frame][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(it->queries[frame][1], GL_QUERY_RESULT, &stop);
+		it->ms = (stop - start) / 1000000.0;
+		it->pending[frame] = false;
+	}
+}
+
+// Latest measured time in milliseconds, 0 until the first result is available
+double GpuTimer::getTime(const char* name) const {
+	for (vector<TimedPass>::const_iterator it = passes.begin(); it != passes.end(); it++)
+		if (strcmp(it->name, name) == 0)
+			return it->ms;
+	return 0;
+}
+
+double GpuTimer::getTotal() const {
+	double total = 0;
+	for (vector<TimedPass>::const_iterator it = passes.begin(); it != passes.end(); it++)
+		total += it->ms;
+	return total;
+}
+
+const vector<TimedPass>& GpuTimer::getPasses() const {
+	return passes;
+}
+
+GpuTimer::~GpuTimer() {
+	for (vector<TimedPass>::iterator it = passes.begin(); it != passes.end(); it++)
+		glDeleteQueries(TIMER_FRAMES * 2, &it->queries[0][0]);
+}
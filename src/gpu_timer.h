@@ -0,0 +1,36 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <vector>
+
+#include "../glad/glad.h"
+
+using namespace std;
+
+static const int TIMER_FRAMES = 4;
+
+struct TimedPass {
+	const char* name;
+	GLuint queries[TIMER_FRAMES][2]; // Start and end timestamps per frame in flight
+	bool pending[TIMER_FRAMES];
+	double ms;
+};
+
+// Timestamp queries read back a few frames later so the CPU never waits for the GPU
+class GpuTimer {
+private:
+	vector<TimedPass> passes;
+	int frame = 0;
+	int current = -1;
+	TimedPass& getPass(const char* name);
+public:
+	void begin(const char* name);
+	void end();
+	void nextFrame();
+	double getTime(const char* name) const;
+	double getTotal() const;
+	const vector<TimedPass>& getPasses() const;
+	~GpuTimer();
+};
+
+#endif
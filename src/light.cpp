@@ -6,19 +6,20 @@ void Light::updatePos(float altitude, float radius, float azimuth) {
 	position = vec3(radius * cos(azimuth), altitude, radius * sin(azimuth));
 }
 
-void Light::updateMatrix() {
-	mat4 view = lookAt(position, vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
-	mat4 projection = ortho(-90.0f, 90.0f, -90.0f, 90.0f, 0.1f, 500.0f);
-	vp_matrix = projection * view;
-}
-
 Light::Light(vec3 pos) {
 	position = pos;
 	altitude = pos.y;
 	radius = sqrt(pos.x * pos.x + pos.z * pos.z);
 	azimuth = atan2(pos.z, pos.x);
-	updateMatrix();
-	initShadowMap();
+	for (int i = 0; i < SHADOW_CASCADES; i++) {
+		vp_matrices[i] = mat4(1.0f);
+		static_rendered[i] = false;
+	}
+	invalidateShadows();
+	shadow_map_texture = createDepthArray();
+	static_map_texture = createDepthArray();
+	glGenFramebuffers(1, &shadow_map_fbo);
+	glGenFramebuffers(1, &static_map_fbo);
 }
 
 void Light::handleInputs(GLFWwindow* window) {
@@ -37,37 +38,119 @@ void Light::handleInputs(GLFWwindow* window) {
 	if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
 		azimuth -= 0.01f;
 	updatePos(altitude, radius, azimuth);
-	updateMatrix();
 }
 
-void Light::initShadowMap() {
-	glGenTextures(1, &shadow_map_texture);
-	glBindTexture(GL_TEXTURE_2D, shadow_map_texture);
+// Fits each cascade to a bounding sphere of its camera frustum slice, the sphere size only depends on the
+// projection so the cascade does not shimmer when the camera rotates. The center is snapped to coarse steps
+// and the sphere padded by one step, so the static casters of a cascade are only redrawn when it moves
+void Light::updateCascades(const Camera& camera) {
+	vec3 direction = normalize(position);
+	vec3 up = fabsf(direction.y) > 0.99f ? vec3(0, 0, 1) : vec3(0, 1, 0);
+	mat4 view = lookAt(vec3(0.0f), -direction, up);
+
+	vec3 forward = normalize(camera.direction);
+	vec3 right = normalize(cross(forward, camera.up));
+	vec3 camera_up = cross(right, forward);
+	float tan_y = tanf(radians(camera.FOV) * 0.5f);
+	float tan_x = tan_y * camera.screen_width / camera.screen_height;
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	float near = camera.NEAR_PLANE;
+	for (int i = 0; i < SHADOW_CASCADES; i++) {
+		float far = std::max(cascade_splits[i], near + 0.1f);
+		vec3 corners[8];
+		vec3 center = vec3(0.0f);
+		for (int j = 0; j < 8; j++) {
+			float d = j & 4 ? far : near;
+			float x = j & 1 ? tan_x * d : -tan_x * d;
+			float y = j & 2 ? tan_y * d : -tan_y * d;
+			corners[j] = camera.position + forward * d + right * x + camera_up * y;
+			center += corners[j] / 8.0f;
+		}
+		float sphere_radius = 0;
+		for (int j = 0; j < 8; j++)
+			sphere_radius = std::max(sphere_radius, length(corners[j] - center));
+		sphere_radius = ceil(sphere_radius * 16.0f) / 16.0f;
+		sphere_radius /= 1.0f - 3.0f * SNAP_TEXELS / WIDTH; // Room for 1.5 steps
+
+		vec3 light_center = vec3(view * vec4(center, 1.0f));
+		float step = 2.0f * sphere_radius / WIDTH * SNAP_TEXELS;
+		light_center = floor(light_center / step) * step;
+		mat4 projection = ortho(light_center.x - sphere_radius, light_center.x + sphere_radius,
+			light_center.y - sphere_radius, light_center.y + sphere_radius,
+			-light_center.z - sphere_radius - CASTER_DISTANCE, -light_center.z + sphere_radius);
+		mat4 vp_matrix = projection * view;
+		if (vp_matrix != vp_matrices[i])
+			static_dirty[i] = true;
+		vp_matrices[i] = vp_matrix;
+		frustums[i] = ExtractFrustum(vp_matrix);
+		near = far;
+	}
+}
+
+const Frustum& Light::getFrustum(int cascade) const {
+	return frustums[cascade];
+}
+
+GLuint Light::createDepthArray() {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	float clamp_color[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, clamp_color);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, WIDTH, HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, clamp_color);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, WIDTH, HEIGHT, SHADOW_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 
-	glGenFramebuffers(1, &shadow_map_fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadow_map_fbo);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadow_map_texture, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return texture;
+}
+
+// Static geometry changed, every cascade redraws its static casters
+void Light::invalidateShadows() {
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+		static_dirty[i] = true;
+}
+
+bool Light::isStaticDirty(int cascade) const {
+	return static_dirty[cascade];
+}
+
+// Cascade matrices are part of the FrameData block, the shader picks one with uCascade
+void Light::bindStaticMap(Shader& shader, int cascade) {
+	glBindFramebuffer(GL_FRAMEBUFFER, static_map_fbo);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, static_map_texture, 0, cascade);
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
-
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, WIDTH, HEIGHT);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	shader.use();
+	static_dirty[cascade] = false;
+	static_rendered[cascade] = true;
 }
 
-void Light::bindShadowMap(Shader& shader) {
+// Restores the static depth of the cascade when it was redrawn or the dynamic casters moved,
+// returns false if last frame's shadow map is still valid and nothing has to be drawn
+bool Light::bindShadowMap(Shader& shader, int cascade, bool dynamic_moved) {
+	bool restore = static_rendered[cascade] || dynamic_moved;
+	static_rendered[cascade] = false;
+	if (!restore)
+		return false;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, static_map_fbo);
+	glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, static_map_texture, 0, cascade);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_map_fbo);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_map_texture, 0, cascade);
+	glDrawBuffer(GL_NONE);
+	glBlitFramebuffer(0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
 	glBindFramebuffer(GL_FRAMEBUFFER, shadow_map_fbo);
 	glViewport(0, 0, WIDTH, HEIGHT);
-	glClear(GL_DEPTH_BUFFER_BIT);
 	shader.use();
-	shader.pushMatrix("lightMatrix", vp_matrix);
+	return true;
 }
 
 void Light::unbindShadowMap(Camera& camera) {
@@ -75,13 +158,18 @@ void Light::unbindShadowMap(Camera& camera) {
 	glViewport(0, 0, camera.screen_width, camera.screen_height);
 }
 
+const mat4& Light::getMatrix(int cascade) const {
+	return vp_matrices[cascade];
+}
+
+// Light position and matrices are part of the FrameData block
 void Light::pushUniforms(Shader& shader) {
-	shader.pushVec3("light_pos", position);
-	shader.pushMatrix("lightMatrix", vp_matrix);
-	shader.pushTexture2D("shadowMap", shadow_map_texture, 0);
+	shader.pushTexture2DArray("shadowMap", shadow_map_texture, 0);
 }
 
 Light::~Light() {
 	glDeleteTextures(1, &shadow_map_texture);
+	glDeleteTextures(1, &static_map_texture);
 	glDeleteFramebuffers(1, &shadow_map_fbo);
+	glDeleteFramebuffers(1, &static_map_fbo);
 }
@@ -3,6 +3,7 @@
 
 #include "camera.h"
 #include "shader.h"
+#include "uniform_buffer.h"
 
 #include <glm/glm.hpp>
 #include "../glad/glad.h"
@@ -12,23 +13,37 @@ private:
 	float altitude;
 	float radius;
 	float azimuth;
-	mat4 vp_matrix;
+	mat4 vp_matrices[SHADOW_CASCADES];
+	Frustum frustums[SHADOW_CASCADES];
+
+	bool static_dirty[SHADOW_CASCADES];
+	bool static_rendered[SHADOW_CASCADES];
 
 	GLuint shadow_map_fbo;
-	GLuint shadow_map_texture;
-	const unsigned int WIDTH = 4096;
-	const unsigned int HEIGHT = 4096;
+	GLuint shadow_map_texture; // One layer per cascade, static casters with the dynamic ones on top
+	GLuint static_map_fbo;
+	GLuint static_map_texture; // Static casters only, kept until the cascade moves
+	const unsigned int WIDTH = 2048;
+	const unsigned int HEIGHT = 2048;
+	const float CASTER_DISTANCE = 250; // Casters behind each cascade towards the light
+	const float SNAP_TEXELS = 64;	   // Cascades move in steps of this many texels
 
-	void initShadowMap();
+	GLuint createDepthArray();
 	void updatePos(float altitude, float radius, float azimuth);
-	void updateMatrix();
 public:
 	vec3 position;
+	float cascade_splits[SHADOW_CASCADES] = { 12, 35, 100, 300 }; // Far distance of each cascade
 	Light(vec3 position);
 	void handleInputs(GLFWwindow* window);
+	void updateCascades(const Camera& camera);
+	const Frustum& getFrustum(int cascade) const;
+	const mat4& getMatrix(int cascade) const;
 	~Light();
 
-	void bindShadowMap(Shader& shader);
+	void invalidateShadows();
+	bool isStaticDirty(int cascade) const;
+	void bindStaticMap(Shader& shader, int cascade);
+	bool bindShadowMap(Shader& shader, int cascade, bool dynamic_moved);
 	void unbindShadowMap(Camera& camera);
 	void pushUniforms(Shader& shader);
 };
@@ -0,0 +1,66 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+bool MappedFile::open(const char* path) {
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = NULL;
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file, &file_size);
+	size = file_size.QuadPart;
+	if (size == 0)
+		return true;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		return false;
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	return data != NULL;
+}
+
+MappedFile::~MappedFile() {
+	if (data != NULL)
+		UnmapViewOfFile(data);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != NULL)
+		CloseHandle(file);
+}
+#else
+bool MappedFile::open(const char* path) {
+	file = ::open(path, O_RDONLY);
+	if (file == -1)
+		return false;
+	struct stat file_stat;
+	if (fstat(file, &file_stat) != 0)
+		return false;
+	size = file_stat.st_size;
+	if (size == 0)
+		return true;
+	void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (mapped == MAP_FAILED)
+		return false;
+	madvise(mapped, size, MADV_SEQUENTIAL);
+	data = (const char*)mapped;
+	return true;
+}
+
+MappedFile::~MappedFile() {
+	if (data != NULL)
+		munmap((void*)data, size);
+	if (file != -1)
+		close(file);
+}
+#endif
@@ -0,0 +1,22 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+// Read only memory mapping of a whole file
+class MappedFile {
+private:
+#ifdef _WIN32
+	void* file = NULL; // Handles, windows.h is kept out of the header
+	void* mapping = NULL;
+#else
+	int file = -1;
+#endif
+public:
+	const char* data = NULL;
+	size_t size = 0;
+	bool open(const char* path);
+	~MappedFile();
+};
+
+#endif
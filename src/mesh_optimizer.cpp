@@ -0,0 +1,375 @@
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <algorithm>
+
+#include "mesh_optimizer.h"
+
+float ComputeACMR(const vector<GLuint>& indices, int vertex_count, int cache_size) {
+	if (indices.size() < 3) return 0;
+	vector<int> cache(cache_size, -1);
+	vector<bool> cached(vertex_count, false);
+	int head = 0, misses = 0;
+	for (unsigned int i = 0; i < indices.size(); i++) {
+		GLuint v = indices[i];
+		if (cached[v]) continue;
+		misses++;
+		if (cache[head] >= 0)
+			cached[cache[head]] = false;
+		cache[head] = v;
+		cached[v] = true;
+		head = (head + 1) % cache_size;
+	}
+	return (float)misses / (indices.size() / 3);
+}
+
+// Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+void OptimizeVertexCache(vector<GLuint>& indices, int vertex_count, vector<unsigned int>& clusters, int cache_size) {
+	int triangle_count = indices.size() / 3;
+	clusters.clear();
+	if (triangle_count == 0) return;
+
+	// Vertex to triangle adjacency in a compact offset table
+	vector<int> live(vertex_count, 0);
+	for (unsigned int i = 0; i < (unsigned int)triangle_count * 3; i++)
+		live[indices[i]]++;
+	vector<int> offsets(vertex_count + 1, 0);
+	for (int v = 0; v < vertex_count; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	vector<int> adjacency(offsets[vertex_count]);
+	vector<int> fill_pos(offsets.begin(), offsets.end() - 1);
+	for (int t = 0; t < triangle_count; t++)
+		for (int j = 0; j < 3; j++)
+			adjacency[fill_pos[indices[t * 3 + j]]++] = t;
+
+	vector<int> timestamps(vertex_count, 0);
+	vector<bool> emitted(triangle_count, false);
+	vector<GLuint> dead_end;
+	vector<GLuint> result;
+	result.reserve(triangle_count * 3);
+	int time = cache_size + 1;
+	int cursor = 1;
+	int fanning = 0;
+
+	clusters.push_back(0);
+	while (fanning >= 0) {
+		vector<GLuint> candidates;
+		for (int a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+			int t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			for (int j = 0; j < 3; j++) {
+				GLuint v = indices[t * 3 + j];
+				result.push_back(v);
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - timestamps[v] > cache_size)
+					timestamps[v] = time++;
+			}
+		}
+
+		// Prefer the candidate still in cache that will stay there while its remaining triangles are emitted
+		int next = -1, best = -1;
+		for (vector<GLuint>::iterator it = candidates.begin(); it != candidates.end(); it++) {
+			if (live[*it] <= 0) continue;
+			int priority = 0;
+			if (time - timestamps[*it] + 2 * live[*it] <= cache_size)
+				priority = time - timestamps[*it];
+			if (priority > best) {
+				best = priority;
+				next = *it;
+			}
+		}
+		if (next < 0) {
+			while (!dead_end.empty() && next < 0) {
+				GLuint v = dead_end.back();
+				dead_end.pop_back();
+				if (live[v] > 0) next = v;
+			}
+			while (next < 0 && cursor < vertex_count) {
+				if (live[cursor] > 0) next = cursor;
+				cursor++;
+			}
+			if (next >= 0 && result.size() / 3 > clusters.back())
+				clusters.push_back(result.size() / 3);
+		}
+		fanning = next;
+	}
+	indices.swap(result);
+}
+
+void OptimizeOverdraw(vector<GLuint>& indices, const vector<MeshVertex>& vertices, const vector<unsigned int>& clusters) {
+	unsigned int triangle_count = indices.size() / 3;
+	if (clusters.size() < 2) return;
+
+	vec3 mesh_center = vec3(0);
+	float mesh_area = 0;
+	vector<vec3> centers(clusters.size());
+	vector<vec3> normals(clusters.size());
+	for (unsigned int c = 0; c < clusters.size(); c++) {
+		unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+		vec3 center = vec3(0), normal = vec3(0);
+		float area = 0;
+		for (unsigned int t = clusters[c]; t < end; t++) {
+			const vec3& a = vertices[indices[t * 3]].position;
+			const vec3& b = vertices[indices[t * 3 + 1]].position;
+			const vec3& d = vertices[indices[t * 3 + 2]].position;
+			vec3 n = cross(b - a, d - a); // Length is twice the area
+			float triangle_area = length(n);
+			center += (a + b + d) * (triangle_area / 3.0f);
+			normal += n;
+			area += triangle_area;
+		}
+		mesh_center += center;
+		mesh_area += area;
+		centers[c] = area > 0 ? center / area : vertices[indices[clusters[c] * 3]].position;
+		normals[c] = length(normal) > 0 ? normalize(normal) : vec3(0);
+	}
+	if (mesh_area > 0)
+		mesh_center /= mesh_area;
+
+	vector<pair<float, unsigned int> > order(clusters.size());
+	for (unsigned int c = 0; c < clusters.size(); c++)
+		order[c] = make_pair(-dot(centers[c] - mesh_center, normals[c]), c);
+	stable_sort(order.begin(), order.end());
+
+	vector<GLuint> result;
+	result.reserve(indices.size());
+	for (unsigned int i = 0; i < order.size(); i++) {
+		unsigned int c = order[i].second;
+		unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+		result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+	}
+	indices.swap(result);
+}
+
+void OptimizeVertexFetch(vector<GLuint>& indices, vector<MeshVertex>& vertices) {
+	const GLuint UNUSED = 0xFFFFFFFF;
+	vector<GLuint> remap(vertices.size(), UNUSED);
+	vector<MeshVertex> result;
+	result.reserve(vertices.size());
+	for (unsigned int i = 0; i < indices.size(); i++) {
+		GLuint& v = indices[i];
+		if (remap[v] == UNUSED) {
+			remap[v] = result.size();
+			result.push_back(vertices[v]);
+		}
+		v = remap[v];
+	}
+	vertices.swap(result);
+}
+
+static bool PositionLess(const vec3& a, const vec3& b) {
+	if (a.x != b.x) return a.x < b.x;
+	if (a.y != b.y) return a.y < b.y;
+	return a.z < b.z;
+}
+
+void ExtractPositions(const vector<vec3>& positions, const vector<GLuint>& indices, vector<vec3>& unique_positions, vector<GLuint>& remapped_indices) {
+	vector<GLuint> sorted(positions.size());
+	for (unsigned int i = 0; i < positions.size(); i++)
+		sorted[i] = i;
+	sort(sorted.begin(), sorted.end(), [&](GLuint a, GLuint b) { return PositionLess(positions[a], positions[b]); });
+
+	vector<GLuint> remap(positions.size());
+	unique_positions.clear();
+	for (unsigned int i = 0; i < sorted.size(); i++) {
+		if (i == 0 || PositionLess(positions[sorted[i - 1]], positions[sorted[i]]))
+			unique_positions.push_back(positions[sorted[i]]);
+		remap[sorted[i]] = unique_positions.size() - 1;
+	}
+	remapped_indices.resize(indices.size());
+	for (unsigned int i = 0; i < indices.size(); i++)
+		remapped_indices[i] = remap[indices[i]];
+}
+
+// Symmetric 4x4 matrix of the summed squared distances to the planes around a vertex
+struct Quadric {
+	double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+	void addPlane(const vec3& n, float d) {
+		a2 += n.x * n.x; ab += n.x * n.y; ac += n.x * n.z; ad += n.x * d;
+		b2 += n.y * n.y; bc += n.y * n.z; bd += n.y * d;
+		c2 += n.z * n.z; cd += n.z * d;
+		d2 += d * d;
+	}
+	void add(const Quadric& q) {
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+		bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+	}
+	double error(const vec3& p) const {
+		double x = p.x, y = p.y, z = p.z;
+		return x * x * a2 + 2 * x * y * ab + 2 * x * z * ac + 2 * x * ad
+			+ y * y * b2 + 2 * y * z * bc + 2 * y * bd
+			+ z * z * c2 + 2 * z * cd + d2;
+	}
+};
+
+struct Collapse {
+	GLuint from;
+	GLuint to;
+	double cost;
+	bool operator<(const Collapse& other) const {
+		return cost < other.cost;
+	}
+};
+
+static bool PositionLess(const MeshVertex& a, const MeshVertex& b) {
+	return PositionLess(a.position, b.position);
+}
+
+float SimplifyMesh(const vector<GLuint>& indices, const vector<MeshVertex>& vertices, unsigned int target_triangles, float max_error, vector<GLuint>& result) {
+	result = indices;
+	unsigned int vertex_count = vertices.size();
+
+	// Vertices sharing a position differ in UV or normal, they form a seam
+	vector<GLuint> sorted(vertex_count);
+	for (unsigned int i = 0; i < vertex_count; i++)
+		sorted[i] = i;
+	sort(sorted.begin(), sorted.end(), [&](GLuint a, GLuint b) { return PositionLess(vertices[a], vertices[b]); });
+	vector<int> group(vertex_count);
+	vector<bool> locked(vertex_count, false);
+	int group_count = 0;
+	for (unsigned int i = 0; i < vertex_count; ) {
+		unsigned int j = i + 1;
+		while (j < vertex_count && !PositionLess(vertices[sorted[i]], vertices[sorted[j]]))
+			j++;
+		for (unsigned int k = i; k < j; k++) {
+			group[sorted[k]] = group_count;
+			locked[sorted[k]] = j - i > 1;
+		}
+		group_count++;
+		i = j;
+	}
+
+	// Edges not shared by exactly two triangles are borders or non-manifold
+	vector<uint64_t> edges;
+	edges.reserve(result.size());
+	for (unsigned int t = 0; t + 2 < result.size(); t += 3) {
+		for (int j = 0; j < 3; j++) {
+			uint64_t a = group[result[t + j]], b = group[result[t + (j + 1) % 3]];
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	}
+	sort(edges.begin(), edges.end());
+	vector<bool> border(group_count, false);
+	for (unsigned int i = 0; i < edges.size(); ) {
+		unsigned int j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i])
+			j++;
+		if (j - i != 2) {
+			border[edges[i] >> 32] = true;
+			border[edges[i] & 0xFFFFFFFF] = true;
+		}
+		i = j;
+	}
+	for (unsigned int v = 0; v < vertex_count; v++)
+		if (border[group[v]])
+			locked[v] = true;
+
+	vector<Quadric> quadrics(group_count);
+	for (unsigned int t = 0; t + 2 < result.size(); t += 3) {
+		const vec3& a = vertices[result[t]].position;
+		vec3 n = cross(vertices[result[t + 1]].position - a, vertices[result[t + 2]].position - a);
+		if (length(n) == 0) continue;
+		n = normalize(n);
+		for (int j = 0; j < 3; j++)
+			quadrics[group[result[t + j]]].addPlane(n, -dot(n, a));
+	}
+
+	double max_cost = (double)max_error * max_error;
+	double reached = 0;
+	vector<int> offsets(vertex_count + 1);
+	vector<int> adjacency;
+	vector<Collapse> collapses;
+	vector<bool> touched(vertex_count);
+	// Each pass collapses a batch of independent vertices ordered by cost, then rebuilds the adjacency
+	while (result.size() / 3 > target_triangles) {
+		fill(offsets.begin(), offsets.end(), 0);
+		for (unsigned int i = 0; i < result.size(); i++)
+			offsets[result[i] + 1]++;
+		for (unsigned int v = 0; v < vertex_count; v++)
+			offsets[v + 1] += offsets[v];
+		adjacency.resize(result.size());
+		vector<int> fill_pos(offsets.begin(), offsets.end() - 1);
+		for (unsigned int i = 0; i < result.size(); i++)
+			adjacency[fill_pos[result[i]]++] = i / 3;
+
+		collapses.clear();
+		for (unsigned int u = 0; u < vertex_count; u++) {
+			if (locked[u] || offsets[u] == offsets[u + 1]) continue;
+			Collapse best = { u, u, DBL_MAX };
+			for (int a = offsets[u]; a < offsets[u + 1]; a++) {
+				for (int j = 0; j < 3; j++) {
+					GLuint w = result[adjacency[a] * 3 + j];
+					if (w == u) continue;
+					Quadric q = quadrics[group[u]];
+					q.add(quadrics[group[w]]);
+					double cost = q.error(vertices[w].position);
+					if (cost < best.cost) {
+						best.to = w;
+						best.cost = cost;
+					}
+				}
+			}
+			if (best.cost <= max_cost)
+				collapses.push_back(best);
+		}
+		sort(collapses.begin(), collapses.end());
+
+		fill(touched.begin(), touched.end(), false);
+		unsigned int triangles = result.size() / 3;
+		int applied = 0;
+		for (vector<Collapse>::iterator it = collapses.begin(); it != collapses.end() && triangles > target_triangles; it++) {
+			GLuint u = it->from, w = it->to;
+			if (touched[u] || touched[w]) continue;
+
+			// Reject collapses that flip a remaining triangle
+			bool flipped = false;
+			int removed = 0;
+			for (int a = offsets[u]; a < offsets[u + 1] && !flipped; a++) {
+				GLuint* tri = &result[adjacency[a] * 3];
+				if (group[tri[0]] == group[w] || group[tri[1]] == group[w] || group[tri[2]] == group[w]) {
+					removed++;
+					continue;
+				}
+				vec3 p[3], q[3];
+				for (int j = 0; j < 3; j++) {
+					p[j] = vertices[tri[j]].position;
+					q[j] = tri[j] == u ? vertices[w].position : p[j];
+				}
+				vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+				vec3 after = cross(q[1] - q[0], q[2] - q[0]);
+				if (dot(before, after) <= 0)
+					flipped = true;
+			}
+			if (flipped) continue;
+
+			for (int a = offsets[u]; a < offsets[u + 1]; a++) {
+				GLuint* tri = &result[adjacency[a] * 3];
+				for (int j = 0; j < 3; j++) {
+					touched[tri[j]] = true;
+					if (tri[j] == u)
+						tri[j] = w;
+				}
+			}
+			quadrics[group[w]].add(quadrics[group[u]]);
+			reached = std::max(reached, it->cost);
+			triangles -= removed;
+			applied++;
+		}
+		if (applied == 0) break;
+
+		unsigned int write = 0;
+		for (unsigned int t = 0; t + 2 < result.size(); t += 3) {
+			int a = group[result[t]], b = group[result[t + 1]], c = group[result[t + 2]];
+			if (a == b || b == c || a == c) continue;
+			result[write++] = result[t];
+			result[write++] = result[t + 1];
+			result[write++] = result[t + 2];
+		}
+		result.resize(write);
+	}
+	return sqrt(reached);
+}
@@ -0,0 +1,32 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+
+#include "obj_loader.h"
+
+using namespace std;
+
+// FIFO post-transform cache size assumed by the optimizer and the ACMR estimate
+static const int VERTEX_CACHE_SIZE = 16;
+
+// Average cache miss ratio, transformed vertices per triangle
+float ComputeACMR(const vector<GLuint>& indices, int vertex_count, int cache_size = VERTEX_CACHE_SIZE);
+
+// Tipsify triangle order, returns the start of each cluster at the points where the walk jumped
+void OptimizeVertexCache(vector<GLuint>& indices, int vertex_count, vector<unsigned int>& clusters, int cache_size = VERTEX_CACHE_SIZE);
+
+// Draws clusters facing away from the mesh center first so they occlude the inner ones
+void OptimizeOverdraw(vector<GLuint>& indices, const vector<MeshVertex>& vertices, const vector<unsigned int>& clusters);
+
+// Renumbers vertices in order of first use
+void OptimizeVertexFetch(vector<GLuint>& indices, vector<MeshVertex>& vertices);
+
+// Position-only copy of an indexed mesh for depth passes, vertices that only differ in other attributes are merged
+void ExtractPositions(const vector<vec3>& positions, const vector<GLuint>& indices, vector<vec3>& unique_positions, vector<GLuint>& remapped_indices);
+
+// Quadric error edge collapses onto existing vertices, UV seams, hard normals and open borders stay locked
+// Returns the geometric error of the result in mesh units
+float SimplifyMesh(const vector<GLuint>& indices, const vector<MeshVertex>& vertices, unsigned int target_triangles, float max_error, vector<GLuint>& result);
+
+#endif
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "worker_pool.h"
+
+// Minimum bytes per block, smaller files are parsed as a single block
+static const size_t MIN_BLOCK_SIZE = 1 << 20;
+
+// Relative indices are stored with this bias, the block-local index is negative when it points into an earlier block
+static const int RELATIVE_BIAS = 1 << 30;
+
+// Face corners store 1-based file indices, block-local indices minus RELATIVE_BIAS and 0 if missing
+struct OBJBlock {
+	const char* begin;
+	const char* end;
+	vector<vec3> positions;
+	vector<vec3> normals;
+	vector<vec2> tex_coords;
+	vector<ivec3> corners; // Position, uv and normal of each triangle corner
+};
+
+struct CornerHash {
+	size_t operator()(const ivec3& c) const {
+		return ((size_t)c.x * 73856093u) ^ ((size_t)c.y * 19349663u) ^ ((size_t)c.z * 83492791u);
+	}
+};
+
+static inline bool IsSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* SkipSpaces(const char* p, const char* end) {
+	while (p < end && IsSpace(*p))
+		p++;
+	return p;
+}
+
+static inline const char* NextLine(const char* p, const char* end) {
+	while (p < end && *p != '\n')
+		p++;
+	return p < end ? p + 1 : end;
+}
+
+static inline const char* ParseInt(const char* p, const char* end, int& value) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	int result = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+		result = 10 * result + (*p++ - '0');
+	value = negative ? -result : result;
+	return p;
+}
+
+static const double POW10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Decimal and scientific notation, enough precision for single floats
+static inline const char* ParseFloat(const char* p, const char* end, float& value) {
+	p = SkipSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		if (digits++ < 18)
+			mantissa = 10 * mantissa + (*p - '0');
+		else
+			exponent++;
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+			if (digits++ < 18) {
+				mantissa = 10 * mantissa + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int e;
+		p = ParseInt(p + 1, end, e);
+		exponent += e;
+	}
+	double result = (double)mantissa;
+	if (exponent < 0)
+		result = exponent >= -22 ? result / POW10[-exponent] : result * pow(10.0, exponent);
+	else if (exponent > 0)
+		result = exponent <= 22 ? result * POW10[exponent] : result * pow(10.0, exponent);
+	value = (float)(negative ? -result : result);
+	return p;
+}
+
+static inline int LocalIndex(int index, int count) {
+	if (index >= 0)
+		return index;
+	return count + index - RELATIVE_BIAS; // -1 is the last element read so far
+}
+
+static const char* ParseCorner(const char* p, const char* end, const OBJBlock& block, ivec3& corner) {
+	int position = 0, tex_coord = 0, normal = 0;
+	p = ParseInt(p, end, position);
+	if (p < end && *p == '/') {
+		p++;
+		if (p < end && *p != '/')
+			p = ParseInt(p, end, tex_coord);
+		if (p < end && *p == '/')
+			p = ParseInt(p + 1, end, normal);
+	}
+	corner.x = LocalIndex(position, block.positions.size());
+	corner.y = LocalIndex(tex_coord, block.tex_coords.size());
+	corner.z = LocalIndex(normal, block.normals.size());
+	return p;
+}
+
+static void ParseBlock(OBJBlock* block) {
+	const char* p = block->begin;
+	const char* end = block->end;
+	while (p < end) {
+		p = SkipSpaces(p, end);
+		if (p + 1 < end && p[0] == 'v' && IsSpace(p[1])) {
+			vec3 position;
+			p = ParseFloat(p + 2, end, position.x);
+			p = ParseFloat(p, end, position.y);
+			p = ParseFloat(p, end, position.z);
+			block->positions.push_back(position);
+		} else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && IsSpace(p[2])) {
+			vec3 normal;
+			p = ParseFloat(p + 3, end, normal.x);
+			p = ParseFloat(p, end, normal.y);
+			p = ParseFloat(p, end, normal.z);
+			block->normals.push_back(normal);
+		} else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && IsSpace(p[2])) {
+			vec2 tex_coord;
+			p = ParseFloat(p + 3, end, tex_coord.x);
+			p = ParseFloat(p, end, tex_coord.y);
+			block->tex_coords.push_back(tex_coord);
+		} else if (p + 1 < end && p[0] == 'f' && IsSpace(p[1])) {
+			// Polygons are triangulated as a fan
+			ivec3 first, previous, corner;
+			int count = 0;
+			p = SkipSpaces(p + 2, end);
+			while (p < end && *p != '\n' && *p != '#') {
+				const char* next = ParseCorner(p, end, *block, corner);
+				if (next == p)
+					break; // Not an index
+				p = SkipSpaces(next, end);
+				if (count >= 2) {
+					block->corners.push_back(first);
+					block->corners.push_back(previous);
+					block->corners.push_back(corner);
+				}
+				if (count == 0)
+					first = corner;
+				previous = corner;
+				count++;
+			}
+		}
+		p = NextLine(p, end);
+	}
+}
+
+// Converts a stored corner index to a 0-based index in the merged arrays, -1 if missing or out of range
+static inline int GlobalIndex(int index, int block_offset, int total, int& invalid) {
+	if (index == 0)
+		return -1;
+	int global = index > 0 ? index - 1 : block_offset + index + RELATIVE_BIAS;
+	if (global < 0 || global >= total) {
+		invalid++;
+		return -1;
+	}
+	return global;
+}
+
+bool LoadOBJ(const char* path, vector<MeshVertex>& vertices, vector<GLuint>& indices, OBJStats& stats) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	MappedFile file;
+	if (!file.open(path)) {
+		printf("[Warning] File not found: %s\n", path);
+		return false;
+	}
+	stats.file_size = file.size;
+
+	// Split in blocks that start at the beginning of a line
+	int block_count = std::max(1, std::min(WorkerPool::shared().getWorkerCount(), (int)(file.size / MIN_BLOCK_SIZE)));
+	vector<OBJBlock> blocks(block_count);
+	const char* file_end = file.data + file.size;
+	const char* block_begin = file.data;
+	for (int i = 0; i < block_count; i++) {
+		const char* block_end = i == block_count - 1 ? file_end : NextLine(std::max(block_begin, file.data + file.size * (i + 1) / block_count), file_end);
+		blocks[i].begin = block_begin;
+		blocks[i].end = block_end;
+		block_begin = block_end;
+	}
+
+	ParallelFor(block_count, [&blocks](int i) { ParseBlock(&blocks[i]); });
+
+	vector<vec3> positions, normals;
+	vector<vec2> tex_coords;
+	size_t corner_count = 0;
+	for (vector<OBJBlock>::iterator it = blocks.begin(); it != blocks.end(); it++) {
+		positions.insert(positions.end(), it->positions.begin(), it->positions.end());
+		normals.insert(normals.end(), it->normals.begin(), it->normals.end());
+		tex_coords.insert(tex_coords.end(), it->tex_coords.begin(), it->tex_coords.end());
+		corner_count += it->corners.size();
+	}
+
+	// Merge equal position/uv/normal tuples into one vertex
+	unordered_map<ivec3, GLuint, CornerHash> vertex_map;
+	vertex_map.reserve(corner_count / 2);
+	vertices.reserve(vertices.size() + corner_count / 2);
+	indices.reserve(indices.size() + corner_count);
+	ivec3 offset = ivec3(0, 0, 0);
+	int invalid = 0;
+	for (vector<OBJBlock>::iterator block = blocks.begin(); block != blocks.end(); block++) {
+		for (vector<ivec3>::iterator it = block->corners.begin(); it != block->corners.end(); it++) {
+			ivec3 key = ivec3(GlobalIndex(it->x, offset.x, positions.size(), invalid),
+							  GlobalIndex(it->y, offset.y, tex_coords.size(), invalid),
+							  GlobalIndex(it->z, offset.z, normals.size(), invalid));
+			unordered_map<ivec3, GLuint, CornerHash>::iterator found = vertex_map.find(key);
+			if (found != vertex_map.end()) {
+				indices.push_back(found->second);
+				continue;
+			}
+			MeshVertex vertex = {
+				key.x >= 0 ? positions[key.x] : vec3(0, 0, 0),
+				key.z >= 0 ? normals[key.z] : vec3(0, 0, 0),
+				key.y >= 0 ? tex_coords[key.y] : vec2(0, 0),
+			};
+			GLuint index = vertices.size();
+			vertex_map[key] = index;
+			vertices.push_back(vertex);
+			indices.push_back(index);
+		}
+		offset += ivec3(block->positions.size(), block->tex_coords.size(), block->normals.size());
+	}
+
+	if (invalid > 0)
+		printf("[Warning] %s has %d face indices out of range\n", path, invalid);
+
+	stats.triangles = corner_count / 3;
+	stats.vertices = vertex_map.size();
+	stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return true;
+}
@@ -0,0 +1,28 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include "../glad/glad.h"
+
+using namespace std;
+using namespace glm;
+
+struct MeshVertex {
+	vec3 position;
+	vec3 normal;
+	vec2 tex_coord;
+};
+
+struct OBJStats {
+	size_t file_size = 0;
+	double seconds = 0;
+	int triangles = 0;
+	int vertices = 0; // After merging equal position/normal/uv tuples
+};
+
+// Memory mapped, parsed in parallel line-aligned blocks and returned as an indexed triangle list
+bool LoadOBJ(const char* path, vector<MeshVertex>& vertices, vector<GLuint>& indices, OBJStats& stats);
+
+#endif
@@ -0,0 +1,176 @@
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "occlusion.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define OCCLUSION_SSE
+#include <xmmintrin.h>
+#endif
+
+// Vertices closer than the camera near plane are not projected
+static const float NEAR_W = 0.1f;
+
+// The frame thread rasterizes a band as well when it waits in end()
+OcclusionBuffer::OcclusionBuffer() : workers(std::min(MAX_WORKERS, std::max(1, (int)thread::hardware_concurrency())) - 1) {
+	depth.resize(WIDTH * HEIGHT, 1.0f);
+}
+
+// Receives world space quads, 4 vertices each
+void OcclusionBuffer::begin(const mat4& vp_matrix, const vector<vec3>& quads) {
+	end();
+	this->vp_matrix = vp_matrix;
+	stats = OcclusionStats();
+	triangles.clear();
+	fill(depth.begin(), depth.end(), 1.0f);
+
+	for (unsigned int i = 0; i + 3 < quads.size(); i += 4) {
+		vec3 screen[4];
+		bool clipped = false;
+		for (int j = 0; j < 4 && !clipped; j++) {
+			vec4 clip = vp_matrix * vec4(quads[i + j], 1.0f);
+			if (clip.w < NEAR_W) {
+				clipped = true; // Skipping an occluder is always safe
+				break;
+			}
+			vec3 ndc = vec3(clip) / clip.w;
+			screen[j] = vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z);
+		}
+		if (clipped) continue;
+		triangles.push_back(screen[0]);
+		triangles.push_back(screen[1]);
+		triangles.push_back(screen[2]);
+		triangles.push_back(screen[0]);
+		triangles.push_back(screen[2]);
+		triangles.push_back(screen[3]);
+	}
+	stats.occluder_triangles = triangles.size() / 3;
+	if (triangles.empty()) return;
+
+	int band_count = workers.getWorkerCount();
+	int band_height = (HEIGHT + band_count - 1) / band_count;
+	workers.start(band_count, [this, band_height](int band, int) {
+		int y = band * band_height;
+		rasterizeBand(y, std::min(y + band_height, HEIGHT));
+	});
+	pending = true;
+}
+
+// Waits for the workers, returns false if no buffer was built this frame
+bool OcclusionBuffer::end() {
+	workers.wait();
+	bool was_pending = pending;
+	pending = false;
+	return was_pending;
+}
+
+void OcclusionBuffer::rasterizeBand(int y_min, int y_max) {
+	for (unsigned int i = 0; i + 2 < triangles.size(); i += 3)
+		rasterizeTriangle(triangles[i], triangles[i + 1], triangles[i + 2], y_min, y_max);
+}
+
+void OcclusionBuffer::rasterizeTriangle(const vec3& v0, const vec3& v1, const vec3& v2, int y_min, int y_max) {
+	float min_x = std::min(v0.x, std::min(v1.x, v2.x));
+	float max_x = std::max(v0.x, std::max(v1.x, v2.x));
+	float min_y = std::min(v0.y, std::min(v1.y, v2.y));
+	float max_y = std::max(v0.y, std::max(v1.y, v2.y));
+	int x0 = std::max(0, (int)floorf(min_x)) & ~3; // Aligned to the SIMD width
+	int x1 = std::min(WIDTH - 1, (int)ceilf(max_x));
+	int y0 = std::max(y_min, (int)floorf(min_y));
+	int y1 = std::min(y_max - 1, (int)ceilf(max_y));
+	if (x0 > x1 || y0 > y1) return;
+
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	if (fabsf(area) < 1e-6f) return;
+	float inv_area = 1.0f / area;
+
+	// Barycentric coordinates as plane equations b = A * x + B * y + C, normalized by the area
+	const vec3* v[3] = { &v0, &v1, &v2 };
+	float A[3], B[3], C[3];
+	for (int i = 0; i < 3; i++) {
+		const vec3& a = *v[(i + 1) % 3];
+		const vec3& b = *v[(i + 2) % 3];
+		A[i] = (a.y - b.y) * inv_area;
+		B[i] = (b.x - a.x) * inv_area;
+		C[i] = (a.x * b.y - a.y * b.x) * inv_area;
+	}
+	float zA = A[0] * v0.z + A[1] * v1.z + A[2] * v2.z;
+	float zB = B[0] * v0.z + B[1] * v1.z + B[2] * v2.z;
+	float zC = C[0] * v0.z + C[1] * v1.z + C[2] * v2.z;
+
+	for (int y = y0; y <= y1; y++) {
+		float py = y + 0.5f;
+		float* row = &depth[y * WIDTH];
+#ifdef OCCLUSION_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]), za = _mm_set1_ps(zA);
+		const __m128 r0 = _mm_set1_ps(B[0] * py + C[0]);
+		const __m128 r1 = _mm_set1_ps(B[1] * py + C[1]);
+		const __m128 r2 = _mm_set1_ps(B[2] * py + C[2]);
+		const __m128 rz = _mm_set1_ps(zB * py + zC);
+		for (int x = x0; x <= x1; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+			__m128 b0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+			__m128 b1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+			__m128 b2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(b0, zero), _mm_and_ps(_mm_cmpge_ps(b1, zero), _mm_cmpge_ps(b2, zero)));
+			if (_mm_movemask_ps(inside) == 0) continue;
+			__m128 z = _mm_add_ps(_mm_mul_ps(za, px), rz);
+			__m128 old_z = _mm_loadu_ps(row + x);
+			__m128 new_z = _mm_min_ps(old_z, z);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, new_z), _mm_andnot_ps(inside, old_z)));
+		}
+#else
+		for (int x = x0; x <= x1; x++) {
+			float px = x + 0.5f;
+			float b0 = A[0] * px + B[0] * py + C[0];
+			float b1 = A[1] * px + B[1] * py + C[1];
+			float b2 = A[2] * px + B[2] * py + C[2];
+			if (b0 < 0 || b1 < 0 || b2 < 0) continue;
+			float z = zA * px + zB * py + zC;
+			if (z < row[x]) row[x] = z;
+		}
+#endif
+	}
+}
+
+// An object is hidden if its nearest depth is behind the occluders on every pixel of its screen rectangle
+bool OcclusionBuffer::isVisible(const vec3* corners, int count) {
+	stats.tested++;
+	float min_x = FLT_MAX, min_y = FLT_MAX, min_z = FLT_MAX;
+	float max_x = -FLT_MAX, max_y = -FLT_MAX;
+	for (int i = 0; i < count; i++) {
+		vec4 clip = vp_matrix * vec4(corners[i], 1.0f);
+		if (clip.w < NEAR_W)
+			return true;
+		vec3 ndc = vec3(clip) / clip.w;
+		float x = (ndc.x * 0.5f + 0.5f) * WIDTH;
+		float y = (ndc.y * 0.5f + 0.5f) * HEIGHT;
+		min_x = std::min(min_x, x);
+		max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y);
+		max_y = std::max(max_y, y);
+		min_z = std::min(min_z, ndc.z);
+	}
+	int x0 = std::max(0, (int)floorf(min_x));
+	int x1 = std::min(WIDTH - 1, (int)floorf(max_x));
+	int y0 = std::max(0, (int)floorf(min_y));
+	int y1 = std::min(HEIGHT - 1, (int)floorf(max_y));
+	if (x0 > x1 || y0 > y1)
+		return true;
+
+	for (int y = y0; y <= y1; y++) {
+		const float* row = &depth[y * WIDTH];
+		for (int x = x0; x <= x1; x++)
+			if (min_z <= row[x])
+				return true;
+	}
+	stats.rejected++;
+	return false;
+}
+
+OcclusionBuffer::~OcclusionBuffer() {
+	end();
+}
@@ -0,0 +1,43 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <vector>
+
+#include "camera.h"
+#include "worker_pool.h"
+
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+struct OcclusionStats {
+	int tested = 0;
+	int rejected = 0;
+	int occluder_triangles = 0;
+};
+
+// Low resolution software depth buffer, occluders are rasterized in horizontal bands on persistent worker threads
+class OcclusionBuffer {
+private:
+	static const int WIDTH = 256;
+	static const int HEIGHT = 128;
+	static const int MAX_WORKERS = 4;
+
+	mat4 vp_matrix;
+	vector<float> depth;
+	vector<vec3> triangles; // Screen space x, y and NDC depth
+	WorkerPool workers;
+	bool pending = false;
+	void rasterizeBand(int y_min, int y_max);
+	void rasterizeTriangle(const vec3& v0, const vec3& v1, const vec3& v2, int y_min, int y_max);
+public:
+	OcclusionStats stats;
+	OcclusionBuffer();
+	void begin(const mat4& vp_matrix, const vector<vec3>& quads);
+	bool end();
+	bool isVisible(const vec3* corners, int count);
+	~OcclusionBuffer();
+};
+
+#endif
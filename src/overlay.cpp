@@ -67,7 +67,7 @@ static vector<const char*> skyboxes = {
 	"village",
 };
 
-Overlay::Overlay(GLFWwindow* window, const Camera& camera, const Light& light, Skybox& skybox, const map<const char*, Shader*>& shaders) : 
+Overlay::Overlay(GLFWwindow* window, const Camera& camera, Light& light, Skybox& skybox, const map<const char*, Shader*>& shaders) : 
 	window(window), camera(camera), light(light), skybox(skybox), shaders(shaders) {
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO();
@@ -133,6 +133,22 @@ void Overlay::frame() {
 		}
 
 		ImGui::ColorEdit3("Clear color", (float*)&clear_color);
+
+		if (ImGui::CollapsingHeader("Shadow cascades")) {
+			for (int i = 0; i < SHADOW_CASCADES; i++) {
+				char label[32];
+				sprintf(label, "Cascade %d far", i);
+				float min_split = i > 0 ? light.cascade_splits[i - 1] + 1.0f : 1.0f;
+				ImGui::SliderFloat(label, &light.cascade_splits[i], min_split, 500.0f, "%.0f m");
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Shader permutations")) {
+			vector<string> permutations;
+			Shader::listPermutations(permutations);
+			for (vector<string>::iterator it = permutations.begin(); it != permutations.end(); it++)
+				ImGui::BulletText("%s", it->c_str());
+		}
 		ImGui::Dummy(ImVec2(0, 10));
 		ImGuiIO& io = ImGui::GetIO();
 		ImGui::Text("FPS: %.0f", io.Framerate);
@@ -28,14 +28,14 @@ private:
 
 	GLFWwindow* window;
 	const Camera& camera;
-	const Light& light;
+	Light& light;
 	Skybox& skybox;
 	const map<const char*, Shader*>& shaders;
 public:
 	bool transparent_glass = true;
 	int hex_orientation = 1;
 
-	Overlay(GLFWwindow* window, const Camera& camera, const Light& light, Skybox& skybox, const map<const char*, Shader*>& shaders);
+	Overlay(GLFWwindow* window, const Camera& camera, Light& light, Skybox& skybox, const map<const char*, Shader*>& shaders);
 	void frame();
 	void render();
 };
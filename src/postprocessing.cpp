@@ -34,6 +34,8 @@ SimpleScreen::SimpleScreen(vec2 position, vec2 size, bool use_framebuffer) {
 }
 
 void SimpleScreen::initFrameBuffer(int width, int height) {
+	this->width = width;
+	this->height = height;
 	glGenFramebuffers(1, &framebuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
@@ -43,13 +45,12 @@ void SimpleScreen::initFrameBuffer(int width, int height) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
 
 	GLenum draw_buffers[] = { GL_COLOR_ATTACHMENT0 };
 	glDrawBuffers(1, draw_buffers);
 
-	GLuint depth_buffer;
 	glGenRenderbuffers(1, &depth_buffer);
 	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, width, height);
@@ -59,13 +60,28 @@ void SimpleScreen::initFrameBuffer(int width, int height) {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// Contents are lost and the texture id may change, returns false if the size was already right
+bool SimpleScreen::resize(int width, int height) {
+	if (framebuffer == 0 || (width == this->width && height == this->height))
+		return false;
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &depth_buffer);
+	glDeleteTextures(1, &texture);
+	initFrameBuffer(width, height);
+	return true;
+}
+
+// Renders at the size of the targets, the previous viewport is restored by end
 void SimpleScreen::start() {
+	glGetIntegerv(GL_VIEWPORT, saved_viewport);
 	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void SimpleScreen::end() {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(saved_viewport[0], saved_viewport[1], saved_viewport[2], saved_viewport[3]);
 }
 
 void SimpleScreen::setTexture(GLuint texture, int channels) {
@@ -91,24 +107,77 @@ void SimpleScreen::draw(Shader& shader, Camera& camera) {
 
 // ----------------------------------------------------------------------------
 
+HistoryBuffer::HistoryBuffer() : buffers{
+	SimpleScreen(vec2(0, 0), vec2(1, 1), true),
+	SimpleScreen(vec2(0, 0), vec2(1, 1), true)
+} {
+	clear();
+}
+
+// History starts black, passes can check isValid to ignore it until a frame was written
+void HistoryBuffer::clear() {
+	for (int i = 0; i < 2; i++) {
+		buffers[i].start();
+		buffers[i].end();
+	}
+	valid = false;
+}
+
+void HistoryBuffer::resize(int width, int height) {
+	bool resized = buffers[0].resize(width, height);
+	resized = buffers[1].resize(width, height) || resized;
+	if (resized)
+		clear();
+}
+
+// Renders into the target that is not holding the history
+void HistoryBuffer::start() {
+	buffers[current].start();
+}
+
+void HistoryBuffer::end() {
+	buffers[current].end();
+}
+
+// Called once per frame after the last read of the history
+void HistoryBuffer::swap() {
+	current = 1 - current;
+	valid = true;
+}
+
+// Written this frame
+GLuint HistoryBuffer::getTexture() {
+	return buffers[current].getTexture();
+}
+
+// Written last frame
+GLuint HistoryBuffer::getHistory() {
+	return buffers[1 - current].getTexture();
+}
+
+bool HistoryBuffer::isValid() {
+	return valid;
+}
+
+void HistoryBuffer::draw(Shader& shader, Camera& camera) {
+	buffers[current].draw(shader, camera);
+}
+
+// ----------------------------------------------------------------------------
+
 void Screen::initFrameBuffer(int width, int height) {
+	this->width = width;
+	this->height = height;
 	glGenFramebuffers(1, &framebuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
-	GLuint sampler;
-	glGenSamplers(1, &sampler);
-	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
 	glGenTextures(1, &color_texture);
 	glBindTexture(GL_TEXTURE_2D, color_texture);
 	glTextureParameteri(color_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTextureParameteri(color_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTextureParameteri(color_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(color_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL); // Gamma encoded by the shaders
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture, 0);
 
 	glGenTextures(1, &normal_texture);
@@ -117,9 +186,9 @@ void Screen::initFrameBuffer(int width, int height) {
 	glTextureParameteri(normal_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTextureParameteri(normal_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(normal_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8_SNORM, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, width, height, 0, GL_RG, GL_UNSIGNED_BYTE, NULL); // Octahedral, SNORM is not renderable in GL 4.1
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal_texture, 0);
-	
+
 	glGenTextures(1, &material_texture);
 	glBindTexture(GL_TEXTURE_2D, material_texture);
 	glTextureParameteri(material_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -144,22 +213,28 @@ void Screen::initFrameBuffer(int width, int height) {
 	glTextureParameteri(depth_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTextureParameteri(depth_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(depth_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, width, height, 0, GL_RED, GL_FLOAT, NULL);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, depth_texture, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture, 0);
 
-	GLenum draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4 };
-	glDrawBuffers(5, draw_buffers);
-
-	GLuint depth_buffer;
-	glGenRenderbuffers(1, &depth_buffer);
-	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, width, height);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+	GLenum draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+	glDrawBuffers(4, draw_buffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		printf("[ERROR] G-buffer framebuffer is incomplete\n");
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// Contents are lost and the texture ids change
+void Screen::resize(int width, int height) {
+	if (width == this->width && height == this->height)
+		return;
+	GLuint textures[] = { color_texture, normal_texture, material_texture, motion_texture, depth_texture };
+	glDeleteTextures(5, textures);
+	glDeleteFramebuffers(1, &framebuffer);
+	initFrameBuffer(width, height);
+}
+
 Screen::Screen() {
 	VBO vbo(screen_vertices, sizeof(screen_vertices));
 	EBO ebo(screen_indices, sizeof(screen_indices));
@@ -172,19 +247,23 @@ Screen::Screen() {
 	initFrameBuffer(WINDOW_WIDTH, WINDOW_HEIGHT);
 }
 
+// Renders at the size of the targets, the previous viewport is restored by end
 void Screen::start() {
+	glGetIntegerv(GL_VIEWPORT, saved_viewport);
 	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void Screen::end() {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(saved_viewport[0], saved_viewport[1], saved_viewport[2], saved_viewport[3]);
 }
 
 void Screen::draw(Shader& shader, Camera& camera) {
 	shader.pushFloat("uNear", camera.NEAR_PLANE);
 	shader.pushFloat("uFar", camera.FAR_PLANE);
-	shader.pushVec2("uPixelSize", vec2(1.0f / camera.screen_width, 1.0f / camera.screen_height));
+	shader.pushVec2("uPixelSize", vec2(1.0f / camera.render_width, 1.0f / camera.render_height));
 	shader.pushVec3("uLightDir", vec3(0.38f, -0.76f, 0.53f));
 	shader.pushVec3("uCameraPos", camera.position);
 
@@ -209,3 +288,102 @@ void Screen::pushUniforms(Shader& shader) {
 	shader.pushTexture2D("uBlueNoise", RTX_Render::bluenoise, 4);
 	// uFoamTexture @5
 }
+
+// ----------------------------------------------------------------------------
+
+LowResGBuffer::LowResGBuffer() {
+	VBO vbo(screen_vertices, sizeof(screen_vertices));
+	EBO ebo(screen_indices, sizeof(screen_indices));
+	vao.linkAttrib(0, 2, GL_FLOAT, 4 * sizeof(GLfloat), (GLvoid*)0);
+	vao.linkAttrib(1, 2, GL_FLOAT, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
+	vao.unbind();
+	vbo.unbind();
+	ebo.unbind();
+}
+
+void LowResGBuffer::initFrameBuffer(int width, int height) {
+	this->width = width;
+	this->height = height;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	glGenTextures(1, &normal_texture);
+	glBindTexture(GL_TEXTURE_2D, normal_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, width, height, 0, GL_RG, GL_UNSIGNED_BYTE, NULL);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normal_texture, 0);
+
+	glGenTextures(1, &depth_texture);
+	glBindTexture(GL_TEXTURE_2D, depth_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL); // Same encoding as the depth buffer
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, depth_texture, 0);
+
+	GLenum draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, draw_buffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		printf("[ERROR] Low resolution G-buffer framebuffer is incomplete\n");
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Size is rounded up so every full resolution pixel has a low resolution texel
+void LowResGBuffer::resize(int full_width, int full_height, int divisor) {
+	int width = (full_width + divisor - 1) / divisor;
+	int height = (full_height + divisor - 1) / divisor;
+	if (framebuffer != 0 && width == this->width && height == this->height && divisor == this->divisor)
+		return;
+	this->divisor = divisor;
+	if (framebuffer != 0) {
+		GLuint textures[] = { normal_texture, depth_texture };
+		glDeleteTextures(2, textures);
+		glDeleteFramebuffers(1, &framebuffer);
+	}
+	initFrameBuffer(width, height);
+}
+
+int LowResGBuffer::getWidth() {
+	return width;
+}
+
+int LowResGBuffer::getHeight() {
+	return height;
+}
+
+void LowResGBuffer::downsample(Shader& shader, Screen& gbuffer) {
+	glGetIntegerv(GL_VIEWPORT, saved_viewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+	glDisable(GL_DEPTH_TEST);
+
+	shader.pushInt("uDivisor", divisor);
+	shader.pushTexture2D("uNormal", gbuffer.normal_texture, 2);
+	shader.pushTexture2D("uDepth", gbuffer.depth_texture, 3);
+	vao.bind();
+	glDrawElements(GL_TRIANGLES, sizeof(screen_indices) / sizeof(GLuint), GL_UNSIGNED_INT, 0);
+	vao.unbind();
+
+	glEnable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(saved_viewport[0], saved_viewport[1], saved_viewport[2], saved_viewport[3]);
+}
+
+// Replaces the full resolution depth and normals bound by Screen::pushUniforms
+void LowResGBuffer::pushUniforms(Shader& shader) {
+	shader.pushTexture2D("uNormal", normal_texture, 2);
+	shader.pushTexture2D("uDepth", depth_texture, 3);
+}
+
+LowResGBuffer::~LowResGBuffer() {
+	if (framebuffer == 0) return;
+	GLuint textures[] = { normal_texture, depth_texture };
+	glDeleteTextures(2, textures);
+	glDeleteFramebuffers(1, &framebuffer);
+}
@@ -8,14 +8,18 @@
 class SimpleScreen {
 private:
 	VAO vao;
-	GLuint framebuffer;
+	GLuint framebuffer = 0;
+	GLuint depth_buffer = 0;
 	GLuint texture;
 	vec2 position;
 	vec2 size;
 	int channels;
+	int width = 0, height = 0;
+	GLint saved_viewport[4];
 	void initFrameBuffer(int width, int height);
 public:
 	SimpleScreen(vec2 position, vec2 size, bool use_framebuffer);
+	bool resize(int width, int height);
 	void start();
 	void end();
 	void setTexture(GLuint texture, int channels = 3);
@@ -23,10 +27,32 @@ public:
 	void draw(Shader& shader, Camera& camera);
 };
 
+// Two targets that swap roles each frame, the one written last frame is sampled as history
+class HistoryBuffer {
+private:
+	SimpleScreen buffers[2];
+	int current = 0;
+	bool valid = false;
+	void clear();
+public:
+	HistoryBuffer();
+	void resize(int width, int height);
+	void start();
+	void end();
+	void swap();
+	GLuint getTexture();
+	GLuint getHistory();
+	bool isValid();
+	void draw(Shader& shader, Camera& camera);
+};
+
+// Color RGBA8, octahedral normal RG8, material RGBA8, motion RG16F and the depth buffer as a texture
 class Screen {
 private:
 	VAO vao;
 	GLuint framebuffer;
+	int width, height;
+	GLint saved_viewport[4];
 public:
 	GLuint color_texture;
 	GLuint normal_texture;
@@ -36,10 +62,33 @@ public:
 	void initFrameBuffer(int width, int height);
 
 	Screen();
+	void resize(int width, int height);
 	void start();
 	void end();
 	void draw(Shader& shader, Camera& camera);
 	void pushUniforms(Shader& shader);
 };
 
+// Depth and normals of a Screen at 1/divisor of its size, for passes that run at reduced resolution
+class LowResGBuffer {
+private:
+	VAO vao;
+	GLuint framebuffer = 0;
+	int width = 0, height = 0;
+	int divisor = 1;
+	GLint saved_viewport[4];
+	void initFrameBuffer(int width, int height);
+public:
+	GLuint normal_texture;
+	GLuint depth_texture;
+
+	LowResGBuffer();
+	void resize(int full_width, int full_height, int divisor);
+	int getWidth();
+	int getHeight();
+	void downsample(Shader& shader, Screen& gbuffer);
+	void pushUniforms(Shader& shader);
+	~LowResGBuffer();
+};
+
 #endif
@@ -6,6 +6,7 @@
 int VoxRender::paletteCount = 0;
 GLuint VoxRender::paletteBank = 0;
 GLuint VoxRender::materialBank = 0;
+vector<uint8_t> VoxRender::paletteAlpha;
 
 void VoxRender::generateMatrixAndOBB() {
 	static const mat4 to_world_coords = mat4(vec4(1, 0, 0, 0),
@@ -44,6 +45,33 @@ void VoxRender::generateMatrixAndOBB() {
 	}
 }
 
+AABB VoxRender::getBounds() const {
+	AABB bounds;
+	for (vector<vec3>::const_iterator it = obb_corners.begin(); it != obb_corners.end(); it++)
+		bounds.grow(*it);
+	return bounds;
+}
+
+int VoxRender::getPaletteId() const {
+	return palette_id;
+}
+
+ObjectData VoxRender::getObjectData() const {
+	ObjectData data;
+	data.position = translate(mat4(1.0f), position);
+	data.rotation = mat4_cast(rotation);
+	data.world_pos = translate(mat4(1.0f), world_position);
+	data.world_rot = mat4_cast(world_rotation);
+	data.size = vec3(0, 0, 0); // SM flag not a voxagon
+	data.scale = scale;
+	data.color = vec3(0, 0, 0);
+	data.palette = palette_id;
+	data.texture_tile = vec4(0, 0, 1, 1);
+	data.volume_size = shape_size;
+	data.alpha = 1.0f;
+	return data;
+}
+
 void VoxRender::setTransform(vec3 position, quat rotation) {
 	this->position = position;
 	this->rotation = rotation;
@@ -83,10 +111,17 @@ int VoxRender::getIndex(const MV_Color* palette, const TD_Material* material) {
 	}
 	if (paletteCount == MAX_PALETTES)
 		printf("[Warning] Palette limit reached!\n");
+	for (int i = 0; i < 256; i++)
+		paletteAlpha.push_back(palette[i].a);
 	paletteCount++;
 	return paletteCount - 1;
 }
 
+bool VoxRender::isOpaque(int palette_id, uint8_t index) {
+	unsigned int i = 256 * palette_id + index;
+	return i < paletteAlpha.size() && paletteAlpha[i] == 255;
+}
+
 void VoxRender::saveTexture() {
 	SaveTexture("palette.png", paletteBank);
 	SaveTexture("material.png", materialBank);
@@ -17,6 +17,7 @@ protected:
 	static int paletteCount;
 	static GLuint paletteBank;
 	static GLuint materialBank;
+	static vector<uint8_t> paletteAlpha;
 
 	VAO vao;
 	int palette_id;
@@ -36,8 +37,12 @@ public:
 	void setWorldTransform(vec3 position, quat rotation);
 	void setScale(float scale);
 	void generateMatrixAndOBB();
+	AABB getBounds() const;
+	int getPaletteId() const;
+	ObjectData getObjectData() const;
 
 	static int getIndex(const MV_Color* palette, const TD_Material* material);
+	static bool isOpaque(int palette_id, uint8_t index);
 	static void saveTexture();
 
 	virtual void draw(Shader& shader, Camera& camera) = 0;
@@ -1,140 +1,77 @@
 #include <string.h>
+#include <algorithm>
 
+#include "ebo.h"
 #include "vbo.h"
 #include "utils.h"
+#include "mesh_optimizer.h"
 #include "render_mesh.h"
 
-struct Triangle {
-	int vertex_index[3];
-	int normal_index[3];
-	int tex_index[3];
-};
+// Coarser LODs are drawn while their error stays below this many pixels on screen
+const float Mesh::LOD_PIXEL_ERROR = 1.0f;
 
-void Mesh::loadSimpleOBJ(const char* path) {
-	vector<vec3> positions;
-	vector<vec3> normals;
-	vector<Triangle> mesh;
-
-	FILE* file = fopen(path, "r");
-	if (file == NULL) {
-		printf("[Warning] File not found: %s\n", path);
+void Mesh::loadOBJ(const char* path) {
+	OBJStats stats;
+	if (!LoadOBJ(path, vertices, indices, stats))
 		return;
-	}
+	optimize(path);
+	buildLODs(path);
+}
 
-	positions.push_back({ 0, 0, 0 });
-	normals.push_back({ 0, 0, 0 });
-	do {
-		char line[128];
-		fscanf(file, "%s", line);
-		if (strcmp(line, "v") == 0) {
-			vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-			positions.push_back(vertex);
-		} else if (strcmp(line, "vn") == 0) {
-			vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-			normals.push_back(normal);
-		} else if (strcmp(line, "f") == 0) {
-			Triangle triangle;
-			fscanf(file, "%d//%d %d//%d %d//%d\n",
-				&triangle.vertex_index[0], &triangle.normal_index[0],
-				&triangle.vertex_index[1], &triangle.normal_index[1],
-				&triangle.vertex_index[2], &triangle.normal_index[2]);
-			mesh.push_back(triangle);
-		} else {
-			char buffer[256];
-			fscanf(file, "%[^\n]\n", buffer);
-		}
-	} while (!feof(file));
-	fclose(file);
-
-	for (unsigned int t = 0; t < mesh.size(); t++) {
-		for (int v = 0; v < 3; v++) {
-			vec3 vert = positions[mesh[t].vertex_index[v]];
-			vec3 norm = normals[mesh[t].normal_index[v]];
-			MeshVertex vertex = {
-				vec3(vert.x, vert.y, vert.z),
-				vec3(norm.x, norm.y, norm.z),
-				vec2(0, 0),
-			};
-			vertices.push_back(vertex);
-		}
-	}
+// Reorders triangles for the post-transform cache and overdraw, then vertices for fetch locality
+void Mesh::optimize(const char* path) {
+	if (indices.empty()) return;
+	double start = glfwGetTime();
+	float acmr_before = ComputeACMR(indices, vertices.size());
+	vector<unsigned int> clusters;
+	OptimizeVertexCache(indices, vertices.size(), clusters);
+	OptimizeOverdraw(indices, vertices, clusters);
+	OptimizeVertexFetch(indices, vertices);
+	float acmr_after = ComputeACMR(indices, vertices.size());
+	printf("[INFO] Optimized %s: ACMR %.3f -> %.3f, %d clusters in %.0f ms\n",
+		path, acmr_before, acmr_after, (int)clusters.size(), (glfwGetTime() - start) * 1000.0);
 }
 
-void Mesh::loadOBJ(const char* path) {
-	vector<vec3> positions;
-	vector<vec3> normals;
-	vector<vec2> tex_coords;
-	vector<Triangle> mesh;
-
-	FILE* file = fopen(path, "r");
-	if (file == NULL) {
-		printf("[Warning] File not found: %s\n", path);
-		return;
-	}
+// Each LOD halves the triangle count of the full mesh, simplification stops once the error gets too large
+void Mesh::buildLODs(const char* path) {
+	MeshLOD full = { 0, (GLsizei)indices.size(), 0.0f };
+	lods.push_back(full);
+	if (indices.empty()) return;
 
-	// OBJ indices start at 1
-	positions.push_back({ 0, 0, 0 });
-	normals.push_back({ 0, 0, 0 });
-	tex_coords.push_back({ 0, 0 });
-	do {
-		char line[128];
-		fscanf(file, "%s", line);
-		if (strcmp(line, "v") == 0) {
-			vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-			positions.push_back(vertex);
-		} else if (strcmp(line, "vn") == 0) {
-			vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-			normals.push_back(normal);
-		} else if (strcmp(line, "vt") == 0) {
-			vec2 tex_coord;
-			fscanf(file, "%f %f\n", &tex_coord.x, &tex_coord.y);
-			tex_coords.push_back(tex_coord);
-		} else if (strcmp(line, "f") == 0) {
-			Triangle triangle;
-			fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n",
-				&triangle.vertex_index[0], &triangle.tex_index[0], &triangle.normal_index[0],
-				&triangle.vertex_index[1], &triangle.tex_index[1], &triangle.normal_index[1],
-				&triangle.vertex_index[2], &triangle.tex_index[2], &triangle.normal_index[2]);
-			mesh.push_back(triangle);
-		} else {
-			char buffer[256];
-			fscanf(file, "%[^\n]\n", buffer);
-		}
-	} while (!feof(file));
-	fclose(file);
-
-	//printf("Loaded %d vertices, %d normals, %d tex_coords, %d triangles\n",
-	//	(int)positions.size() - 1, (int)normals.size() - 1, (int)tex_coords.size() - 1, (int)mesh.size());
-
-	// Convert negative indices to positive
-	for (unsigned int t = 0; t < mesh.size(); t++) {
-		for (unsigned int v = 0; v < 3; v++) {
-			if (mesh[t].vertex_index[v] < 0)
-				mesh[t].vertex_index[v] += positions.size();
-			if (mesh[t].normal_index[v] < 0)
-				mesh[t].normal_index[v] += normals.size();
-			if (mesh[t].tex_index[v] < 0)
-				mesh[t].tex_index[v] += tex_coords.size();
-		}
+	AABB bounds;
+	for (unsigned int i = 0; i < vertices.size(); i++)
+		bounds.grow(vertices[i].position);
+	float max_error = 0.05f * length(bounds.max - bounds.min);
+
+	vector<GLuint> full_indices(indices);
+	string summary = to_string(full.count / 3);
+	for (int i = 1; i < MAX_LODS; i++) {
+		vector<GLuint> lod_indices;
+		unsigned int target = (full.count / 3) >> i;
+		float error = SimplifyMesh(full_indices, vertices, target, max_error, lod_indices);
+		if (lod_indices.size() * 10 > (unsigned int)lods.back().count * 9)
+			break; // Less than 10% reduction from the previous LOD
+		vector<unsigned int> clusters;
+		OptimizeVertexCache(lod_indices, vertices.size(), clusters);
+		MeshLOD lod = { (GLuint)indices.size(), (GLsizei)lod_indices.size(), error };
+		lods.push_back(lod);
+		indices.insert(indices.end(), lod_indices.begin(), lod_indices.end());
+		summary += ", " + to_string(lod.count / 3);
 	}
+	printf("[INFO] LODs for %s: %s triangles\n", path, summary.c_str());
+}
 
-	for (unsigned int t = 0; t < mesh.size(); t++) {
-		for (int v = 0; v < 3; v++) {
-			vec3 vert = positions[mesh[t].vertex_index[v]];
-			vec3 norm = normals[mesh[t].normal_index[v]];
-			vec2 tex = tex_coords[mesh[t].tex_index[v]];
-			MeshVertex vertex = {
-				vec3(vert.x, vert.y, vert.z),
-				vec3(norm.x, norm.y, norm.z),
-				vec2(tex.x, tex.y),
-			};
-			vertices.push_back(vertex);
-		}
-	}
+// Projects the LOD error at the nearest point of the bounds, the shadow pass uses the same choice as the camera
+const MeshLOD& Mesh::selectLOD(const Camera& camera) const {
+	AABB bounds = getBounds();
+	float distance = length(glm::max(glm::max(bounds.min - camera.position, camera.position - bounds.max), vec3(0)));
+	if (distance <= camera.NEAR_PLANE)
+		return lods[0];
+	float pixels_per_unit = camera.screen_height / (2.0f * distance * tanf(radians(camera.FOV) * 0.5f));
+	for (int i = lods.size() - 1; i > 0; i--)
+		if (lods[i].error * pixels_per_unit < LOD_PIXEL_ERROR)
+			return lods[i];
+	return lods[0];
 }
 
 void Mesh::saveOBJ(const char* path) {
@@ -149,32 +86,50 @@ void Mesh::saveOBJ(const char* path) {
 		fprintf(output, "vn %f %f %f\n", vertices[i].normal.x, vertices[i].normal.y, vertices[i].normal.z);
 	for (unsigned int i = 0; i < vertices.size(); i++)
 		fprintf(output, "vt %f %f\n", vertices[i].tex_coord.x, vertices[i].tex_coord.y);
-	for (unsigned int i = 0; i < vertices.size(); i += 3)
-		fprintf(output, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", i + 1, i + 1, i + 1, i + 2, i + 2, i + 2, i + 3, i + 3, i + 3);
+	GLsizei count = lods.empty() ? 0 : lods[0].count;
+	for (int i = 0; i + 2 < count; i += 3) {
+		GLuint a = indices[i] + 1, b = indices[i + 1] + 1, c = indices[i + 2] + 1;
+		fprintf(output, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+	}
 	fclose(output);
 }
 
-Mesh::Mesh(const char* path) {
-	loadOBJ(path);
-
+void Mesh::createBuffers() {
+	vao.bind();
 	VBO vbo(vertices);
+	EBO ebo(indices);
 	vao.linkAttrib(0, 3, GL_FLOAT, sizeof(MeshVertex), (GLvoid*)0);						// Position
 	vao.linkAttrib(1, 3, GL_FLOAT, sizeof(MeshVertex), (GLvoid*)(3 * sizeof(GLfloat))); // Normal
 	vao.linkAttrib(2, 2, GL_FLOAT, sizeof(MeshVertex), (GLvoid*)(6 * sizeof(GLfloat))); // TexCoord
 	vao.unbind();
+
+	vector<vec3> positions, depth_positions;
+	vector<GLuint> depth_indices;
+	for (unsigned int i = 0; i < vertices.size(); i++)
+		positions.push_back(vertices[i].position);
+	ExtractPositions(positions, indices, depth_positions, depth_indices);
+	depth_vao.bind();
+	VBO depth_vbo(depth_positions);
+	EBO depth_ebo(depth_indices);
+	depth_vao.linkAttrib(0, 3, GL_FLOAT, sizeof(vec3), (GLvoid*)0); // Position
+	depth_vao.unbind();
+
 	vbo.unbind();
+	ebo.unbind();
+
+	for (unsigned int i = 0; i < vertices.size(); i++)
+		local_bounds.grow(vertices[i].position);
+}
+
+Mesh::Mesh(const char* path) {
+	loadOBJ(path);
+	createBuffers();
 }
 
 Mesh::Mesh(const char* path, vec3 color) {
 	this->color = color;
-	loadSimpleOBJ(path);
-
-	VBO vbo(vertices);
-	vao.linkAttrib(0, 3, GL_FLOAT, sizeof(MeshVertex), (GLvoid*)0);						// Position
-	vao.linkAttrib(1, 3, GL_FLOAT, sizeof(MeshVertex), (GLvoid*)(3 * sizeof(GLfloat))); // Normal
-	vao.linkAttrib(2, 2, GL_FLOAT, sizeof(MeshVertex), (GLvoid*)(6 * sizeof(GLfloat))); // TexCoord
-	vao.unbind();
-	vbo.unbind();
+	loadOBJ(path);
+	createBuffers();
 }
 
 void Mesh::addTexture(const char* path) {
@@ -182,6 +137,11 @@ void Mesh::addTexture(const char* path) {
 	textures.push_back(texture_id);
 }
 
+// First texture, used to group meshes sharing a material
+GLuint Mesh::getTexture() const {
+	return textures.empty() ? 0 : textures[0];
+}
+
 void Mesh::handleInputs(GLFWwindow* window) {
 	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
 		position.y += 0.025f;
@@ -207,18 +167,32 @@ void Mesh::setWorldTransform(vec3 position, quat rotation) {
 	this->rotation = rotation;
 }
 
-void Mesh::draw(Shader& shader, Camera& camera) {
-	shader.pushMatrix("camera", camera.vp_matrix);
-	shader.pushVec3("camera_pos", camera.position);
+AABB Mesh::getBounds() const {
+	AABB bounds;
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = vec3(i & 1 ? local_bounds.max.x : local_bounds.min.x,
+						   i & 2 ? local_bounds.max.y : local_bounds.min.y,
+						   i & 4 ? local_bounds.max.z : local_bounds.min.z);
+		bounds.grow(position + rotation * corner);
+	}
+	return bounds;
+}
 
-	shader.pushFloat("scale", 0); // SM flag not a voxel
-	shader.pushVec3("size", vec3(0, 0, 0)); // SM flag not a voxagon
-	shader.pushVec3("color", color); // No texture
+ObjectData Mesh::getObjectData() const {
+	ObjectData data;
+	data.position = translate(mat4(1.0f), position);
+	data.rotation = mat4_cast(rotation);
+	data.world_pos = mat4(1.0f);
+	data.world_rot = mat4(1.0f);
+	data.size = vec3(0, 0, 0); // SM flag not a voxagon
+	data.scale = 0; // SM flag not a voxel
+	data.color = color; // No texture
+	data.palette = 0;
+	return data;
+}
 
-	mat4 pos = translate(mat4(1.0f), position);
-	mat4 rot = mat4_cast(rotation);
-	shader.pushMatrix("position", pos);
-	shader.pushMatrix("rotation", rot);
+void Mesh::draw(Shader& shader, Camera& camera) {
+	Shader::pushObject(getObjectData());
 
 	for (unsigned int i = 0; i < textures.size(); i++) {
 		char name[16];
@@ -226,7 +200,19 @@ void Mesh::draw(Shader& shader, Camera& camera) {
 		shader.pushTexture2D(name, textures[i], i + 1); // Texture 0 is SM
 	}
 
+	if (lods.empty()) return;
+	const MeshLOD& lod = selectLOD(camera);
 	vao.bind();
-	glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+	glDrawElements(GL_TRIANGLES, lod.count, GL_UNSIGNED_INT, (GLvoid*)(lod.first * sizeof(GLuint)));
 	vao.unbind();
 }
+
+void Mesh::drawDepth(Shader& shader, Camera& camera) {
+	(void)shader;
+	if (lods.empty()) return;
+	const MeshLOD& lod = selectLOD(camera);
+	Shader::pushObject(getObjectData());
+	depth_vao.bind();
+	glDrawElements(GL_TRIANGLES, lod.count, GL_UNSIGNED_INT, (GLvoid*)(lod.first * sizeof(GLuint)));
+	depth_vao.unbind();
+}
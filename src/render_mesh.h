@@ -6,6 +6,7 @@
 #include "vao.h"
 #include "shader.h"
 #include "camera.h"
+#include "obj_loader.h"
 
 #include "../glad/glad.h"
 #include <GLFW/glfw3.h>
@@ -14,21 +15,30 @@
 using namespace std;
 using namespace glm;
 
-struct MeshVertex {
-	vec3 position;
-	vec3 normal;
-	vec2 tex_coord;
+struct MeshLOD {
+	GLuint first; // Offset in the shared index buffer
+	GLsizei count;
+	float error;  // Geometric error in mesh units
 };
 
 class Mesh {
 private:
+	static const int MAX_LODS = 4;
+	static const float LOD_PIXEL_ERROR;
 	VAO vao;
+	VAO depth_vao; // Deduplicated positions for the shadow pass, same index layout
 	vector<MeshVertex> vertices;
+	vector<GLuint> indices; // All LODs, finest first
+	vector<MeshLOD> lods;
 	vector<GLuint> textures;
 	vec3 color;
+	AABB local_bounds;
 	void loadOBJ(const char* path);
+	void optimize(const char* path);
+	void buildLODs(const char* path);
+	const MeshLOD& selectLOD(const Camera& camera) const;
 	void saveOBJ(const char* path);
-	void loadSimpleOBJ(const char* path); // No texture
+	void createBuffers();
 public:
 	vec3 position = vec3(0, 0, 0);
 	quat rotation = quat(1, 0, 0, 0);
@@ -38,7 +48,11 @@ public:
 	void handleInputs(GLFWwindow* window);
 	void setWorldTransform(vec3 position, float angle = 0);
 	void setWorldTransform(vec3 position, quat rotation);
+	AABB getBounds() const;
+	GLuint getTexture() const;
+	ObjectData getObjectData() const;
 	void draw(Shader& shader, Camera& camera);
+	void drawDepth(Shader& shader, Camera& camera);
 };
 
 #endif
@@ -0,0 +1,42 @@
+#include <string.h>
+#include <algorithm>
+
+#include "render_queue.h"
+
+static bool compareKeys(const RenderItem& a, const RenderItem& b) {
+	return a.key < b.key;
+}
+
+// Key layout: pass 4 bits | shader 8 bits | material 20 bits | depth 32 bits
+void RenderQueue::push(RenderPass pass, Shader& shader, uint32_t material, float depth, int object) {
+	uint32_t depth_bits;
+	memcpy(&depth_bits, &depth, sizeof(depth_bits)); // Positive floats sort like integers
+	if (pass == PASS_TRANSPARENT)
+		depth_bits = ~depth_bits;
+	uint64_t key = (uint64_t)(pass & 0xF) << 60;
+	key |= (uint64_t)(shader.getIndex() & 0xFF) << 52;
+	key |= (uint64_t)(material & 0xFFFFF) << 32;
+	key |= depth_bits;
+	items.push_back({ key, &shader, object });
+	sorted = false;
+}
+
+// Next item in key order up to the given pass, later passes stay queued
+// The items that were not returned yet are sorted again after a push, the queue is emptied once every item was returned
+const RenderItem* RenderQueue::pop(RenderPass pass) {
+	if (!sorted) {
+		std::sort(items.begin() + next, items.end(), compareKeys);
+		sorted = true;
+	}
+	if (next < items.size() && (RenderPass)(items[next].key >> 60) <= pass)
+		return &items[next++];
+	if (next == items.size())
+		clear();
+	return NULL;
+}
+
+void RenderQueue::clear() {
+	items.clear();
+	next = 0;
+	sorted = true;
+}
@@ -0,0 +1,35 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "shader.h"
+
+using namespace std;
+
+enum RenderPass : uint8_t {
+	PASS_OPAQUE,
+	PASS_TRANSPARENT,
+};
+
+struct RenderItem {
+	uint64_t key;
+	Shader* shader;
+	int object;
+};
+
+// Draw items of the whole frame sorted by pass, shader, material and depth
+// Opaque items go front to back for early depth rejection, transparent ones back to front
+class RenderQueue {
+private:
+	vector<RenderItem> items;
+	size_t next = 0; // First item not returned by pop
+	bool sorted = true;
+public:
+	void push(RenderPass pass, Shader& shader, uint32_t material, float depth, int object);
+	const RenderItem* pop(RenderPass pass);
+	void clear();
+};
+
+#endif
@@ -1,14 +1,12 @@
-#include "vbo.h"
+#include <stddef.h>
+
 #include "render_rope.h"
-#include <glm/gtc/matrix_transform.hpp>
 
 RopeRender::RopeRender(vector<vec3> points, vec3 color) {
+	this->points = points;
 	this->color = color;
-	points_count = points.size();
-	VBO vbo(points);
-	vao.linkAttrib(0, 3, GL_FLOAT, sizeof(vec3), (GLvoid*)0); // Vertex position
-	vao.unbind();
-	vbo.unbind();
+	for (unsigned int i = 0; i < points.size(); i++)
+		local_bounds.grow(points[i]);
 }
 
 void RopeRender::setWorldTransform(vec3 position, quat rotation) {
@@ -16,16 +14,76 @@ void RopeRender::setWorldTransform(vec3 position, quat rotation) {
 	this->rotation = rotation;
 }
 
-void RopeRender::draw(Shader& shader, Camera& camera) {
-	shader.pushMatrix("camera", camera.vp_matrix);
-	shader.pushVec3("color", color);
+AABB RopeRender::getBounds() const {
+	AABB bounds;
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = vec3(i & 1 ? local_bounds.max.x : local_bounds.min.x,
+						   i & 2 ? local_bounds.max.y : local_bounds.min.y,
+						   i & 4 ? local_bounds.max.z : local_bounds.min.z);
+		bounds.grow(position + rotation * corner);
+	}
+	return bounds;
+}
+
+void RopeRender::getWorldPoints(vector<vec3>& world_points) const {
+	for (vector<vec3>::const_iterator it = points.begin(); it != points.end(); it++)
+		world_points.push_back(position + rotation * *it);
+}
+
+vec3 RopeRender::getColor() const {
+	return color;
+}
 
-	mat4 pos = translate(mat4(1.0f), position);
-	mat4 rot = mat4_cast(rotation);
-	shader.pushMatrix("position", pos);
-	shader.pushMatrix("rotation", rot);
+// ----------------------------------------------------------------------------
+
+RopeBatch::RopeBatch() {
+	glGenBuffers(1, &vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	vao.linkAttrib(0, 3, GL_FLOAT, sizeof(RopeVertex), (GLvoid*)offsetof(RopeVertex, position)); // Vertex position
+	vao.linkAttrib(1, 3, GL_FLOAT, sizeof(RopeVertex), (GLvoid*)offsetof(RopeVertex, color));	// Color
+	vao.unbind();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Call after loading or moving ropes
+void RopeBatch::update(const vector<RopeRender*>& ropes) {
+	vector<RopeVertex> vertices;
+	vector<vec3> points;
+	first.clear();
+	count.clear();
+	for (vector<RopeRender*>::const_iterator it = ropes.begin(); it != ropes.end(); it++) {
+		points.clear();
+		(*it)->getWorldPoints(points);
+		first.push_back(vertices.size());
+		count.push_back(points.size());
+		for (vector<vec3>::iterator point = points.begin(); point != points.end(); point++)
+			vertices.push_back({ *point, (*it)->getColor() });
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(RopeVertex), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Visible holds rope indices, each one is a separate line strip of the same draw
+void RopeBatch::draw(Shader& shader, const vector<int>& visible) {
+	(void)shader;
+	draw_first.clear();
+	draw_count.clear();
+	for (vector<int>::const_iterator it = visible.begin(); it != visible.end(); it++) {
+		if (*it >= (int)first.size())
+			continue;
+		draw_first.push_back(first[*it]);
+		draw_count.push_back(count[*it]);
+	}
+	if (draw_first.empty())
+		return;
 
 	vao.bind();
-	glDrawArrays(GL_LINE_STRIP, 0, points_count);
+	glMultiDrawArrays(GL_LINE_STRIP, draw_first.data(), draw_count.data(), draw_first.size());
 	vao.unbind();
+	Shader::stats.draws++;
+}
+
+RopeBatch::~RopeBatch() {
+	glDeleteBuffers(1, &vertex_buffer);
 }
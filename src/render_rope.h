@@ -11,15 +11,38 @@
 
 class RopeRender {
 private:
-	VAO vao;
-	GLsizei points_count;
+	vector<vec3> points;
+	AABB local_bounds;
 	vec3 color = vec3(1, 1, 1);
 	vec3 position = vec3(0, 0, 0);
 	quat rotation = quat(1, 0, 0, 0);
 public:
 	RopeRender(vector<vec3> points, vec3 color);
 	void setWorldTransform(vec3 position, quat rotation);
-	void draw(Shader& shader, Camera& camera);
+	AABB getBounds() const;
+	void getWorldPoints(vector<vec3>& world_points) const;
+	vec3 getColor() const;
+};
+
+struct RopeVertex {
+	vec3 position;
+	vec3 color;
+};
+
+// Every rope of a scene in one world space vertex buffer, visible ones are drawn with a single multi-draw
+class RopeBatch {
+private:
+	VAO vao;
+	GLuint vertex_buffer = 0;
+	vector<GLint> first;
+	vector<GLsizei> count;
+	vector<GLint> draw_first;
+	vector<GLsizei> draw_count;
+public:
+	RopeBatch();
+	void update(const vector<RopeRender*>& ropes);
+	void draw(Shader& shader, const vector<int>& visible);
+	~RopeBatch();
 };
 
 #endif
@@ -4,6 +4,7 @@
 #include "ebo.h"
 #include "vbo.h"
 #include "utils.h"
+#include "mesh_optimizer.h"
 #include "render_vox_greedy.h"
 
 /*
@@ -31,6 +32,9 @@
   |_||_|___|_|_\___| |___/___| |___/|_|_\/_/ \_\___|\___/|_|\_|___/
 */
 
+// Faces smaller than this (in voxels) are not used for occlusion culling
+static const float MIN_OCCLUDER_AREA = 64;
+
 struct GM_Vertex {
 	vec3 position;
 	vec3 normal;
@@ -218,39 +222,74 @@ GreedyRender::GreedyRender(const MV_Shape& shape, int palette_id) {
 	mesh.SaveOBJ(shape.id + ".obj", palette_id);
 #endif
 
+	// Large opaque faces, p3 is the corner opposite to p0
+	const vector<GM_Vertex>& vertices = mesh.getVertices();
+	for (unsigned int i = 0; i + 3 < vertices.size(); i += 4) {
+		bool opaque = VoxRender::isOpaque(palette_id, vertices[i].index);
+		if (!opaque)
+			has_transparency = true;
+		const vec3& p0 = vertices[i].position;
+		const vec3& p1 = vertices[i + 1].position;
+		const vec3& p2 = vertices[i + 2].position;
+		const vec3& p3 = vertices[i + 3].position;
+		float area = length(cross(p1 - p0, p2 - p0));
+		if (area >= MIN_OCCLUDER_AREA && opaque) {
+			occluder_quads.push_back(p0);
+			occluder_quads.push_back(p1);
+			occluder_quads.push_back(p3);
+			occluder_quads.push_back(p2);
+		}
+	}
+
+	vao.bind();
 	VBO vbo(mesh.getVertices());
 	EBO ebo(mesh.getIndices());
 
 	vao.linkAttrib(0, 3, GL_FLOAT, sizeof(GM_Vertex), (GLvoid*)0);							   // Vertex position
 	vao.linkAttrib(1, 3, GL_FLOAT, sizeof(GM_Vertex), (GLvoid*)(3 * sizeof(GLfloat)));		   // Normal
 	vao.linkAttrib(2, 1, GL_UNSIGNED_BYTE, sizeof(GM_Vertex), (GLvoid*)(6 * sizeof(GLfloat))); // Texture coord
-
 	vao.unbind();
+
+	vector<vec3> positions, depth_positions;
+	vector<GLuint> depth_indices;
+	for (unsigned int i = 0; i < vertices.size(); i++)
+		positions.push_back(vertices[i].position);
+	ExtractPositions(positions, mesh.getIndices(), depth_positions, depth_indices);
+	depth_vao.bind();
+	VBO depth_vbo(depth_positions);
+	EBO depth_ebo(depth_indices);
+	depth_vao.linkAttrib(0, 3, GL_FLOAT, sizeof(vec3), (GLvoid*)0); // Vertex position
+	depth_vao.unbind();
+
 	vbo.unbind();
 	ebo.unbind();
 }
 
-void GreedyRender::draw(Shader& shader, Camera& camera) {
-	shader.pushMatrix("camera", camera.vp_matrix);
-
-	shader.pushFloat("scale", scale);
-	shader.pushInt("side", 0); // SM flag not an hexagon
-	shader.pushVec3("size", vec3(0, 0, 0)); // SM flag not a voxagon
-	shader.pushTexture2D("uColor", paletteBank, 1); // Texture 0 is SM
-	shader.pushInt("uPalette", palette_id);
+void GreedyRender::getOccluders(vector<vec3>& quads) const {
+	mat4 local_to_world = volume_matrix * glm::scale(mat4(1.0f), vec3(0.1f * scale));
+	for (vector<vec3>::const_iterator it = occluder_quads.begin(); it != occluder_quads.end(); it++)
+		quads.push_back(vec3(local_to_world * vec4(*it, 1.0f)));
+}
 
-	mat4 pos = translate(mat4(1.0f), position);
-	mat4 rot = mat4_cast(rotation);
-	shader.pushMatrix("position", pos);
-	shader.pushMatrix("rotation", rot);
+bool GreedyRender::hasTransparency() const {
+	return has_transparency;
+}
 
-	mat4 world_pos = translate(mat4(1.0f), world_position);
-	mat4 world_rot = mat4_cast(world_rotation);
-	shader.pushMatrix("world_pos", world_pos);
-	shader.pushMatrix("world_rot", world_rot);
+void GreedyRender::draw(Shader& shader, Camera& camera) {
+	(void)camera;
+	Shader::pushObject(getObjectData());
+	shader.pushTexture2D("uColor", paletteBank, 1); // Texture 0 is SM
 
 	vao.bind();
 	//glLineWidth(5.0f); // GL_LINES
 	glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
 	vao.unbind();
 }
+
+void GreedyRender::drawDepth(Shader& shader) {
+	(void)shader;
+	Shader::pushObject(getObjectData());
+	depth_vao.bind();
+	glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+	depth_vao.unbind();
+}
@@ -13,10 +13,16 @@
 
 class GreedyRender : public VoxRender {
 private:
+	VAO depth_vao; // Deduplicated positions for the shadow pass
 	GLsizei index_count = 0;
+	vector<vec3> occluder_quads; // Local coordinates, 4 vertices each
+	bool has_transparency = false;
 public:
 	GreedyRender(const MV_Shape& shape, int palette_id);
+	void getOccluders(vector<vec3>& quads) const;
+	bool hasTransparency() const;
 	void draw(Shader& shader, Camera& camera) override;
+	void drawDepth(Shader& shader);
 };
 
 #endif
@@ -1,8 +1,12 @@
-#include <unordered_set>
+#include <vector>
+#include <stdint.h>
+#include <algorithm>
 
 #include "ebo.h"
 #include "vbo.h"
 #include "utils.h"
+#include "worker_pool.h"
+#include "mesh_optimizer.h"
 #include "render_vox_hex.h"
 
 //   4 _ _ _ _ 3
@@ -92,89 +96,182 @@ static const GLuint hex_prism_indices[] = {
 	32, 34, 35,
 };
 
-static void TrimVoxels(const vector<MV_Voxel>& voxels, vector<MV_Voxel>& trimmed) {
-	unordered_set<tuple<uint8_t, uint8_t, uint8_t>, VoxelHash> positions;
-	for (vector<MV_Voxel>::const_iterator it = voxels.begin(); it != voxels.end(); it++) {
-		const MV_Voxel& voxel = *it;
-		if (voxel.index != HOLE_INDEX)
-			positions.insert({ voxel.x, voxel.y, voxel.z });
-	}
-
-	for (vector<MV_Voxel>::const_iterator it = voxels.begin(); it != voxels.end(); it++) {
-		bool is_exposed = false;
-		const MV_Voxel& voxel = *it;
-		if (voxel.index == HOLE_INDEX)
-			continue;
+// First index and index count of each face: top, bottom, then the sides 0-1, 1-2, 2-3, 3-4, 4-5 and 5-0
+static const int HEX_FACES = 8;
+static const GLuint hex_face_first[HEX_FACES] = { 0, 12, 24, 30, 36, 42, 48, 54 };
+static const GLsizei hex_face_count[HEX_FACES] = { 12, 12, 6, 6, 6, 6, 6, 6 };
+
+// Voxel sharing each face in the layouts of voxel_hex_vert.glsl, by HEX_SIDE, column parity and face.
+// Zero means the face is never hidden, the cube layout overlaps its sides
+static const int8_t hex_neighbors[4][2][HEX_FACES][3] = {
+	{ // Cube
+		{ { 0, 0, 1 }, { 0, 0, -1 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } },
+		{ { 0, 0, 1 }, { 0, 0, -1 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } },
+	},
+	{ // Top, parity of x
+		{ { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 1, -1, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { -1, 0, 0 }, { -1, -1, 0 } },
+		{ { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { -1, 1, 0 }, { -1, 0, 0 } },
+	},
+	{ // Front, parity of x
+		{ { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 1, 0, 0 }, { 1, 0, -1 }, { 0, 0, -1 }, { -1, 0, -1 }, { -1, 0, 0 } },
+		{ { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 1, 0, 1 }, { 1, 0, 0 }, { 0, 0, -1 }, { -1, 0, 0 }, { -1, 0, 1 } },
+	},
+	{ // Side, parity of z
+		{ { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0, -1, 1 }, { 0, -1, 0 }, { 0, -1, -1 }, { 0, 0, -1 } },
+		{ { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, 1, 1 }, { 0, 0, 1 }, { 0, -1, 0 }, { 0, 0, -1 }, { 0, 1, -1 } },
+	},
+};
 
-		int dx[] = { -1, 1, 0, 0, 0, 0 };
-		int dy[] = { 0, 0, -1, 1, 0, 0 };
-		int dz[] = { 0, 0, 0, 0, -1, 1 };
-
-		for (int i = 0; i < 6; i++) {
-			int nx = voxel.x + dx[i];
-			int ny = voxel.y + dy[i];
-			int nz = voxel.z + dz[i];
-			if (nx < 0 || ny < 0 || nz < 0 || nx > 255 || ny > 255 || nz > 255) {
-				is_exposed = true;
-				break;
-			}
-			const tuple<uint8_t, uint8_t, uint8_t> neighbor_pos = make_tuple(nx, ny, nz);
-			if (positions.find(neighbor_pos) == positions.end()) {
-				is_exposed = true;
-				break;
+// A voxel is hidden when its 6 neighbors are set, tested 64 voxels at a time with shifted rows.
+// The output keeps the order of the input
+void TrimVoxels(const vector<MV_Voxel>& voxels, vector<MV_Voxel>& trimmed) {
+	VoxelBitmask occupancy;
+	occupancy.build(voxels);
+	if (occupancy.size_x == 0) return;
+
+	const int words = occupancy.words;
+	const size_t slice = occupancy.slice;
+	const int size_y = occupancy.size_y;
+	const int size_z = occupancy.size_z;
+	const vector<uint64_t>& occupied = occupancy.bits;
+
+	// Each z-slab writes only its own rows of exposed
+	vector<uint64_t> exposed(occupied.size(), 0);
+	const vector<uint64_t> empty_row(words, 0);
+	auto trim_slab = [&](int z) {
+		for (int y = 0; y < size_y; y++) {
+			size_t offset = z * slice + y * words;
+			const uint64_t* row = &occupied[offset];
+			const uint64_t* y_minus = y > 0 ? row - words : empty_row.data();
+			const uint64_t* y_plus = y < size_y - 1 ? row + words : empty_row.data();
+			const uint64_t* z_minus = z > 0 ? row - slice : empty_row.data();
+			const uint64_t* z_plus = z < size_z - 1 ? row + slice : empty_row.data();
+			for (int w = 0; w < words; w++) {
+				uint64_t center = row[w];
+				if (center == 0) continue;
+				uint64_t x_minus = (center << 1) | (w > 0 ? row[w - 1] >> 63 : 0);
+				uint64_t x_plus = (center >> 1) | (w < words - 1 ? row[w + 1] << 63 : 0);
+				exposed[offset + w] = center & ~(x_minus & x_plus & y_minus[w] & y_plus[w] & z_minus[w] & z_plus[w]);
 			}
 		}
-		if (is_exposed)
-			trimmed.push_back(voxel);
+	};
+
+	const int MIN_PARALLEL_SLABS = 32; // Small shapes are not worth waking the pool
+	if (size_z >= MIN_PARALLEL_SLABS) {
+		ParallelFor(size_z, trim_slab);
+	} else {
+		for (int z = 0; z < size_z; z++)
+			trim_slab(z);
 	}
+
+	for (vector<MV_Voxel>::const_iterator it = voxels.begin(); it != voxels.end(); it++)
+		if (it->index != HOLE_INDEX && (exposed[occupancy.word(it->x, it->y, it->z)] >> (it->x % 64)) & 1)
+			trimmed.push_back(*it);
 }
 
+int HexRender::orientation = 0;
+
+// Face lists are built for the active orientation only, the exposed voxels and the occupancy stay on the CPU to rebuild them
 HexRender::HexRender(const MV_Shape& shape, int palette_id) {
-	vector<MV_Voxel> trimmed;
-	TrimVoxels(shape.voxels, trimmed);
+	TrimVoxels(shape.voxels, exposed);
+	occupancy.build(shape.voxels);
 
 	this->palette_id = palette_id;
-	this->voxel_count = trimmed.size();
 	shape_size = vec3(shape.sizex, shape.sizey, shape.sizez);
 
+	glGenBuffers(1, &instance_buffer);
+
+	vao.bind();
 	VBO vbo(hex_prism_vertices, sizeof(hex_prism_vertices));
 	EBO ebo(hex_prism_indices, sizeof(hex_prism_indices));
 
 	vao.linkAttrib(0, 3, GL_FLOAT, 6 * sizeof(GLfloat), (GLvoid*)0);					 // Vertex position
 	vao.linkAttrib(1, 3, GL_FLOAT, 6 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat))); // Normal
+	linkInstances(0);
+	vao.unbind();
 
-	VBO instaceVBO(trimmed);
-	vao.linkAttrib(2, 1, GL_UNSIGNED_BYTE, sizeof(MV_Voxel), (GLvoid*)(3 * sizeof(uint8_t))); // Palette index
-	vao.linkAttrib(3, 3, GL_UNSIGNED_BYTE, sizeof(MV_Voxel), (GLvoid*)0);					  // Voxel position
-	glVertexAttribDivisor(2, 1);
-	glVertexAttribDivisor(3, 1);
-	instaceVBO.unbind();
+	vector<vec3> positions, depth_positions;
+	vector<GLuint> indices(hex_prism_indices, hex_prism_indices + sizeof(hex_prism_indices) / sizeof(GLuint));
+	vector<GLuint> depth_indices;
+	for (unsigned int i = 0; i < sizeof(hex_prism_vertices) / sizeof(GLfloat); i += 6)
+		positions.push_back(vec3(hex_prism_vertices[i], hex_prism_vertices[i + 1], hex_prism_vertices[i + 2]));
+	ExtractPositions(positions, indices, depth_positions, depth_indices); // Keeps the triangle order, so the face ranges
+	depth_vao.bind();
+	VBO depth_vbo(depth_positions);
+	EBO depth_ebo(depth_indices);
+	depth_vao.linkAttrib(0, 3, GL_FLOAT, sizeof(vec3), (GLvoid*)0); // Vertex position
+	linkInstances(0);
+	depth_vao.unbind();
 
-	vao.unbind();
 	vbo.unbind();
 	ebo.unbind();
 }
 
-void HexRender::draw(Shader& shader, Camera& camera) {
-	shader.pushMatrix("camera", camera.vp_matrix);
+// Faces that are never hidden share the exposed voxel list at the start of the buffer
+void HexRender::buildFaces(int side) {
+	vector<MV_Voxel> instances(exposed);
+	for (int face = 0; face < HEX_FACES; face++) {
+		const int8_t* even = hex_neighbors[side][0][face];
+		if (even[0] == 0 && even[1] == 0 && even[2] == 0) {
+			face_first[face] = 0;
+			face_count[face] = exposed.size();
+			continue;
+		}
+		face_first[face] = instances.size();
+		for (vector<MV_Voxel>::iterator it = exposed.begin(); it != exposed.end(); it++) {
+			int parity = (side == 3 ? it->z : it->x) % 2;
+			const int8_t* offset = hex_neighbors[side][parity][face];
+			if (!occupancy.get(it->x + offset[0], it->y + offset[1], it->z + offset[2]))
+				instances.push_back(*it);
+		}
+		face_count[face] = instances.size() - face_first[face];
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(MV_Voxel), instances.data(), GL_STATIC_DRAW);
+	built_orientation = side;
+}
 
-	shader.pushFloat("scale", scale);
-	shader.pushInt("uPalette", palette_id);
-	shader.pushVec3("size", vec3(0, 0, 0)); // SM flag not a voxagon
-	shader.pushTexture2D("uColor", paletteBank, 1); // Texture 0 is SM
+// Palette index and voxel position of the bound VAO start at instance first, GL 4.1 has no base instance
+void HexRender::linkInstances(GLintptr first) {
+	GLintptr base = first * sizeof(MV_Voxel);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glVertexAttribPointer(2, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(MV_Voxel), (GLvoid*)(base + 3 * sizeof(uint8_t))); // Palette index
+	glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(MV_Voxel), (GLvoid*)base);						 // Voxel position
+	for (GLuint i = 2; i <= 3; i++) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
+}
+
+// One instanced draw per prism face, each over the voxels that show it
+void HexRender::drawFaces(VAO& target) {
+	int side = std::min(std::max(orientation, 0), ORIENTATIONS - 1);
+	if (side != built_orientation)
+		buildFaces(side);
+	target.bind();
+	for (int face = 0; face < HEX_FACES; face++) {
+		if (face_count[face] == 0) continue;
+		linkInstances(face_first[face]);
+		glDrawElementsInstanced(GL_TRIANGLES, hex_face_count[face], GL_UNSIGNED_INT,
+			(GLvoid*)(hex_face_first[face] * sizeof(GLuint)), face_count[face]);
+	}
+	target.unbind();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-	mat4 pos = translate(mat4(1.0f), position);
-	mat4 rot = mat4_cast(rotation);
-	shader.pushMatrix("position", pos);
-	shader.pushMatrix("rotation", rot);
+void HexRender::draw(Shader& shader, Camera& camera) {
+	(void)camera;
+	Shader::pushObject(getObjectData());
+	shader.pushTexture2D("uColor", paletteBank, 1); // Texture 0 is SM
+	drawFaces(vao);
+}
 
-	mat4 world_pos = translate(mat4(1.0f), world_position);
-	mat4 world_rot = mat4_cast(world_rotation);
-	shader.pushMatrix("world_pos", world_pos);
-	shader.pushMatrix("world_rot", world_rot);
+void HexRender::drawDepth(Shader& shader) {
+	(void)shader;
+	Shader::pushObject(getObjectData());
+	drawFaces(depth_vao);
+}
 
-	// Use GL_LINES for wireframe
-	vao.bind();
-	glDrawElementsInstanced(GL_TRIANGLES, sizeof(hex_prism_indices) / sizeof(GLuint), GL_UNSIGNED_INT, 0, voxel_count);
-	vao.unbind();
+HexRender::~HexRender() {
+	glDeleteBuffers(1, &instance_buffer);
 }
@@ -4,18 +4,68 @@
 #include "vao.h"
 #include "camera.h"
 #include "shader.h"
+#include "vox_loader.h"
 #include "render_interface.h"
 
 #include <glm/glm.hpp>
 
 using namespace glm;
 
+// One bit per voxel with rows along x, holes and voxels outside of the occupied bounds are empty
+struct VoxelBitmask {
+	int size_x = 0, size_y = 0, size_z = 0;
+	int words = 0;
+	size_t slice = 0;
+	vector<uint64_t> bits;
+
+	void build(const vector<MV_Voxel>& voxels) {
+		for (vector<MV_Voxel>::const_iterator it = voxels.begin(); it != voxels.end(); it++) {
+			if (it->index == HOLE_INDEX) continue;
+			size_x = std::max(size_x, it->x + 1);
+			size_y = std::max(size_y, it->y + 1);
+			size_z = std::max(size_z, it->z + 1);
+		}
+		words = (size_x + 63) / 64;
+		slice = (size_t)size_y * words;
+		bits.assign(slice * size_z, 0);
+		for (vector<MV_Voxel>::const_iterator it = voxels.begin(); it != voxels.end(); it++)
+			if (it->index != HOLE_INDEX)
+				bits[word(it->x, it->y, it->z)] |= 1ull << (it->x % 64);
+	}
+	size_t word(int x, int y, int z) const {
+		return z * slice + y * words + x / 64;
+	}
+	bool get(int x, int y, int z) const {
+		if (x < 0 || y < 0 || z < 0 || x >= size_x || y >= size_y || z >= size_z)
+			return false;
+		return (bits[word(x, y, z)] >> (x % 64)) & 1;
+	}
+};
+
+// Drops the voxels that are enclosed on all 6 sides, holes are removed
+void TrimVoxels(const vector<MV_Voxel>& voxels, vector<MV_Voxel>& trimmed);
+
+// Exposed voxels are instanced once per visible prism face, hidden faces are culled against the hex layout neighbors
 class HexRender : public VoxRender {
 private:
-	GLsizei voxel_count = 0;
+	static const int ORIENTATIONS = 4;
+	VAO depth_vao; // Prism positions and voxel offsets for the shadow pass
+	GLuint instance_buffer = 0;
+	vector<MV_Voxel> exposed;
+	VoxelBitmask occupancy;
+	int built_orientation = -1;
+	GLsizei face_first[8]; // Instances by prism face for built_orientation
+	GLsizei face_count[8];
+	void buildFaces(int side);
+	void linkInstances(GLintptr first);
+	void drawFaces(VAO& target);
 public:
+	static int orientation; // HEX_SIDE of the bound shader: 0 cube, 1 top, 2 front, 3 side
+
 	HexRender(const MV_Shape& shape, int palette_id);
 	void draw(Shader& shader, Camera& camera) override;
+	void drawDepth(Shader& shader);
+	~HexRender();
 };
 
 #endif
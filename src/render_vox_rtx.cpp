@@ -170,6 +170,7 @@ void RTX_Render::drawSimple(Shader& shader, Camera& camera) {
 }
 
 void RTX_Render::drawAdvanced(Shader& shader, Camera& camera) {
+	(void)camera;
 	shader.pushTexture3D("uVolTex", volume_texture, 0);
 	shader.pushTexture2D("uColor", paletteBank, 1);
 	shader.pushTexture2D("uMaterial", materialBank, 2);
@@ -180,24 +181,12 @@ void RTX_Render::drawAdvanced(Shader& shader, Camera& camera) {
 	shader.pushTexture2D("uWindowNormal", window_normal, 7);
 	shader.pushTexture2D("uBlueNoise", bluenoise, 8);
 
-	shader.pushInt("uPalette", palette_id);
-	shader.pushVec3("uObjSize", shape_size);
-	shader.pushVec4("uVoxelSize", vec4(matrix_size, 0.1f * scale));
-	shader.pushVec4("uTextureTile", texture);
-	shader.pushVec3("uTextureParams", vec3(0, 0, 0));
-	shader.pushFloat("uAlpha", 1.0f);
-	shader.pushFloat("uHighlight", 0.0f);
-
-	shader.pushFloat("uRndFrame", random_frame);
-	shader.pushFloat("uFar", camera.FAR_PLANE);
-	shader.pushFloat("uInvFar", 1.0f / camera.FAR_PLANE);
-	shader.pushVec3("uCameraPos", camera.position);
-	shader.pushVec2("uPixelSize", vec2(1.0f / camera.screen_width, 1.0f / camera.screen_height));
-
-	mat4 vol_matrix_inv = inverse(volume_matrix);
-	shader.pushMatrix("uVpMatrix", camera.vp_matrix);
-	shader.pushMatrix("uVolMatrix", volume_matrix);
-	shader.pushMatrix("uVpInvMatrix", vol_matrix_inv);
+	// Camera and frame uniforms come from the FrameData block, the volume matrix is rebuilt from ObjectData
+	ObjectData data = getObjectData();
+	data.size = shape_size;
+	data.texture_tile = texture;
+	data.volume_size = matrix_size;
+	Shader::pushObject(data);
 
 	vao.bind();
 	glDrawElements(GL_TRIANGLES, sizeof(cube_indices) / sizeof(GLuint), GL_UNSIGNED_INT, 0);
@@ -205,8 +194,7 @@ void RTX_Render::drawAdvanced(Shader& shader, Camera& camera) {
 }
 
 void RTX_Render::draw(Shader& shader, Camera& camera) {
-	if (camera.isInFrustum(obb_corners))
-		drawAdvanced(shader, camera);
+	drawAdvanced(shader, camera);
 }
 
 void RTX_Render::setTexture(vec4 texture) {
@@ -1,7 +1,13 @@
+#include <stddef.h>
+
 #include "ebo.h"
 #include "vbo.h"
+#include "mesh_optimizer.h"
 #include "render_voxbox.h"
 
+// Faces smaller than this (in square meters) are not used for occlusion culling
+static const float MIN_OCCLUDER_AREA = 0.64f;
+
 //   6--------7
 //  /|       /|
 // 2--------3 |
@@ -60,37 +66,158 @@ static const GLuint cube_indices[] = {
 VoxboxRender::VoxboxRender(vec3 size, vec3 color) {
 	this->size = size;
 	this->color = color;
-	VBO vbo(cube_vertices, sizeof(cube_vertices));
-	EBO ebo(cube_indices, sizeof(cube_indices));
-	vao.linkAttrib(0, 3, GL_FLOAT, 6 * sizeof(GLfloat), (GLvoid*)0);					 // Vertex position
-	vao.linkAttrib(1, 3, GL_FLOAT, 6 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat))); // Normal
-	vao.unbind();
-	vbo.unbind();
-	ebo.unbind();
+}
+
+void VoxboxRender::setBatch(VoxboxBatch* batch, int index) {
+	this->batch = batch;
+	batch_index = index;
 }
 
 void VoxboxRender::setColor(vec3 color) {
 	this->color = color;
+	if (batch != NULL)
+		batch->setInstance(batch_index, getInstance());
 }
 
 void VoxboxRender::setWorldTransform(vec3 position, quat rotation) {
 	this->position = position;
 	this->rotation = rotation;
+	if (batch != NULL)
+		batch->setInstance(batch_index, getInstance());
+}
+
+AABB VoxboxRender::getBounds() const {
+	AABB bounds;
+	vec3 size_meters = size / 10.0f;
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1) * size_meters;
+		bounds.grow(position + rotation * corner);
+	}
+	return bounds;
+}
+
+void VoxboxRender::getOccluders(vector<vec3>& quads) const {
+	vec3 size_meters = size / 10.0f;
+	for (int axis = 0; axis < 3; axis++) {
+		int u = (axis + 1) % 3;
+		int v = (axis + 2) % 3;
+		if (size_meters[u] * size_meters[v] < MIN_OCCLUDER_AREA)
+			continue;
+		for (int side = 0; side < 2; side++) {
+			vec3 corners[4];
+			for (int i = 0; i < 4; i++) {
+				corners[i][axis] = side * size_meters[axis];
+				corners[i][u] = (i == 1 || i == 2) ? size_meters[u] : 0;
+				corners[i][v] = (i == 2 || i == 3) ? size_meters[v] : 0;
+				quads.push_back(position + rotation * corners[i]);
+			}
+		}
+	}
 }
 
-void VoxboxRender::draw(Shader& shader, Camera& camera) {
-	shader.pushMatrix("camera", camera.vp_matrix);
+VoxboxInstance VoxboxRender::getInstance() const {
+	VoxboxInstance instance;
+	instance.position = position;
+	instance.rotation = vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+	instance.size = size;
+	instance.color = color;
+	return instance;
+}
 
-	shader.pushVec3("color", color);
-	shader.pushVec3("size", size);
-	shader.pushFloat("scale", 0); // SM flag not a voxel
+// ----------------------------------------------------------------------------
 
-	mat4 pos = translate(mat4(1.0f), position);
-	mat4 rot = mat4_cast(rotation);
-	shader.pushMatrix("position", pos);
-	shader.pushMatrix("rotation", rot);
+VoxboxBatch::VoxboxBatch() {
+	glGenBuffers(1, &instance_buffer);
 
 	vao.bind();
-	glDrawElements(GL_TRIANGLES, sizeof(cube_indices) / sizeof(GLuint), GL_UNSIGNED_INT, 0);
+	VBO vbo(cube_vertices, sizeof(cube_vertices));
+	EBO ebo(cube_indices, sizeof(cube_indices));
+	vao.linkAttrib(0, 3, GL_FLOAT, 6 * sizeof(GLfloat), (GLvoid*)0);					 // Vertex position
+	vao.linkAttrib(1, 3, GL_FLOAT, 6 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat))); // Normal
+	linkInstances();
 	vao.unbind();
+
+	vector<vec3> positions, depth_positions;
+	vector<GLuint> indices(cube_indices, cube_indices + sizeof(cube_indices) / sizeof(GLuint));
+	vector<GLuint> depth_indices;
+	for (unsigned int i = 0; i < sizeof(cube_vertices) / sizeof(GLfloat); i += 6)
+		positions.push_back(vec3(cube_vertices[i], cube_vertices[i + 1], cube_vertices[i + 2]));
+	ExtractPositions(positions, indices, depth_positions, depth_indices);
+	depth_vao.bind();
+	VBO depth_vbo(depth_positions);
+	EBO depth_ebo(depth_indices);
+	depth_vao.linkAttrib(0, 3, GL_FLOAT, sizeof(vec3), (GLvoid*)0); // Vertex position
+	linkInstances();
+	depth_vao.unbind();
+
+	vbo.unbind();
+	ebo.unbind();
+}
+
+// Attributes 2 to 5 of the bound VAO read the compacted instances
+void VoxboxBatch::linkInstances() {
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(VoxboxInstance), (GLvoid*)offsetof(VoxboxInstance, position));
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(VoxboxInstance), (GLvoid*)offsetof(VoxboxInstance, rotation));
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(VoxboxInstance), (GLvoid*)offsetof(VoxboxInstance, size));
+	glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(VoxboxInstance), (GLvoid*)offsetof(VoxboxInstance, color));
+	for (GLuint i = 2; i <= 5; i++) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
+}
+
+// Call after loading or moving voxboxes, later changes of a single voxbox go through setInstance
+void VoxboxBatch::update(const vector<VoxboxRender*>& voxboxes) {
+	instances.clear();
+	instances.reserve(voxboxes.size());
+	for (vector<VoxboxRender*>::const_iterator it = voxboxes.begin(); it != voxboxes.end(); it++) {
+		(*it)->setBatch(this, instances.size());
+		instances.push_back((*it)->getInstance());
+	}
+	dirty = true;
+}
+
+void VoxboxBatch::setInstance(int index, const VoxboxInstance& instance) {
+	instances[index] = instance;
+	dirty = true;
+}
+
+// The buffer is orphaned and refilled when the visible set or an instance changed since the last upload
+void VoxboxBatch::upload(const vector<int>& visible) {
+	if (!dirty && visible == uploaded)
+		return;
+	compacted.clear();
+	for (vector<int>::const_iterator it = visible.begin(); it != visible.end(); it++)
+		if (*it < (int)instances.size())
+			compacted.push_back(instances[*it]);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, compacted.size() * sizeof(VoxboxInstance), compacted.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	uploaded = visible;
+	dirty = false;
+}
+
+void VoxboxBatch::drawInstances(VAO& target, const vector<int>& visible) {
+	upload(visible);
+	if (compacted.empty())
+		return;
+	target.bind();
+	glDrawElementsInstanced(GL_TRIANGLES, sizeof(cube_indices) / sizeof(GLuint), GL_UNSIGNED_INT, 0, compacted.size());
+	Shader::stats.draws++;
+	target.unbind();
+}
+
+void VoxboxBatch::draw(Shader& shader, const vector<int>& visible) {
+	(void)shader;
+	drawInstances(vao, visible);
+}
+
+void VoxboxBatch::drawDepth(Shader& shader, const vector<int>& visible) {
+	(void)shader;
+	drawInstances(depth_vao, visible);
+}
+
+VoxboxBatch::~VoxboxBatch() {
+	glDeleteBuffers(1, &instance_buffer);
 }
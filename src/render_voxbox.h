@@ -10,18 +10,54 @@
 
 using namespace glm;
 
+// Rotation is stored x, y, z, w whatever the quat memory layout is
+struct VoxboxInstance {
+	vec3 position;
+	vec4 rotation;
+	vec3 size;
+	vec3 color;
+};
+
+class VoxboxBatch;
+
 class VoxboxRender {
 private:
-	VAO vao;
 	vec3 size = vec3(10, 10, 10);
 	vec3 color = vec3(1, 1, 1);
 	vec3 position = vec3(0, 0, 0);
 	quat rotation = quat(1, 0, 0, 0);
+	VoxboxBatch* batch = NULL; // Refreshed on changes once the voxbox is batched
+	int batch_index = -1;
 public:
 	VoxboxRender(vec3 size, vec3 color);
+	void setBatch(VoxboxBatch* batch, int index);
 	void setColor(vec3 color);
 	void setWorldTransform(vec3 position, quat rotation);
-	void draw(Shader& shader, Camera& camera);
+	AABB getBounds() const;
+	void getOccluders(vector<vec3>& quads) const;
+	VoxboxInstance getInstance() const;
+};
+
+// Every voxbox of a scene, the visible ones are compacted into a streamed instance buffer and drawn at once
+class VoxboxBatch {
+private:
+	VAO vao;
+	VAO depth_vao; // The 8 corners for the shadow pass
+	GLuint instance_buffer = 0;
+	vector<VoxboxInstance> instances;
+	vector<VoxboxInstance> compacted; // Contents of instance_buffer
+	vector<int> uploaded; // Visible indices of the last upload
+	bool dirty = true;
+	void linkInstances();
+	void upload(const vector<int>& visible);
+	void drawInstances(VAO& target, const vector<int>& visible);
+public:
+	VoxboxBatch();
+	void update(const vector<VoxboxRender*>& voxboxes);
+	void setInstance(int index, const VoxboxInstance& instance);
+	void draw(Shader& shader, const vector<int>& visible);
+	void drawDepth(Shader& shader, const vector<int>& visible);
+	~VoxboxBatch();
 };
 
 #endif
@@ -15,6 +15,8 @@ WaterRender::WaterRender(vector<vec2> vertices) {
 	vector<vec3> vertices_bis;
 	for (unsigned int i = 0; i < vertices.size(); i++)
 		vertices_bis.push_back(vec3(vertices[i].x, 0, vertices[i].y));
+	for (unsigned int i = 0; i < vertices_bis.size(); i++)
+		local_bounds.grow(vertices_bis[i]);
 	vertex_count = vertices_bis.size();
 	VBO vbo(vertices_bis);
 	vao.linkAttrib(0, 3, GL_FLOAT, sizeof(vec3), (GLvoid*)0); // Vertex position
@@ -26,6 +28,13 @@ void WaterRender::setWorldTransform(vec3 position) {
 	this->position = position;
 }
 
+AABB WaterRender::getBounds() const {
+	AABB bounds = local_bounds;
+	bounds.min += position;
+	bounds.max += position;
+	return bounds;
+}
+
 void WaterRender::draw(Shader& shader, Camera& camera) {
 	/*shader.pushMatrix("camera", camera.vp_matrix);
 	mat4 pos = translate(mat4(1.0f), position);
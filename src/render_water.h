@@ -13,10 +13,12 @@ class WaterRender {
 private:
 	VAO vao;
 	GLsizei vertex_count;
+	AABB local_bounds;
 	vec3 position = vec3(0, 0, 0);
 public:
 	WaterRender(vector<vec2> vertices);
 	void setWorldTransform(vec3 position);
+	AABB getBounds() const;
 	void draw(Shader& shader, Camera& camera);
 };
 
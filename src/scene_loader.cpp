@@ -123,15 +123,18 @@ void Scene::recursiveLoad(XMLElement* element, vec3 parent_pos, quat parent_rot)
 			switch (vox.method) {
 			case RTX:
 				renderer = new RTX_Render(shape, palette_id);
+				addObject(OBJECT_RTX, vox_rtx.size());
 				vox_rtx.push_back((RTX_Render*)renderer);
 				((RTX_Render*)renderer)->setTexture(vox.texture);
 				break;
 			case GREEDY:
 				renderer = new GreedyRender(shape, palette_id);
+				addObject(OBJECT_GREEDY, vox_greedy.size());
 				vox_greedy.push_back((GreedyRender*)renderer);
 				break;
 			case HEXAGON:
 				renderer = new HexRender(shape, palette_id);
+				addObject(OBJECT_HEXAGON, vox_hexagon.size());
 				vox_hexagon.push_back((HexRender*)renderer);
 				break;
 			}
@@ -159,6 +162,7 @@ void Scene::recursiveLoad(XMLElement* element, vec3 parent_pos, quat parent_rot)
 		}
 		VoxboxRender* voxbox = new VoxboxRender(size, color);
 		voxbox->setWorldTransform(position, rotation);
+		addObject(OBJECT_VOXBOX, voxboxes.size());
 		voxboxes.push_back(voxbox);
 	} else if (strcmp(element->Name(), "water") == 0) {
 		vector<vec2> water_verts;
@@ -176,6 +180,7 @@ void Scene::recursiveLoad(XMLElement* element, vec3 parent_pos, quat parent_rot)
 			std::reverse(water_verts.begin(), water_verts.end()); // TD order is CW
 			WaterRender* water = new WaterRender(water_verts);
 			water->setWorldTransform(position);
+			addObject(OBJECT_WATER, waters.size());
 			waters.push_back(water);
 		}
 	} else if (strcmp(element->Name(), "rope") == 0 || strcmp(element->Name(), "voxagon") == 0) {
@@ -202,6 +207,7 @@ void Scene::recursiveLoad(XMLElement* element, vec3 parent_pos, quat parent_rot)
 		if (rope_verts.size() > 1) {
 			RopeRender* rope = new RopeRender(rope_verts, color);
 			rope->setWorldTransform(position, rotation);
+			addObject(OBJECT_ROPE, ropes.size());
 			ropes.push_back(rope);
 		}
 	} else if (strcmp(element->Name(), "spawnpoint") == 0) {
@@ -233,6 +239,7 @@ void Scene::recursiveLoad(XMLElement* element, vec3 parent_pos, quat parent_rot)
 		string path = parent_folder + file;
 		Mesh* mesh = new Mesh(path.c_str(), color);
 		mesh->setWorldTransform(position, rotation);
+		addObject(OBJECT_MESH, meshes.size());
 		meshes.push_back(mesh);
 	} else if (strcmp(element->Name(), "instance") == 0) {
 		const char* file = element->Attribute("file");
@@ -274,42 +281,265 @@ Scene::Scene(string path) {
 	shadow_volume = new ShadowVolume(20, 5, 20);
 	recursiveLoad(root, position, rotation);
 	shadow_volume->updateTexture();
+
+	computeBounds();
+	bvh.build(bounds);
+	computeOccluders();
+	updateBatches();
+
+	// Everything is visible until the first call to cull
+	for (unsigned int i = 0; i < objects.size(); i++)
+		visible_objects.push_back(i);
+	for (unsigned int i = 0; i < voxboxes.size(); i++)
+		visible_voxboxes.push_back(i);
+	for (unsigned int i = 0; i < ropes.size(); i++)
+		visible_ropes.push_back(i);
+	visible_waters = waters;
+}
+
+void Scene::addObject(ObjectType type, int index) {
+	objects.push_back({ type, index });
+}
+
+AABB Scene::getBounds(const SceneObject& object) {
+	switch (object.type) {
+	case OBJECT_RTX:
+		return vox_rtx[object.index]->getBounds();
+	case OBJECT_GREEDY:
+		return vox_greedy[object.index]->getBounds();
+	case OBJECT_HEXAGON:
+		return vox_hexagon[object.index]->getBounds();
+	case OBJECT_VOXBOX:
+		return voxboxes[object.index]->getBounds();
+	case OBJECT_MESH:
+		return meshes[object.index]->getBounds();
+	case OBJECT_ROPE:
+		return ropes[object.index]->getBounds();
+	case OBJECT_WATER:
+		return waters[object.index]->getBounds();
+	}
+	return AABB();
+}
+
+void Scene::computeBounds() {
+	bounds.resize(objects.size());
+	for (unsigned int i = 0; i < objects.size(); i++)
+		bounds[i] = getBounds(objects[i]);
+}
+
+// Only greedy volumes and voxboxes have large opaque faces to use as occluders
+void Scene::computeOccluders() {
+	occluder_quads.resize(objects.size());
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		occluder_quads[i].clear();
+		if (objects[i].type == OBJECT_GREEDY)
+			vox_greedy[objects[i].index]->getOccluders(occluder_quads[i]);
+		else if (objects[i].type == OBJECT_VOXBOX)
+			voxboxes[objects[i].index]->getOccluders(occluder_quads[i]);
+	}
+}
+
+// Instance and vertex buffers only change with the scene contents
+void Scene::updateBatches() {
+	voxbox_batch.update(voxboxes);
+	rope_batch.update(ropes);
+}
+
+// Call after moving objects, the tree topology is kept
+void Scene::updateBounds() {
+	computeBounds();
+	bvh.refit(bounds);
+	computeOccluders();
+	updateBatches();
+}
+
+// Rasterizes the occluders that were visible last frame, runs in the background until the next cull
+void Scene::startOcclusion(const mat4& vp_matrix) {
+	occluder_vertices.clear();
+	for (vector<int>::iterator it = occluders.begin(); it != occluders.end(); it++)
+		occluder_vertices.insert(occluder_vertices.end(), occluder_quads[*it].begin(), occluder_quads[*it].end());
+	occlusion.begin(vp_matrix, occluder_vertices);
+}
+
+const OcclusionStats& Scene::getOcclusionStats() const {
+	return occlusion.stats;
+}
+
+// Fills the visible lists used by the draw methods
+void Scene::cull(const Frustum& frustum, bool occlusion_test) {
+	bvh.query(frustum, visible_objects);
+	if (occlusion_test) {
+		if (occlusion.end()) {
+			unsigned int count = 0;
+			for (unsigned int i = 0; i < visible_objects.size(); i++) {
+				const AABB& box = bounds[visible_objects[i]];
+				vec3 corners[8];
+				for (int j = 0; j < 8; j++)
+					corners[j] = vec3(j & 1 ? box.max.x : box.min.x, j & 2 ? box.max.y : box.min.y, j & 4 ? box.max.z : box.min.z);
+				if (occlusion.isVisible(corners, 8))
+					visible_objects[count++] = visible_objects[i];
+			}
+			visible_objects.resize(count);
+		}
+		occluders.clear();
+		for (vector<int>::iterator it = visible_objects.begin(); it != visible_objects.end(); it++)
+			if (!occluder_quads[*it].empty())
+				occluders.push_back(*it);
+	}
+	// Voxboxes, ropes and water are not queued, they use a single shader state each
+	visible_voxboxes.clear();
+	visible_ropes.clear();
+	visible_waters.clear();
+	for (vector<int>::iterator it = visible_objects.begin(); it != visible_objects.end(); it++) {
+		const SceneObject& object = objects[*it];
+		if (object.type == OBJECT_VOXBOX)
+			visible_voxboxes.push_back(object.index);
+		else if (object.type == OBJECT_ROPE)
+			visible_ropes.push_back(object.index);
+		else if (object.type == OBJECT_WATER)
+			visible_waters.push_back(waters[object.index]);
+	}
+}
+
+// Sorted by palette or texture, then by distance to the camera
+void Scene::queueObjects(ObjectType type, RenderPass pass, Shader& shader, Camera& camera) {
+	for (vector<int>::iterator it = visible_objects.begin(); it != visible_objects.end(); it++) {
+		const SceneObject& object = objects[*it];
+		if (object.type != type)
+			continue;
+		uint32_t material = 0;
+		switch (object.type) {
+		case OBJECT_RTX:
+			material = vox_rtx[object.index]->getPaletteId();
+			break;
+		case OBJECT_GREEDY:
+			if (pass == PASS_TRANSPARENT && !vox_greedy[object.index]->hasTransparency())
+				continue;
+			material = vox_greedy[object.index]->getPaletteId();
+			break;
+		case OBJECT_HEXAGON:
+			material = vox_hexagon[object.index]->getPaletteId();
+			break;
+		case OBJECT_MESH:
+			material = meshes[object.index]->getTexture();
+			break;
+		default:
+			break;
+		}
+		vec3 offset = bounds[*it].center() - camera.position;
+		queue.push(pass, shader, material, dot(offset, offset), *it);
+	}
+}
+
+void Scene::drawObject(const SceneObject& object, Shader& shader, Camera& camera) {
+	switch (object.type) {
+	case OBJECT_RTX:
+		vox_rtx[object.index]->draw(shader, camera);
+		break;
+	case OBJECT_GREEDY:
+		vox_greedy[object.index]->draw(shader, camera);
+		break;
+	case OBJECT_HEXAGON:
+		vox_hexagon[object.index]->draw(shader, camera);
+		break;
+	case OBJECT_MESH:
+		meshes[object.index]->draw(shader, camera);
+		break;
+	case OBJECT_WATER:
+		waters[object.index]->draw(shader, camera);
+		break;
+	default: // Voxboxes and ropes are drawn in batches
+		break;
+	}
+}
+
+// Draws the queued items up to the given pass, the programs keep the uniforms pushed before they were submitted
+// Redundant uniforms and texture binds are skipped by the shader while batching
+void Scene::drawQueue(Camera& camera, RenderPass pass) {
+	Shader::beginBatch();
+	for (const RenderItem* item = queue.pop(pass); item != NULL; item = queue.pop(pass)) {
+		item->shader->use();
+		drawObject(objects[item->object], *item->shader, camera);
+		Shader::stats.draws++;
+	}
+	Shader::endBatch();
 }
 
-void Scene::draw(Shader& shader, Camera& camera, RenderMethod method) {
+// Position-only streams, no material state is bound
+void Scene::drawObjectDepth(const SceneObject& object, Shader& shader, Camera& camera) {
+	switch (object.type) {
+	case OBJECT_GREEDY:
+		vox_greedy[object.index]->drawDepth(shader);
+		break;
+	case OBJECT_HEXAGON:
+		vox_hexagon[object.index]->drawDepth(shader);
+		break;
+	case OBJECT_MESH:
+		meshes[object.index]->drawDepth(shader, camera);
+		break;
+	default:
+		break;
+	}
+}
+
+// Casters culled against the light frustum by the last call to cull, front to back from the camera
+void Scene::submitShadow(Shader& shader, Camera& camera, ObjectType type) {
+	for (vector<int>::iterator it = visible_objects.begin(); it != visible_objects.end(); it++) {
+		if (objects[*it].type != type)
+			continue;
+		vec3 offset = bounds[*it].center() - camera.position;
+		queue.push(PASS_OPAQUE, shader, 0, dot(offset, offset), *it);
+	}
+}
+
+// Every caster submitted for the cascade, sorted by shader once
+void Scene::drawShadowQueue(Camera& camera) {
+	for (const RenderItem* item = queue.pop(PASS_OPAQUE); item != NULL; item = queue.pop(PASS_OPAQUE)) {
+		item->shader->use();
+		drawObjectDepth(objects[item->object], *item->shader, camera);
+		Shader::stats.draws++;
+	}
+}
+
+void Scene::drawVoxboxDepth(Shader& shader) {
+	voxbox_batch.drawDepth(shader, visible_voxboxes);
+}
+
+// Objects are only queued, drawQueue draws them sorted together with the other submitted renderers
+void Scene::submit(Shader& shader, Camera& camera, RenderMethod method) {
 	switch (method) {
 	case RTX:
-		for (vector<RTX_Render*>::iterator it = vox_rtx.begin(); it != vox_rtx.end(); it++)
-			(*it)->draw(shader, camera);
+		queueObjects(OBJECT_RTX, PASS_OPAQUE, shader, camera);
 		break;
 	case GREEDY:
-		for (vector<GreedyRender*>::iterator it = vox_greedy.begin(); it != vox_greedy.end(); it++)
-			(*it)->draw(shader, camera);
+		queueObjects(OBJECT_GREEDY, PASS_OPAQUE, shader, camera);
 		break;
 	case HEXAGON:
-		for (vector<HexRender*>::iterator it = vox_hexagon.begin(); it != vox_hexagon.end(); it++)
-			(*it)->draw(shader, camera);
+		queueObjects(OBJECT_HEXAGON, PASS_OPAQUE, shader, camera);
 		break;
 	}
 }
 
+void Scene::submitGlass(Shader& shader, Camera& camera) {
+	queueObjects(OBJECT_GREEDY, PASS_TRANSPARENT, shader, camera);
+}
+
 void Scene::drawVoxbox(Shader& shader, Camera& camera) {
-	for (vector<VoxboxRender*>::iterator it = voxboxes.begin(); it != voxboxes.end(); it++)
-		(*it)->draw(shader, camera);
+	(void)camera;
+	voxbox_batch.draw(shader, visible_voxboxes);
 }
 
-void Scene::drawMesh(Shader& shader, Camera& camera) {
-	for (vector<Mesh*>::iterator it = meshes.begin(); it != meshes.end(); it++)
-		(*it)->draw(shader, camera);
+void Scene::submitMesh(Shader& shader, Camera& camera) {
+	queueObjects(OBJECT_MESH, PASS_OPAQUE, shader, camera);
 }
 
 void Scene::drawRope(Shader& shader, Camera& camera) {
-	for (vector<RopeRender*>::iterator it = ropes.begin(); it != ropes.end(); it++)
-		(*it)->draw(shader, camera);
+	(void)camera;
+	rope_batch.draw(shader, visible_ropes);
 }
 
 void Scene::drawWater(Shader& shader, Camera& camera) {
-	for (vector<WaterRender*>::iterator it = waters.begin(); it != waters.end(); it++)
+	for (vector<WaterRender*>::iterator it = visible_waters.begin(); it != visible_waters.end(); it++)
 		(*it)->draw(shader, camera);
 }
 
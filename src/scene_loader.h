@@ -5,6 +5,9 @@
 #include <string>
 #include <vector>
 
+#include "bvh.h"
+#include "occlusion.h"
+#include "render_queue.h"
 #include "vox_loader.h"
 #include "render_rope.h"
 #include "render_mesh.h"
@@ -38,6 +41,21 @@ struct Transform {
 	quat rot;
 };
 
+enum ObjectType : uint8_t {
+	OBJECT_RTX,
+	OBJECT_GREEDY,
+	OBJECT_HEXAGON,
+	OBJECT_VOXBOX,
+	OBJECT_MESH,
+	OBJECT_ROPE,
+	OBJECT_WATER,
+};
+
+struct SceneObject {
+	ObjectType type;
+	int index; // Position in the renderer vector of its type
+};
+
 class Scene {
 private:
 	string parent_folder;
@@ -52,18 +70,52 @@ private:
 	vector<HexRender*> vox_hexagon;
 	vector<GreedyRender*> vox_greedy;
 	map<string, VoxLoader*> vox_files;
+
+	BVH bvh;
+	vector<SceneObject> objects;
+	vector<AABB> bounds; // World bounds of each object
+	vector<int> visible_objects;
+	vector<int> visible_voxboxes; // Indices into voxboxes
+	vector<int> visible_ropes;
+	VoxboxBatch voxbox_batch;
+	RopeBatch rope_batch;
+	vector<WaterRender*> visible_waters;
+	RenderQueue queue; // Every queued draw of the frame, or of one shadow cascade
+
+	OcclusionBuffer occlusion;
+	vector<vector<vec3> > occluder_quads; // Per object, empty if it can't occlude
+	vector<int> occluders; // Objects that were visible last frame and have occluder quads
+	vector<vec3> occluder_vertices;
+
 	void recursiveLoad(XMLElement* element, vec3 parent_pos, quat parent_rot);
+	void addObject(ObjectType type, int index);
+	AABB getBounds(const SceneObject& object);
+	void computeBounds();
+	void computeOccluders();
+	void updateBatches();
+	void queueObjects(ObjectType type, RenderPass pass, Shader& shader, Camera& camera);
+	void drawObject(const SceneObject& object, Shader& shader, Camera& camera);
+	void drawObjectDepth(const SceneObject& object, Shader& shader, Camera& camera);
 public:
 	Transform spawnpoint;
 	Scene(string path);
 	~Scene();
-	void draw(Shader& shader, Camera& camera, RenderMethod method);
+	void startOcclusion(const mat4& vp_matrix);
+	void cull(const Frustum& frustum, bool occlusion_test = false);
+	void updateBounds();
+	const OcclusionStats& getOcclusionStats() const;
+	void submit(Shader& shader, Camera& camera, RenderMethod method);
+	void submitGlass(Shader& shader, Camera& camera);
+	void submitMesh(Shader& shader, Camera& camera);
+	void drawQueue(Camera& camera, RenderPass pass);
 	void drawVoxbox(Shader& shader, Camera& camera);
-	void drawMesh(Shader& shader, Camera& camera);
 	void drawRope(Shader& shader, Camera& camera);
 	void drawWater(Shader& shader, Camera& camera);
 	void drawBoundary(Shader& shader, Camera& camera);
 	void drawShadowVolume(Shader& shader, Camera& camera);
+	void submitShadow(Shader& shader, Camera& camera, ObjectType type);
+	void drawShadowQueue(Camera& camera);
+	void drawVoxboxDepth(Shader& shader);
 };
 
 #endif
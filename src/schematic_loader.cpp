@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "schematic_loader.h"
+#include "../lib/stb_image.h"
+
+enum NBT_Tag {
+	TAG_END,
+	TAG_BYTE,
+	TAG_SHORT,
+	TAG_INT,
+	TAG_LONG,
+	TAG_FLOAT,
+	TAG_DOUBLE,
+	TAG_BYTE_ARRAY,
+	TAG_STRING,
+	TAG_LIST,
+	TAG_COMPOUND,
+	TAG_INT_ARRAY,
+	TAG_LONG_ARRAY
+};
+
+// Big endian cursor over the decompressed NBT, any out of bounds read sets failed
+struct NBTReader {
+	const uint8_t* data;
+	size_t size;
+	size_t pos = 0;
+	bool failed = false;
+
+	NBTReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+	bool has(size_t n) {
+		if (failed || n > size - pos)
+			failed = true;
+		return !failed;
+	}
+	void skip(size_t n) {
+		if (has(n)) pos += n;
+	}
+	uint8_t readByte() {
+		if (!has(1)) return 0;
+		return data[pos++];
+	}
+	int16_t readShort() {
+		if (!has(2)) return 0;
+		uint16_t value = (data[pos] << 8) | data[pos + 1];
+		pos += 2;
+		return (int16_t)value;
+	}
+	int32_t readInt() {
+		if (!has(4)) return 0;
+		uint32_t value = ((uint32_t)data[pos] << 24) | (data[pos + 1] << 16) | (data[pos + 2] << 8) | data[pos + 3];
+		pos += 4;
+		return (int32_t)value;
+	}
+	string readString() {
+		uint16_t length = readShort();
+		if (!has(length)) return "";
+		string value((const char*)data + pos, length);
+		pos += length;
+		return value;
+	}
+	size_t readArraySize(size_t element_size) {
+		int32_t length = readInt();
+		if (length < 0) {
+			failed = true;
+			return 0;
+		}
+		return (size_t)length * element_size;
+	}
+	void skipPayload(uint8_t type) {
+		switch (type) {
+		case TAG_BYTE:
+			skip(1);
+			break;
+		case TAG_SHORT:
+			skip(2);
+			break;
+		case TAG_INT:
+		case TAG_FLOAT:
+			skip(4);
+			break;
+		case TAG_LONG:
+		case TAG_DOUBLE:
+			skip(8);
+			break;
+		case TAG_BYTE_ARRAY:
+			skip(readArraySize(1));
+			break;
+		case TAG_STRING:
+			skip((uint16_t)readShort());
+			break;
+		case TAG_LIST: {
+				uint8_t element_type = readByte();
+				int32_t length = readInt();
+				for (int32_t i = 0; i < length && !failed; i++)
+					skipPayload(element_type);
+			}
+			break;
+		case TAG_COMPOUND:
+			while (!failed) {
+				uint8_t child_type = readByte();
+				if (child_type == TAG_END) break;
+				skip((uint16_t)readShort());
+				skipPayload(child_type);
+			}
+			break;
+		case TAG_INT_ARRAY:
+			skip(readArraySize(4));
+			break;
+		case TAG_LONG_ARRAY:
+			skip(readArraySize(8));
+			break;
+		default:
+			failed = true;
+			break;
+		}
+	}
+};
+
+// Fields of interest, the block data is only located here and decoded once the dimensions are known
+struct SchematicFields {
+	int version = 0;
+	int width = -1, height = -1, length = -1;
+	map<string, int> palette;
+	size_t data_offset = 0;
+	size_t data_size = 0;
+	bool has_data = false;
+};
+
+static void ReadPalette(NBTReader& nbt, map<string, int>& palette) {
+	while (!nbt.failed) {
+		uint8_t type = nbt.readByte();
+		if (type == TAG_END) break;
+		string name = nbt.readString();
+		if (type == TAG_INT)
+			palette[name] = nbt.readInt();
+		else
+			nbt.skipPayload(type);
+	}
+}
+
+// Version 2 keeps everything in the root compound, version 3 nests it in "Schematic" and "Blocks"
+static void ReadCompound(NBTReader& nbt, SchematicFields& fields, bool in_blocks) {
+	while (!nbt.failed) {
+		uint8_t type = nbt.readByte();
+		if (type == TAG_END) break;
+		string name = nbt.readString();
+		if (type == TAG_SHORT && name == "Width")
+			fields.width = (uint16_t)nbt.readShort();
+		else if (type == TAG_SHORT && name == "Height")
+			fields.height = (uint16_t)nbt.readShort();
+		else if (type == TAG_SHORT && name == "Length")
+			fields.length = (uint16_t)nbt.readShort();
+		else if (type == TAG_INT && name == "Version")
+			fields.version = nbt.readInt();
+		else if (type == TAG_COMPOUND && (name == "Schematic" || name == "Blocks"))
+			ReadCompound(nbt, fields, name == "Blocks");
+		else if (type == TAG_COMPOUND && name == "Palette")
+			ReadPalette(nbt, fields.palette);
+		else if (type == TAG_BYTE_ARRAY && (name == "BlockData" || (in_blocks && name == "Data"))) {
+			fields.data_size = nbt.readArraySize(1);
+			fields.data_offset = nbt.pos;
+			fields.has_data = true;
+			nbt.skip(fields.data_size);
+		} else
+			nbt.skipPayload(type);
+	}
+}
+
+static BlockState ParseBlockState(const string& entry) {
+	const string MC_PREFIX = "minecraft:";
+	BlockState state;
+	size_t bracket = entry.find('[');
+	state.name = entry.substr(0, bracket);
+	if (state.name.find(MC_PREFIX) == 0)
+		state.name = state.name.substr(MC_PREFIX.size());
+	if (bracket == string::npos)
+		return state;
+
+	size_t start = bracket + 1;
+	while (start < entry.size()) {
+		size_t end = entry.find_first_of(",]", start);
+		if (end == string::npos) end = entry.size();
+		string property = entry.substr(start, end - start);
+		size_t equals = property.find('=');
+		if (equals != string::npos)
+			state.properties[property.substr(0, equals)] = property.substr(equals + 1);
+		start = end + 1;
+	}
+	return state;
+}
+
+// Skips the gzip member header and inflates the raw deflate stream, the trailer size is used to allocate the output once
+static bool Inflate(const vector<uint8_t>& file, vector<uint8_t>& output) {
+	const size_t HEADER_SIZE = 10, TRAILER_SIZE = 8;
+	const uint8_t FHCRC = 2, FEXTRA = 4, FNAME = 8, FCOMMENT = 16;
+	if (file.size() < HEADER_SIZE + TRAILER_SIZE || file[0] != 0x1F || file[1] != 0x8B || file[2] != 8)
+		return false;
+
+	uint8_t flags = file[3];
+	size_t pos = HEADER_SIZE;
+	size_t end = file.size() - TRAILER_SIZE;
+	if ((flags & FEXTRA) && pos + 2 <= end)
+		pos += 2 + (file[pos] | (file[pos + 1] << 8));
+	if (flags & FNAME)
+		while (pos < end && file[pos++] != 0);
+	if (flags & FCOMMENT)
+		while (pos < end && file[pos++] != 0);
+	if (flags & FHCRC)
+		pos += 2;
+	if (pos >= end)
+		return false;
+
+	const char* deflate = (const char*)file.data() + pos;
+	int deflate_size = end - pos;
+	const uint8_t* trailer = &file[end + 4];
+	uint32_t inflated_size = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+
+	output.resize(inflated_size);
+	if (inflated_size > 0 && stbi_zlib_decode_noheader_buffer((char*)output.data(), inflated_size, deflate, deflate_size) == (int)inflated_size)
+		return true;
+
+	// The trailer size is modulo 2^32, let stb grow the buffer instead
+	int length = 0;
+	char* data = stbi_zlib_decode_noheader_malloc(deflate, deflate_size, &length);
+	if (data == NULL)
+		return false;
+	output.assign((uint8_t*)data, (uint8_t*)data + length);
+	free(data);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+void BlockGrid::resize(int size_x, int size_y, int size_z, uint16_t empty) {
+	this->size_x = size_x;
+	this->size_y = size_y;
+	this->size_z = size_z;
+	this->empty = empty;
+	chunks_x = (size_x + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunks_y = (size_y + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunks_z = (size_z + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunks.clear();
+	chunks.resize(chunks_x * chunks_y * chunks_z);
+}
+
+uint16_t BlockGrid::get(int x, int y, int z) const {
+	if (x < 0 || y < 0 || z < 0 || x >= size_x || y >= size_y || z >= size_z)
+		return empty;
+	const vector<uint16_t>& chunk = chunks[((y / CHUNK_SIZE) * chunks_z + z / CHUNK_SIZE) * chunks_x + x / CHUNK_SIZE];
+	if (chunk.empty())
+		return empty;
+	return chunk[((y % CHUNK_SIZE) * CHUNK_SIZE + z % CHUNK_SIZE) * CHUNK_SIZE + x % CHUNK_SIZE];
+}
+
+void BlockGrid::set(int x, int y, int z, uint16_t index) {
+	vector<uint16_t>& chunk = chunks[((y / CHUNK_SIZE) * chunks_z + z / CHUNK_SIZE) * chunks_x + x / CHUNK_SIZE];
+	if (chunk.empty()) {
+		if (index == empty) return;
+		chunk.resize(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE, empty);
+	}
+	chunk[((y % CHUNK_SIZE) * CHUNK_SIZE + z % CHUNK_SIZE) * CHUNK_SIZE + x % CHUNK_SIZE] = index;
+}
+
+bool BlockGrid::hasChunk(int cx, int cy, int cz) const {
+	return !chunks[(cy * chunks_z + cz) * chunks_x + cx].empty();
+}
+
+// ----------------------------------------------------------------------------
+
+bool Schematic::load(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		printf("[Warning] File %s not found.\n", path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long file_size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	vector<uint8_t> compressed(file_size > 0 ? file_size : 0);
+	size_t read_size = fread(compressed.data(), 1, compressed.size(), file);
+	fclose(file);
+	compressed.resize(read_size);
+
+	vector<uint8_t> data;
+	if (!Inflate(compressed, data)) {
+		printf("[ERROR] Schematic %s is not a valid gzip file.\n", path);
+		return false;
+	}
+	compressed.clear();
+	compressed.shrink_to_fit();
+
+	NBTReader nbt(data.data(), data.size());
+	SchematicFields fields;
+	if (nbt.readByte() != TAG_COMPOUND) {
+		printf("[ERROR] Schematic %s has no root compound.\n", path);
+		return false;
+	}
+	nbt.readString();
+	ReadCompound(nbt, fields, false);
+	if (nbt.failed || !fields.has_data || fields.width < 0 || fields.height < 0 || fields.length < 0) {
+		printf("[ERROR] Schematic %s is truncated or not a Sponge schematic.\n", path);
+		return false;
+	}
+	version = fields.version;
+
+	int palette_size = 0;
+	for (map<string, int>::iterator it = fields.palette.begin(); it != fields.palette.end(); it++)
+		palette_size = std::max(palette_size, it->second + 1);
+	if (palette_size >= 0xFFFF) {
+		printf("[ERROR] Schematic %s has %d palette entries, only %d are supported.\n", path, palette_size, 0xFFFF - 1);
+		return false;
+	}
+	palette.clear();
+	palette.resize(palette_size);
+	int air = -1;
+	for (map<string, int>::iterator it = fields.palette.begin(); it != fields.palette.end(); it++) {
+		if (it->second < 0) continue;
+		palette[it->second] = ParseBlockState(it->first);
+		if (palette[it->second].name == "air")
+			air = it->second;
+	}
+	if (air < 0) {
+		air = palette.size();
+		palette.push_back(ParseBlockState("minecraft:air"));
+	}
+	blocks.resize(fields.width, fields.height, fields.length, air);
+
+	// Varints in x, z, y order, decoded straight into the grid
+	const uint8_t* it = &data[fields.data_offset];
+	const uint8_t* end = it + fields.data_size;
+	size_t block_count = (size_t)fields.width * fields.height * fields.length;
+	size_t decoded = 0;
+	uint32_t value = 0;
+	int shift = 0;
+	int x = 0, y = 0, z = 0;
+	int invalid = 0;
+	for (; it != end && decoded < block_count; it++) {
+		value |= (uint32_t)(*it & 0x7F) << shift;
+		if (*it & 0x80) {
+			shift += 7;
+			if (shift > 28) break;
+			continue;
+		}
+		if (value >= palette.size()) {
+			value = air;
+			invalid++;
+		}
+		blocks.set(x, y, z, value);
+		value = 0;
+		shift = 0;
+		decoded++;
+		if (++x == fields.width) {
+			x = 0;
+			if (++z == fields.length) {
+				z = 0;
+				y++;
+			}
+		}
+	}
+	if (decoded < block_count)
+		printf("[Warning] Schematic %s has %d of %d blocks.\n", path, (int)decoded, (int)block_count);
+	if (invalid > 0)
+		printf("[Warning] Schematic %s has %d blocks outside the palette.\n", path, invalid);
+	printf("[INFO] Loaded schematic %s v%d: %d x %d x %d blocks, %d palette entries\n", path, version, fields.width, fields.height, fields.length, (int)palette.size());
+	return true;
+}
@@ -0,0 +1,48 @@
+#ifndef SCHEMATIC_LOADER_H
+#define SCHEMATIC_LOADER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+// Palette entry such as "minecraft:oak_stairs[facing=east,half=bottom]"
+struct BlockState {
+	string name; // Without the "minecraft:" prefix
+	map<string, string> properties;
+};
+
+// Palette indices of a volume of any size, stored in CHUNK_SIZE^3 chunks that are only allocated when they hold a non empty block
+class BlockGrid {
+private:
+	int size_x = 0, size_y = 0, size_z = 0;
+	int chunks_x = 0, chunks_y = 0, chunks_z = 0;
+	uint16_t empty = 0;
+	vector<vector<uint16_t> > chunks;
+public:
+	static const int CHUNK_SIZE = 16;
+	void resize(int size_x, int size_y, int size_z, uint16_t empty);
+	uint16_t get(int x, int y, int z) const;
+	void set(int x, int y, int z, uint16_t index);
+	bool hasChunk(int cx, int cy, int cz) const;
+	int getSizeX() const { return size_x; }
+	int getSizeY() const { return size_y; }
+	int getSizeZ() const { return size_z; }
+	int getChunksX() const { return chunks_x; }
+	int getChunksY() const { return chunks_y; }
+	int getChunksZ() const { return chunks_z; }
+	uint16_t getEmpty() const { return empty; }
+};
+
+// Sponge schematic, versions 2 and 3
+class Schematic {
+public:
+	int version = 0;
+	vector<BlockState> palette;
+	BlockGrid blocks;
+	bool load(const char* path);
+};
+
+#endif
@@ -0,0 +1,254 @@
+#include <map>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+
+#include "worker_pool.h"
+#include "schematic_voxelizer.h"
+
+// Mean color of the texels that are not cut out, alpha is the fraction of them
+vector<vec4> AverageLayerColors(const vector<const uint8_t*>& layers, int layer_size) {
+	vector<vec4> colors(layers.size(), vec4(0, 0, 0, 0));
+	int texel_count = layer_size * layer_size;
+	ParallelFor(layers.size(), [&](int i) {
+		const uint8_t* layer = layers[i];
+		vec3 sum = vec3(0, 0, 0);
+		int covered = 0;
+		for (int j = 0; j < texel_count; j++) {
+			const uint8_t* texel = layer + j * 4;
+			if (texel[3] < 128) continue;
+			sum += vec3(texel[0], texel[1], texel[2]);
+			covered++;
+		}
+		if (covered > 0)
+			colors[i] = vec4(sum / (255.0f * covered), (float)covered / texel_count);
+	});
+	return colors;
+}
+
+struct ColorBin {
+	vec3 color;
+	float weight;
+};
+
+// The box with the largest weighted extent is split at its weighted median until there are max_colors boxes
+static vector<vec3> MedianCut(vector<ColorBin>& bins, int max_colors) {
+	vector<ivec2> boxes; // Ranges of bins
+	if (!bins.empty())
+		boxes.push_back(ivec2(0, bins.size()));
+	while ((int)boxes.size() < max_colors) {
+		int best = -1, best_axis = 0;
+		float best_score = 0;
+		for (unsigned int i = 0; i < boxes.size(); i++) {
+			if (boxes[i].y - boxes[i].x < 2) continue;
+			vec3 low = vec3(1e9f), high = vec3(-1e9f);
+			float weight = 0;
+			for (int j = boxes[i].x; j < boxes[i].y; j++) {
+				low = min(low, bins[j].color);
+				high = max(high, bins[j].color);
+				weight += bins[j].weight;
+			}
+			vec3 extent = high - low;
+			int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+			float score = extent[axis] * sqrtf(weight);
+			if (score > best_score) {
+				best = i;
+				best_axis = axis;
+				best_score = score;
+			}
+		}
+		if (best < 0) break;
+
+		ivec2 box = boxes[best];
+		sort(bins.begin() + box.x, bins.begin() + box.y, [best_axis](const ColorBin& a, const ColorBin& b) {
+			return a.color[best_axis] < b.color[best_axis];
+		});
+		float total = 0;
+		for (int j = box.x; j < box.y; j++)
+			total += bins[j].weight;
+		int split = box.x + 1;
+		float below = bins[box.x].weight;
+		while (split < box.y - 1 && below < 0.5f * total)
+			below += bins[split++].weight;
+		boxes[best] = ivec2(box.x, split);
+		boxes.push_back(ivec2(split, box.y));
+	}
+
+	vector<vec3> colors;
+	for (vector<ivec2>::iterator it = boxes.begin(); it != boxes.end(); it++) {
+		vec3 sum = vec3(0, 0, 0);
+		float weight = 0;
+		for (int j = it->x; j < it->y; j++) {
+			sum += bins[j].color * bins[j].weight;
+			weight += bins[j].weight;
+		}
+		colors.push_back(weight > 0 ? sum / weight : bins[it->x].color);
+	}
+	return colors;
+}
+
+template<typename Visitor>
+static void ForEachBlock(const BlockGrid& grid, Visitor visit) {
+	const int S = BlockGrid::CHUNK_SIZE;
+	for (int cy = 0; cy < grid.getChunksY(); cy++)
+		for (int cz = 0; cz < grid.getChunksZ(); cz++)
+			for (int cx = 0; cx < grid.getChunksX(); cx++) {
+				if (!grid.hasChunk(cx, cy, cz)) continue;
+				for (int y = cy * S; y < std::min((cy + 1) * S, grid.getSizeY()); y++)
+					for (int z = cz * S; z < std::min((cz + 1) * S, grid.getSizeZ()); z++)
+						for (int x = cx * S; x < std::min((cx + 1) * S, grid.getSizeX()); x++) {
+							uint16_t index = grid.get(x, y, z);
+							if (index != grid.getEmpty())
+								visit(x, y, z, index);
+						}
+			}
+}
+
+void VoxelizeSchematic(const BlockGrid& grid, const vector<BlockModel>& models, const vector<vector<VoxelBox> >& block_boxes,
+                       int voxels_per_block, MV_Color* palette, vector<VoxelVolume>& volumes) {
+	const int N = voxels_per_block;
+	vector<int> block_count(block_boxes.size(), 0);
+	ForEachBlock(grid, [&](int x, int y, int z, uint16_t index) {
+		(void)x; (void)y; (void)z;
+		block_count[index]++;
+	});
+
+	// Cells hold a box slot + 1, a whole block is a single slot at one voxel per block
+	vector<vector<uint8_t> > cells(block_boxes.size());
+	vector<vector<uint32_t> > slot_colors(block_boxes.size()); // RGB8
+	map<uint32_t, float> color_weights;
+	for (unsigned int i = 0; i < block_boxes.size(); i++) {
+		if (block_count[i] == 0 || block_boxes[i].empty()) continue;
+		vector<vec3> colors;
+		vector<float> slot_volumes;
+		if (N == 1) {
+			vec3 sum = vec3(0, 0, 0);
+			float volume = 0;
+			for (vector<VoxelBox>::const_iterator it = block_boxes[i].begin(); it != block_boxes[i].end(); it++) {
+				if (it->color.a < 0.5f) continue; // Mostly cut out, like glass
+				ivec3 size = it->max - it->min;
+				sum += vec3(it->color) * (float)(size.x * size.y * size.z);
+				volume += size.x * size.y * size.z;
+			}
+			if (volume < 16 * 16 * 16 / 8) continue;
+			cells[i].assign(1, 1);
+			colors.push_back(sum / volume);
+			slot_volumes.push_back(1);
+		} else {
+			cells[i].assign(N * N * N, 0);
+			for (unsigned int b = 0; b < block_boxes[i].size(); b++) {
+				const VoxelBox& box = block_boxes[i][b];
+				if (box.color.a < 0.5f) continue;
+				uint8_t slot = colors.size() + 1;
+				for (int y = box.min.y; y < box.max.y; y++)
+					for (int z = box.min.z; z < box.max.z; z++)
+						for (int x = box.min.x; x < box.max.x; x++)
+							cells[i][(y * N + z) * N + x] = slot;
+				colors.push_back(vec3(box.color));
+				slot_volumes.push_back(0);
+				if (colors.size() == 255) break;
+			}
+			for (vector<uint8_t>::iterator it = cells[i].begin(); it != cells[i].end(); it++)
+				if (*it) slot_volumes[*it - 1]++;
+		}
+		for (unsigned int j = 0; j < colors.size(); j++) {
+			ivec3 rgb = clamp(ivec3(colors[j] * 255.0f + 0.5f), ivec3(0), ivec3(255));
+			uint32_t key = (rgb.r << 16) | (rgb.g << 8) | rgb.b;
+			slot_colors[i].push_back(key);
+			color_weights[key] += slot_volumes[j] * block_count[i];
+		}
+	}
+
+	vector<ColorBin> bins;
+	for (map<uint32_t, float>::iterator it = color_weights.begin(); it != color_weights.end(); it++) {
+		ColorBin bin;
+		bin.color = vec3((it->first >> 16) & 255, (it->first >> 8) & 255, it->first & 255);
+		bin.weight = it->second;
+		if (bin.weight > 0)
+			bins.push_back(bin);
+	}
+	vector<vec3> colors = MedianCut(bins, VOXEL_COLORS);
+	memset(palette, 0, 256 * sizeof(MV_Color));
+	for (unsigned int i = 0; i < colors.size(); i++) {
+		MV_Color color = { (uint8_t)roundf(colors[i].r), (uint8_t)roundf(colors[i].g), (uint8_t)roundf(colors[i].b), 255 };
+		palette[i + 1] = color;
+	}
+	map<uint32_t, uint8_t> color_index;
+	for (map<uint32_t, float>::iterator it = color_weights.begin(); it != color_weights.end(); it++) {
+		vec3 color = vec3((it->first >> 16) & 255, (it->first >> 8) & 255, it->first & 255);
+		float best_distance = FLT_MAX;
+		for (unsigned int i = 0; i < colors.size(); i++) {
+			vec3 delta = colors[i] - color;
+			if (dot(delta, delta) < best_distance) {
+				best_distance = dot(delta, delta);
+				color_index[it->first] = i + 1;
+			}
+		}
+	}
+
+	// Palette indices of the cells to emit, only the shell of opaque cubes can be seen
+	vector<vector<uint16_t> > block_cells(block_boxes.size());
+	for (unsigned int i = 0; i < cells.size(); i++) {
+		for (unsigned int c = 0; c < cells[i].size(); c++) {
+			if (cells[i][c] == 0) continue;
+			int x = c % N, z = (c / N) % N, y = c / (N * N);
+			bool shell = x == 0 || x == N - 1 || y == 0 || y == N - 1 || z == 0 || z == N - 1;
+			if (models[i].opaque_cube && !shell) continue;
+			cells[i][c] = color_index[slot_colors[i][cells[i][c] - 1]];
+			block_cells[i].push_back(c);
+		}
+	}
+
+	ivec3 voxel_size = ivec3(grid.getSizeX(), grid.getSizeY(), grid.getSizeZ()) * N;
+	ivec3 tiles = (voxel_size + ivec3(MAX_VOLUME_SIZE - 1)) / MAX_VOLUME_SIZE;
+	volumes.assign(tiles.x * tiles.y * tiles.z, VoxelVolume());
+	for (int ty = 0; ty < tiles.y; ty++)
+		for (int tz = 0; tz < tiles.z; tz++)
+			for (int tx = 0; tx < tiles.x; tx++) {
+				VoxelVolume& volume = volumes[(ty * tiles.z + tz) * tiles.x + tx];
+				volume.origin = ivec3(tx, ty, tz) * MAX_VOLUME_SIZE;
+				ivec3 size = min(voxel_size - volume.origin, ivec3(MAX_VOLUME_SIZE));
+				volume.shape.id = "schematic_" + to_string(tx) + "_" + to_string(ty) + "_" + to_string(tz);
+				volume.shape.sizex = size.x;
+				volume.shape.sizey = size.z;
+				volume.shape.sizez = size.y;
+			}
+
+	ForEachBlock(grid, [&](int x, int y, int z, uint16_t index) {
+		if (block_cells[index].empty()) return;
+		bool exposed[6];
+		bool hidden = true;
+		for (int d = 0; d < 6; d++) {
+			ivec3 n = ivec3(x, y, z) + DIRECTIONS[d];
+			bool inside = n.x >= 0 && n.y >= 0 && n.z >= 0 && n.x < grid.getSizeX() && n.y < grid.getSizeY() && n.z < grid.getSizeZ();
+			exposed[d] = !inside || !models[grid.get(n.x, n.y, n.z)].opaque_cube;
+			hidden = hidden && !exposed[d];
+		}
+		if (hidden) return;
+
+		bool opaque_cube = models[index].opaque_cube;
+		for (vector<uint16_t>::iterator it = block_cells[index].begin(); it != block_cells[index].end(); it++) {
+			ivec3 local = ivec3(*it % N, *it / (N * N), (*it / N) % N);
+			if (opaque_cube) {
+				bool visible = false;
+				for (int a = 0; a < 3 && !visible; a++)
+					visible = (local[a] == N - 1 && exposed[a * 2]) || (local[a] == 0 && exposed[a * 2 + 1]);
+				if (!visible) continue;
+			}
+			ivec3 voxel = ivec3(x, y, z) * N + local;
+			ivec3 tile = voxel / MAX_VOLUME_SIZE;
+			ivec3 cell = voxel - tile * MAX_VOLUME_SIZE;
+			VoxelVolume& volume = volumes[(tile.y * tiles.z + tile.z) * tiles.x + tile.x];
+			// Schematic y up and z south to MagicaVoxel z up and y north
+			MV_Voxel mv_voxel = { (uint8_t)cell.x, (uint8_t)(volume.shape.sizey - 1 - cell.z), (uint8_t)cell.y, cells[index][*it] };
+			volume.shape.voxels.push_back(mv_voxel);
+		}
+	});
+
+	vector<VoxelVolume>::iterator last = remove_if(volumes.begin(), volumes.end(), [](const VoxelVolume& volume) {
+		return volume.shape.voxels.empty();
+	});
+	volumes.erase(last, volumes.end());
+}
+
@@ -0,0 +1,38 @@
+#ifndef SCHEMATIC_VOXELIZER_H
+#define SCHEMATIC_VOXELIZER_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "vox_loader.h"
+#include "world_mesher.h"
+#include "schematic_loader.h"
+
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+// Model element as an axis aligned box in sixteenths of a block, alpha of the color is the opaque texture coverage
+struct VoxelBox {
+	ivec3 min, max;
+	vec4 color;
+};
+
+// Shape of at most MAX_VOLUME_SIZE^3 voxels in MagicaVoxel axes, origin is its min corner in schematic voxels
+struct VoxelVolume {
+	MV_Shape shape;
+	ivec3 origin;
+};
+
+static const int MAX_VOLUME_SIZE = 256;
+static const int VOXEL_COLORS = 253; // Index 0 is empty, 254 and 255 are snow and holes
+
+// Mean color of the texels that are not cut out, alpha is the fraction of them
+vector<vec4> AverageLayerColors(const vector<const uint8_t*>& layers, int layer_size);
+
+// Palette entries are rasterized once, blocks hidden behind opaque cubes and the inside of opaque cubes are skipped
+void VoxelizeSchematic(const BlockGrid& grid, const vector<BlockModel>& models, const vector<vector<VoxelBox> >& block_boxes,
+                       int voxels_per_block, MV_Color* palette, vector<VoxelVolume>& volumes);
+
+#endif
@@ -1,158 +1,513 @@
+#include <stdio.h>
+#include <algorithm>
 #include <stdexcept>
 #include <string.h>
+#include <filesystem>
 
 #include "utils.h"
 #include "shader.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
+GLuint Shader::frame_buffer = 0;
+UniformRing* Shader::object_ring = NULL;
+GLuint Shader::current_program = 0;
+GLuint Shader::bound_textures[MAX_TEXTURE_UNITS];
+bool Shader::batching = false;
+StateStats Shader::stats;
+CacheStats Shader::cache_stats;
+vector<Shader*> Shader::pending;
+vector<Shader*> Shader::programs;
+int Shader::program_count = 0;
+
+static const char* CACHE_FOLDER = "shader_cache/";
+static const uint32_t CACHE_MAGIC = 0x42505444; // "DTPB"
+
+// Texture bindings are global state, they are only tracked between beginBatch and endBatch
+void Shader::beginBatch() {
+	for (int i = 0; i < MAX_TEXTURE_UNITS; i++)
+		bound_textures[i] = ~0u;
+	batching = true;
+}
+
+void Shader::endBatch() {
+	batching = false;
+}
+
+// Call once per frame before drawing, shared by every program with a FrameData block
+void Shader::pushFrame(const FrameData& data) {
+	if (frame_buffer == 0) {
+		glGenBuffers(1, &frame_buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, frame_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+		object_ring = new UniformRing(sizeof(ObjectData), MAX_OBJECTS_PER_FRAME * OBJECT_PASSES);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, frame_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, frame_buffer);
+	object_ring->nextFrame();
+}
+
+void Shader::pushObject(const ObjectData& data) {
+	object_ring->push(OBJECT_BINDING, &data, sizeof(ObjectData));
+	stats.changes++;
+}
+
+// FNV-1a, avoids building a string for every lookup
+static uint32_t HashName(const char* name) {
+	uint32_t hash = 2166136261u;
+	for (; *name != '\0'; name++) {
+		hash ^= (uint8_t)*name;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static uint64_t HashString(const char* data, uint64_t hash = 14695981039346656037ull) {
+	for (; *data != '\0'; data++) {
+		hash ^= (uint8_t)*data;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Binaries are only valid for the driver that produced them
+static uint64_t CacheKey(const char* vertex_source, const char* fragment_source) {
+	uint64_t hash = HashString((const char*)glGetString(GL_VENDOR));
+	hash = HashString((const char*)glGetString(GL_RENDERER), hash);
+	hash = HashString((const char*)glGetString(GL_VERSION), hash);
+	hash = HashString(vertex_source, hash);
+	return HashString(fragment_source, hash);
+}
+
+static bool HasExtension(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
+	return false;
+}
+
+static bool BinaryCacheSupported() {
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+bool Shader::loadBinary(const string& path, uint64_t key) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	uint32_t magic = 0, format = 0, length = 0;
+	uint64_t file_key = 0;
+	bool valid = fread(&magic, sizeof(magic), 1, file) == 1 && magic == CACHE_MAGIC
+		&& fread(&file_key, sizeof(file_key), 1, file) == 1 && file_key == key
+		&& fread(&format, sizeof(format), 1, file) == 1
+		&& fread(&length, sizeof(length), 1, file) == 1 && length > 0;
+	vector<uint8_t> binary;
+	if (valid) {
+		binary.resize(length);
+		valid = fread(binary.data(), 1, length, file) == length;
+	}
+	fclose(file);
+	if (!valid)
+		return false;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), length);
+	GLint has_linked;
+	glGetProgramiv(program, GL_LINK_STATUS, &has_linked);
+	if (has_linked == GL_FALSE) { // Driver update or corrupted file
+		glDeleteProgram(program);
+		return false;
+	}
+	setProgram(program);
+	return true;
+}
+
+void Shader::saveBinary(const string& path, uint64_t key) {
+	GLint length = 0;
+	glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+	vector<uint8_t> binary(length);
+	GLenum format;
+	glGetProgramBinary(id, length, NULL, &format, binary.data());
+
+	error_code error;
+	filesystem::create_directories(CACHE_FOLDER, error);
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == NULL)
+		return;
+	uint32_t header[] = { CACHE_MAGIC, 0, 0, (uint32_t)format, (uint32_t)length };
+	memcpy(&header[1], &key, sizeof(key));
+	fwrite(header, sizeof(header), 1, file);
+	fwrite(binary.data(), 1, length, file);
+	fclose(file);
+}
+
+// Queues the compile and link, the driver may run them on its own threads until finish is called
 void Shader::create(const char* vertex_source, const char* fragment_source) {
+	static const bool cache_supported = BinaryCacheSupported();
+	pending_key = CacheKey(vertex_source, fragment_source);
+	char cache_path[64];
+	snprintf(cache_path, sizeof(cache_path), "%s%016llx.bin", CACHE_FOLDER, (unsigned long long)pending_key);
+	this->cache_path = cache_supported ? cache_path : "";
+	if (cache_supported && loadBinary(cache_path, pending_key)) {
+		cache_stats.hits++;
+		return;
+	}
+	cache_stats.misses++;
+
+	pending_shaders[0] = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(pending_shaders[0], 1, &vertex_source, NULL);
+	glCompileShader(pending_shaders[0]);
+
+	pending_shaders[1] = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(pending_shaders[1], 1, &fragment_source, NULL);
+	glCompileShader(pending_shaders[1]);
+
+	pending_program = glCreateProgram();
+	glAttachShader(pending_program, pending_shaders[0]);
+	glAttachShader(pending_program, pending_shaders[1]);
+	if (cache_supported)
+		glProgramParameteri(pending_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(pending_program);
+	pending.push_back(this);
+}
+
+// Without the extension the link is always considered done, finish will block on it
+bool Shader::isReady() const {
+	static const bool parallel_compile = HasExtension("GL_KHR_parallel_shader_compile") || HasExtension("GL_ARB_parallel_shader_compile");
+	if (pending_program == 0 || !parallel_compile)
+		return true;
+	GLint completed;
+	glGetProgramiv(pending_program, GL_COMPLETION_STATUS_KHR, &completed);
+	return completed == GL_TRUE;
+}
+
+// Replaces the active program with the pending one if it linked, returns false on errors
+bool Shader::finish() {
+	if (pending_program == 0)
+		return true;
+	pending.erase(remove(pending.begin(), pending.end(), this), pending.end());
+
 	GLint has_compiled;
 	char info_log[1024];
+	const char* stages[] = { "Vertex", "Fragment" };
+	const string* paths[] = { &path1, &path2 };
+	for (int i = 0; i < 2; i++) {
+		glGetShaderiv(pending_shaders[i], GL_COMPILE_STATUS, &has_compiled);
+		glGetShaderInfoLog(pending_shaders[i], 1024, NULL, info_log);
+		if (has_compiled == GL_FALSE)
+			printf("[ERROR] %s shader %s failed to compile\n%s\n", stages[i], paths[i]->c_str(), info_log);
+		else if (strcmp(info_log, "") != 0)
+			printf("[Warning] %s shader %s compiled with warnings\n%s\n", stages[i], paths[i]->c_str(), info_log);
+		glDeleteShader(pending_shaders[i]);
+	}
 
-	GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex_shader, 1, &vertex_source, NULL);
-	glCompileShader(vertex_shader);
-	
-	glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &has_compiled);
-	glGetShaderInfoLog(vertex_shader, 1024, NULL, info_log);
-	if (has_compiled == GL_FALSE)
-		printf("[ERROR] Vertex shader %s failed to compile\n%s\n", path1.c_str(), info_log);
-	else if (strcmp(info_log, "") != 0)
-		printf("[Warning] Vertex shader %s compiled with warnings\n%s\n", path1.c_str(), info_log);
-
-	GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment_shader, 1, &fragment_source, NULL);
-	glCompileShader(fragment_shader);
-
-	glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &has_compiled);
-	glGetShaderInfoLog(fragment_shader, 1024, NULL, info_log);
-	if (has_compiled == GL_FALSE)
-		printf("[ERROR] Fragment shader %s failed to compile\n%s\n", path2.c_str(), info_log);
-	else if (strcmp(info_log, "") != 0)
-		printf("[Warning] Fragment shader %s compiled with warnings\n%s\n", path2.c_str(), info_log);
-
-	id = glCreateProgram();
-	glAttachShader(id, vertex_shader);
-	glAttachShader(id, fragment_shader);
-	glLinkProgram(id);
-
-	glGetProgramiv(id, GL_LINK_STATUS, &has_compiled);
+	GLuint program = pending_program;
+	pending_program = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &has_compiled);
 	if (has_compiled == GL_FALSE) {
-		//glGetProgramInfoLog(id, 1024, NULL, infoLog);
-		throw runtime_error("Program linking failed");
+		glDeleteProgram(program);
+		if (id == 0)
+			throw runtime_error("Program linking failed");
+		printf("[Warning] Shader %s failed to reload\n", path1.c_str());
+		return false;
+	}
+	setProgram(program);
+	if (cache_path != "")
+		saveBinary(cache_path, pending_key);
+	return true;
+}
+
+// The previous program stays valid until the new one is ready
+void Shader::setProgram(GLuint program) {
+	if (id != 0)
+		glDeleteProgram(id);
+	if (current_program == id)
+		current_program = 0;
+	id = program;
+	resolveUniforms();
+}
+
+void Shader::finishAll() {
+	while (!pending.empty())
+		pending.front()->finish();
+}
+
+// Queries every active uniform once and binds the shared uniform blocks
+void Shader::resolveUniforms() {
+	uniforms.clear();
+	values.clear();
+	GLint uniform_count;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &uniform_count);
+	for (GLint i = 0; i < uniform_count; i++) {
+		char name[256];
+		GLsizei length;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(id, i, sizeof(name), &length, &size, &type, name);
+		GLint location = glGetUniformLocation(id, name);
+		if (location == -1)
+			continue; // Uniform block member
+		char* array_suffix = strstr(name, "[0]");
+		if (array_suffix != NULL)
+			*array_suffix = '\0';
+		uint32_t hash = HashName(name);
+		if (uniforms.find(hash) != uniforms.end())
+			printf("[Warning] Uniform %s hash collision in %s\n", name, path1.c_str());
+		uniforms[hash] = location;
 	}
 
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
+	GLuint frame_block = glGetUniformBlockIndex(id, "FrameData");
+	if (frame_block != GL_INVALID_INDEX)
+		glUniformBlockBinding(id, frame_block, FRAME_BINDING);
+	GLuint object_block = glGetUniformBlockIndex(id, "ObjectData");
+	if (object_block != GL_INVALID_INDEX)
+		glUniformBlockBinding(id, object_block, OBJECT_BINDING);
 }
 
-Shader::Shader(const char* name) {
+Shader::Shader(const char* name, const vector<string>& defines) {
 	string path = "shaders/" + string(name) + ".glsl";
 	unified = true;
 	path1 = path;
 	path2 = path;
+	setDefines(defines);
 	load();
 }
 
-Shader::Shader(const char* vertex_path, const char* fragment_path) {
+Shader::Shader(const char* vertex_path, const char* fragment_path, const vector<string>& defines) {
 	unified = false;
 	path1 = vertex_path;
 	path2 = fragment_path;
+	setDefines(defines);
+	load();
+}
+
+Shader::Shader(const Shader& base, const vector<string>& defines) {
+	unified = base.unified;
+	path1 = base.path1;
+	path2 = base.path2;
+	setDefines(defines);
 	load();
 }
 
+// Each define is a name optionally followed by a value, e.g. "HEX_SIDE 2"
+void Shader::setDefines(const vector<string>& defines) {
+	for (vector<string>::const_iterator it = defines.begin(); it != defines.end(); it++) {
+		this->defines += "#define " + *it + "\n";
+		permutation += (permutation.empty() ? "" : ", ") + *it;
+	}
+	programs.push_back(this);
+	index = program_count++;
+}
+
+// Defines go right after the #version line
+static string InjectDefines(const string& source, const string& defines) {
+	size_t version = source.find("#version");
+	if (version == string::npos)
+		return defines + source;
+	size_t line_end = source.find('\n', version);
+	if (line_end == string::npos)
+		return source + "\n" + defines;
+	return source.substr(0, line_end + 1) + defines + source.substr(line_end + 1);
+}
+
 void Shader::load() {
 	if (unified) {
 		string shader_code = ReadFile(path1.c_str());
-		string vertex_code = string(VERSION) + VERTEX + shader_code;
-		string fragment_code = string(VERSION) + FRAGMENT + shader_code;
+		string vertex_code = string(VERSION) + defines + VERTEX + shader_code;
+		string fragment_code = string(VERSION) + defines + FRAGMENT + shader_code;
 		create(vertex_code.c_str(), fragment_code.c_str());
 	} else {
-		string vertex_code = ReadFile(path1.c_str());
-		string fragment_code = ReadFile(path2.c_str());
+		string vertex_code = InjectDefines(ReadFile(path1.c_str()), defines);
+		string fragment_code = InjectDefines(ReadFile(path2.c_str()), defines);
 		create(vertex_code.c_str(), fragment_code.c_str());
 	}
 }
 
+// Variants are compiled on first request and owned by the base shader
+Shader& Shader::getVariant(const vector<string>& defines) {
+	if (defines.empty())
+		return *this;
+	string key;
+	for (vector<string>::const_iterator it = defines.begin(); it != defines.end(); it++)
+		key += *it + ";";
+	map<string, Shader*>::iterator it = variants.find(key);
+	if (it != variants.end())
+		return *it->second;
+	Shader* variant = new Shader(*this, defines);
+	variants[key] = variant;
+	return *variant;
+}
+
+void Shader::listPermutations(vector<string>& names) {
+	for (vector<Shader*>::iterator it = programs.begin(); it != programs.end(); it++) {
+		const Shader* shader = *it;
+		string name = shader->unified ? shader->path1 : shader->path1 + " + " + shader->path2;
+		if (!shader->permutation.empty())
+			name += " [" + shader->permutation + "]";
+		names.push_back(name);
+	}
+}
+
 GLint Shader::getLocation(const char* uniform) {
-	if (uniforms.find(uniform) == uniforms.end()) {
-		GLint location = glGetUniformLocation(id, uniform);
-		if (location == -1)
-			printf("[Warning] Uniform %s not found or used in %s / %s\n", uniform, path1.c_str(), path2.c_str());
-		uniforms[uniform] = location;
+	uint32_t hash = HashName(uniform);
+	unordered_map<uint32_t, GLint>::iterator it = uniforms.find(hash);
+	if (it != uniforms.end())
+		return it->second;
+	printf("[Warning] Uniform %s not found or used in %s / %s\n", uniform, path1.c_str(), path2.c_str());
+	uniforms[hash] = -1;
+	return -1;
+}
+
+// Uniform values belong to the program, returns false if the location already holds this value
+bool Shader::setValue(GLint location, const void* data, size_t size) {
+	if (location == -1)
+		return false;
+	map<GLint, mat4>::iterator it = values.find(location);
+	if (it != values.end() && memcmp(value_ptr(it->second), data, size) == 0) {
+		stats.skipped++;
+		return false;
+	}
+	memcpy(value_ptr(values[location]), data, size);
+	stats.changes++;
+	return true;
+}
+
+void Shader::bindTexture(GLenum target, GLuint texture_id, GLuint unit) {
+	if (batching && unit < MAX_TEXTURE_UNITS) {
+		if (bound_textures[unit] == texture_id) {
+			stats.skipped++;
+			return;
+		}
+		bound_textures[unit] = texture_id;
 	}
-	return uniforms[uniform];
+	stats.changes++;
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(target, texture_id);
 }
 
 void Shader::pushInt(const char* uniform, int value) {
-	glUniform1i(getLocation(uniform), value);
+	GLint location = getLocation(uniform);
+	if (setValue(location, &value, sizeof(value)))
+		glUniform1i(location, value);
 }
 
 void Shader::pushUInt(const char* uniform, unsigned int value) {
-	glUniform1ui(getLocation(uniform), value);
+	GLint location = getLocation(uniform);
+	if (setValue(location, &value, sizeof(value)))
+		glUniform1ui(location, value);
 }
 
 void Shader::pushFloat(const char* uniform, float value) {
-	glUniform1f(getLocation(uniform), value);
+	GLint location = getLocation(uniform);
+	if (setValue(location, &value, sizeof(value)))
+		glUniform1f(location, value);
 }
 
 void Shader::pushVec2(const char* uniform, vec2 value) {
-	glUniform2fv(getLocation(uniform), 1, value_ptr(value));
+	GLint location = getLocation(uniform);
+	if (setValue(location, value_ptr(value), sizeof(value)))
+		glUniform2fv(location, 1, value_ptr(value));
 }
 
 void Shader::pushVec3(const char* uniform, vec3 value) {
-	glUniform3fv(getLocation(uniform), 1, value_ptr(value));
+	GLint location = getLocation(uniform);
+	if (setValue(location, value_ptr(value), sizeof(value)))
+		glUniform3fv(location, 1, value_ptr(value));
 }
 
 void Shader::pushVec4(const char* uniform, vec4 value) {
-	glUniform4fv(getLocation(uniform), 1, value_ptr(value));
+	GLint location = getLocation(uniform);
+	if (setValue(location, value_ptr(value), sizeof(value)))
+		glUniform4fv(location, 1, value_ptr(value));
 }
 
 void Shader::pushMatrix(const char* uniform, mat4 value) {
-	glUniformMatrix4fv(getLocation(uniform), 1, GL_FALSE, value_ptr(value));
+	GLint location = getLocation(uniform);
+	if (setValue(location, value_ptr(value), sizeof(value)))
+		glUniformMatrix4fv(location, 1, GL_FALSE, value_ptr(value));
 }
 
 void Shader::pushTexture1D(const char* uniform, GLuint texture_id, GLuint unit) {
-	glUniform1i(getLocation(uniform), unit);
-	glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_1D, texture_id);
+	pushInt(uniform, unit);
+	bindTexture(GL_TEXTURE_1D, texture_id, unit);
 }
 
 void Shader::pushTexture2D(const char* uniform, GLuint texture_id, GLuint unit) {
-	glUniform1i(getLocation(uniform), unit);
-	glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_2D, texture_id);
+	pushInt(uniform, unit);
+	bindTexture(GL_TEXTURE_2D, texture_id, unit);
+}
+
+void Shader::pushTexture2DArray(const char* uniform, GLuint texture_id, GLuint unit) {
+	pushInt(uniform, unit);
+	bindTexture(GL_TEXTURE_2D_ARRAY, texture_id, unit);
 }
 
 void Shader::pushTexture3D(const char* uniform, GLuint texture_id, GLuint unit) {
-	glUniform1i(getLocation(uniform), unit);
-	glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_3D, texture_id);
+	pushInt(uniform, unit);
+	bindTexture(GL_TEXTURE_3D, texture_id, unit);
 }
 
 void Shader::pushTextureCubeMap(const char* uniform, GLuint texture_id, GLuint unit) {
-	glUniform1i(getLocation(uniform), unit);
-	glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id);
+	pushInt(uniform, unit);
+	bindTexture(GL_TEXTURE_CUBE_MAP, texture_id, unit);
 }
 
 void Shader::use() {
+	if (pending_program != 0 && (id == 0 || isReady()))
+		finish();
+	if (current_program == id) {
+		stats.skipped++;
+		return;
+	}
+	stats.changes++;
+	current_program = id;
 	glUseProgram(id);
 }
 
+GLuint Shader::getId() const {
+	return id;
+}
+
+int Shader::getIndex() const {
+	return index;
+}
+
+// Non-blocking, use() switches to the new program once the driver has linked it
+// A missing or unreadable source keeps the current program and its variants
 void Shader::reload() {
-	GLuint old_id = id;
+	discardPending();
 	try {
 		load();
-		uniforms.clear();
 	} catch (const runtime_error& e) {
-		printf("[Warning] Shader %s failed to reload\n", path1.c_str());
-		glDeleteProgram(id);
-		id = old_id;
+		printf("[Warning] Shader %s failed to reload: %s\n", path1.c_str(), e.what());
+		return;
 	}
+	for (map<string, Shader*>::iterator it = variants.begin(); it != variants.end(); it++)
+		it->second->reload();
+}
+
+void Shader::discardPending() {
+	if (pending_program == 0)
+		return;
+	pending.erase(remove(pending.begin(), pending.end(), this), pending.end());
+	glDeleteShader(pending_shaders[0]);
+	glDeleteShader(pending_shaders[1]);
+	glDeleteProgram(pending_program);
+	pending_program = 0;
 }
 
 Shader::~Shader() {
+	discardPending();
+	for (map<string, Shader*>::iterator it = variants.begin(); it != variants.end(); it++)
+		delete it->second;
+	programs.erase(remove(programs.begin(), programs.end(), this), programs.end());
+	if (current_program == id)
+		current_program = 0;
 	glDeleteProgram(id);
 }
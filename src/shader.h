@@ -3,30 +3,94 @@
 
 #include <map>
 #include <string>
+#include <vector>
+#include <stdint.h>
+#include <unordered_map>
 
+#include "uniform_buffer.h"
 #include "../glad/glad.h"
 #include <glm/glm.hpp>
 
 using namespace std;
 using namespace glm;
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+struct CacheStats {
+	int hits = 0;
+	int misses = 0;
+};
+
+struct StateStats {
+	int draws = 0;
+	int changes = 0;
+	int skipped = 0; // Redundant changes not sent to the driver
+};
+
 class Shader {
 private:
+	static const int MAX_TEXTURE_UNITS = 16;
+	static const int MAX_OBJECTS_PER_FRAME = 4096;
+	// Objects are pushed once for the G-buffer and once per shadow cascade
+	static const int OBJECT_PASSES = 1 + SHADOW_CASCADES;
+	static GLuint frame_buffer;
+	static UniformRing* object_ring;
+	static GLuint current_program;
+	static GLuint bound_textures[MAX_TEXTURE_UNITS];
+	static bool batching;
+	static vector<Shader*> pending; // Programs still compiling
+	static vector<Shader*> programs; // Every permutation, for profiling
+	static int program_count;
+
 	const char* VERSION = "#version 410 core\n";
 	const char* VERTEX = "#define VERTEX\n";
 	const char* FRAGMENT = "#define FRAGMENT\n";
-	map<string, GLint> uniforms;
+	unordered_map<uint32_t, GLint> uniforms; // Name hash to location, filled at link time
+	map<GLint, mat4> values; // Last value sent to each location
 
-	GLuint id;
+	GLuint id = 0;
+	int index; // Dense creation order, used as the shader field of render queue keys
+	GLuint pending_program = 0;
+	GLuint pending_shaders[2];
+	uint64_t pending_key;
+	string cache_path;
 	bool unified;
 	string path1;
 	string path2;
+	string defines; // Injected after the version line
+	string permutation;
+	map<string, Shader*> variants;
+	Shader(const Shader& base, const vector<string>& defines);
+	void setDefines(const vector<string>& defines);
 	void load();
 	void create(const char* vertex_source, const char* fragment_source);
+	bool isReady() const;
+	bool finish();
+	void discardPending();
+	void setProgram(GLuint program);
+	bool loadBinary(const string& path, uint64_t key);
+	void saveBinary(const string& path, uint64_t key);
+	void resolveUniforms();
 	GLint getLocation(const char* uniform);
+	bool setValue(GLint location, const void* data, size_t size);
+	void bindTexture(GLenum target, GLuint texture_id, GLuint unit);
 public:
-	Shader(const char* name);
-	Shader(const char* vertex_path, const char* fragment_path);
+	static StateStats stats;
+	static CacheStats cache_stats;
+	static void beginBatch();
+	static void endBatch();
+	static void pushFrame(const FrameData& data);
+	static void pushObject(const ObjectData& data);
+	static void finishAll();
+
+	Shader(const char* name, const vector<string>& defines = vector<string>());
+	Shader(const char* vertex_path, const char* fragment_path, const vector<string>& defines = vector<string>());
+	Shader(const Shader&) = delete; // Owns the GL program and its variants
+	Shader& operator=(const Shader&) = delete;
+	Shader& getVariant(const vector<string>& defines);
+	static void listPermutations(vector<string>& names);
 	void pushInt(const char* uniform, int value);
 	void pushUInt(const char* uniform, unsigned int value);
 	void pushFloat(const char* uniform, float value);
@@ -36,9 +100,12 @@ public:
 	void pushMatrix(const char* uniform, mat4 value);
 	void pushTexture1D(const char* uniform, GLuint texture_id, GLuint unit);
 	void pushTexture2D(const char* uniform, GLuint texture_id, GLuint unit);
+	void pushTexture2DArray(const char* uniform, GLuint texture_id, GLuint unit);
 	void pushTexture3D(const char* uniform, GLuint texture_id, GLuint unit);
 	void pushTextureCubeMap(const char* uniform, GLuint texture_id, GLuint unit);
 	void use();
+	GLuint getId() const;
+	int getIndex() const;
 	void reload();
 	~Shader();
 };
@@ -167,7 +167,7 @@ void ShadowVolume::draw(Shader& shader, Camera& camera) {
 	shader.pushVec3("uVolResolution", vec3(width, height, depth));
 
 	shader.pushFloat("uRndFrame", RTX_Render::random_frame);
-	shader.pushVec2("uPixelSize", vec2(1.0f / camera.screen_width, 1.0f / camera.screen_height));
+	shader.pushVec2("uPixelSize", vec2(1.0f / camera.render_width, 1.0f / camera.render_height));
 
 	vao.bind();
 	glDrawElements(GL_TRIANGLES, sizeof(screen_indices) / sizeof(GLuint), GL_UNSIGNED_INT, 0);
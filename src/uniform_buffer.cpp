@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "uniform_buffer.h"
+
+// Every block starts at an aligned offset, so a frame holds that many aligned slots rather than packed blocks
+UniformRing::UniformRing(GLsizeiptr block_size, int blocks_per_frame) {
+	GLint offset_alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+	alignment = offset_alignment > 0 ? offset_alignment : 256;
+	frame_size = (block_size + alignment - 1) / alignment * alignment * blocks_per_frame;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	if (GLAD_GL_VERSION_4_4) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, FRAMES * frame_size, NULL, flags);
+		mapped = (uint8_t*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, FRAMES * frame_size, flags);
+	} else
+		glBufferData(GL_UNIFORM_BUFFER, FRAMES * frame_size, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Writes the block and binds its range, the GPU is never reading the current frame region
+void UniformRing::push(GLuint binding, const void* data, GLsizeiptr size) {
+	GLsizeiptr aligned_size = (size + alignment - 1) / alignment * alignment;
+	if (offset + aligned_size > frame_size) {
+		printf("[Warning] Uniform ring full, waiting for the GPU\n");
+		glFinish();
+		offset = 0;
+	}
+	GLintptr frame_offset = frame * frame_size + offset;
+	if (mapped != NULL)
+		memcpy(mapped + frame_offset, data, size);
+	else {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, frame_offset, size, data);
+	}
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, frame_offset, size);
+	offset += aligned_size;
+}
+
+void UniformRing::nextFrame() {
+	if (fences[frame] != NULL)
+		glDeleteSync(fences[frame]);
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame = (frame + 1) % FRAMES;
+	offset = 0;
+	if (fences[frame] != NULL) {
+		glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fences[frame]);
+		fences[frame] = NULL;
+	}
+}
+
+UniformRing::~UniformRing() {
+	for (int i = 0; i < FRAMES; i++)
+		if (fences[i] != NULL)
+			glDeleteSync(fences[i]);
+	if (mapped != NULL) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+	glDeleteBuffers(1, &buffer);
+}
@@ -0,0 +1,64 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+#include "../glad/glad.h"
+
+using namespace glm;
+
+enum UniformBinding : GLuint {
+	FRAME_BINDING = 0,
+	OBJECT_BINDING = 1,
+};
+
+static const int SHADOW_CASCADES = 4;
+
+// std140 layouts, they must match the FrameData and ObjectData blocks in the shaders
+struct FrameData {
+	mat4 vp_matrix;
+	mat4 light_matrices[SHADOW_CASCADES];
+	vec3 camera_pos;
+	float far_plane;
+	vec3 light_pos;
+	float rnd_frame;
+	vec2 pixel_size;
+	float time;
+	float inv_far;
+};
+
+struct ObjectData {
+	mat4 position;
+	mat4 rotation;
+	mat4 world_pos;
+	mat4 world_rot;
+	vec3 size;
+	float scale;
+	vec3 color;
+	int palette;
+	// Only read by the RTX shader, other shaders declare the block without them
+	vec4 texture_tile;
+	vec3 volume_size;
+	float alpha;
+};
+
+// Per-object blocks are appended to a ring of frames, persistently mapped if the driver supports it
+class UniformRing {
+private:
+	static const int FRAMES = 3;
+	GLuint buffer;
+	uint8_t* mapped = NULL;
+	GLsync fences[FRAMES] = {};
+	GLsizeiptr frame_size;
+	GLintptr alignment;
+	GLintptr offset = 0;
+	int frame = 0;
+public:
+	UniformRing(GLsizeiptr block_size, int blocks_per_frame);
+	void push(GLuint binding, const void* data, GLsizeiptr size);
+	void nextFrame();
+	~UniformRing();
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include <algorithm>
+
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(int thread_count) : next(0) {
+	for (int i = 0; i < thread_count; i++)
+		threads.push_back(thread(&WorkerPool::work, this, i));
+}
+
+// Every thread takes part in every job, so a job is only done once all of them have seen it
+void WorkerPool::work(int worker) {
+	unsigned int seen = 0;
+	unique_lock<mutex> guard(lock);
+	while (true) {
+		wake.wait(guard, [&]() { return stopping || job != seen; });
+		if (stopping) return;
+		seen = job;
+		guard.unlock();
+		for (int i = next++; i < count; i = next++)
+			task(i, worker);
+		guard.lock();
+		if (--running == 0)
+			done.notify_all();
+	}
+}
+
+// Returns once the threads are woken, the previous job is finished first
+void WorkerPool::start(int count, function<void(int, int)> task) {
+	wait();
+	unique_lock<mutex> guard(lock);
+	this->task = task;
+	this->count = count;
+	next = 0;
+	running = threads.size();
+	job++;
+	active = true;
+	wake.notify_all();
+}
+
+void WorkerPool::wait() {
+	if (!active) return;
+	int caller = threads.size();
+	for (int i = next++; i < count; i = next++)
+		task(i, caller);
+	unique_lock<mutex> guard(lock);
+	done.wait(guard, [&]() { return running == 0; });
+	active = false;
+}
+
+void WorkerPool::run(int count, function<void(int, int)> task) {
+	start(count, task);
+	wait();
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		unique_lock<mutex> guard(lock);
+		stopping = true;
+		wake.notify_all();
+	}
+	for (vector<thread>::iterator it = threads.begin(); it != threads.end(); it++)
+		it->join();
+}
+
+// The calling thread is a worker too, so one thread fewer than the hardware has
+WorkerPool& WorkerPool::shared() {
+	static WorkerPool pool(std::max(0, (int)thread::hardware_concurrency() - 1));
+	return pool;
+}
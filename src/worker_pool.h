@@ -0,0 +1,45 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+using namespace std;
+
+// Persistent threads that share the indices of one job at a time, the calling thread helps when it waits
+class WorkerPool {
+private:
+	vector<thread> threads;
+	mutex lock;
+	condition_variable wake;
+	condition_variable done;
+	function<void(int, int)> task; // Index, worker
+	int count = 0;
+	atomic<int> next;
+	int running = 0; // Threads that have not finished the current job
+	unsigned int job = 0;
+	bool active = false;
+	bool stopping = false;
+	void work(int worker);
+public:
+	WorkerPool(int thread_count);
+	// Threads plus the caller, workers are numbered from 0 and the caller is the last one
+	int getWorkerCount() const { return threads.size() + 1; }
+	void start(int count, function<void(int, int)> task);
+	void wait();
+	void run(int count, function<void(int, int)> task);
+	~WorkerPool();
+	static WorkerPool& shared();
+};
+
+// Runs task(i) for every i in [0, count) on the shared pool
+template<typename Task>
+void ParallelFor(int count, Task task) {
+	WorkerPool::shared().run(count, [&task](int i, int) { task(i); });
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include <math.h>
+#include <algorithm>
+
+#include "worker_pool.h"
+#include "world_mesher.h"
+
+// Same triangles as the model quads, corners 0 and 3 are opposite
+static const GLuint QUAD_INDICES[] = {
+	0, 1, 2,
+	1, 3, 2,
+};
+
+void ClassifyFace(BlockFace& face, const vector<bool>& opaque_layers, bool* opaque_sides) {
+	const float EPSILON = 1e-3f;
+	for (int a = 0; a < 3; a++) {
+		float side = face.vertices[0].position[a];
+		if (fabsf(fabsf(side) - 0.5f) > EPSILON) continue;
+		bool flat = true;
+		vec2 min_pos = vec2(1e9f), max_pos = vec2(-1e9f);
+		int u = (a + 1) % 3, v = (a + 2) % 3;
+		for (int i = 0; i < 4; i++) {
+			const vec3& p = face.vertices[i].position;
+			flat = flat && fabsf(p[a] - side) < EPSILON;
+			min_pos = min(min_pos, vec2(p[u], p[v]));
+			max_pos = max(max_pos, vec2(p[u], p[v]));
+		}
+		if (!flat || length(min_pos + vec2(0.5f)) > EPSILON || length(max_pos - vec2(0.5f)) > EPSILON) continue;
+		int direction = a * 2 + (side > 0 ? 0 : 1);
+
+		int layer = face.vertices[0].layer;
+		if (layer >= 0 && layer < (int)opaque_layers.size() && opaque_layers[layer] && face.vertices[0].tint.a >= 1.0f)
+			opaque_sides[direction] = true;
+
+		// Plane position to uv, merged quads keep the texture scale and orientation of a single face
+		const ChunkVertex* c = face.vertices;
+		mat2 position_delta = mat2(vec2(c[1].position[u] - c[0].position[u], c[1].position[v] - c[0].position[v]),
+		                           vec2(c[2].position[u] - c[0].position[u], c[2].position[v] - c[0].position[v]));
+		mat2 uv_delta = mat2(c[1].uv - c[0].uv, c[2].uv - c[0].uv);
+		if (fabsf(determinant(position_delta)) < EPSILON) return;
+		mat2 transform = uv_delta * inverse(position_delta);
+		bool tiles = fabsf(fabsf(determinant(transform)) - 1.0f) < EPSILON;
+		for (int i = 0; i < 2; i++)
+			for (int j = 0; j < 2; j++)
+				tiles = tiles && fabsf(transform[i][j] - roundf(transform[i][j])) < EPSILON;
+		tiles = tiles && length(c[0].uv - round(c[0].uv)) < EPSILON;
+		if (!tiles) return;
+		face.merge_face = direction;
+		face.uv_transform = transform;
+		return;
+	}
+}
+
+static void EmitQuad(const ChunkVertex* corners, vec3 offset, ChunkGeometry& geometry) {
+	GLuint base = geometry.vertices.size();
+	for (int i = 0; i < 4; i++) {
+		geometry.vertices.push_back(corners[i]);
+		geometry.vertices.back().position += offset;
+	}
+	for (unsigned int i = 0; i < sizeof(QUAD_INDICES) / sizeof(GLuint); i++)
+		geometry.indices.push_back(base + QUAD_INDICES[i]);
+}
+
+static bool SameFace(const BlockFace* a, const BlockFace* b) {
+	if (a == NULL || b == NULL) return false;
+	if (a == b) return true;
+	for (int i = 0; i < 4; i++) {
+		const ChunkVertex& va = a->vertices[i];
+		const ChunkVertex& vb = b->vertices[i];
+		if (va.position != vb.position || va.uv != vb.uv || va.layer != vb.layer || va.tint != vb.tint)
+			return false;
+	}
+	return true;
+}
+
+void WorldMesher::meshChunk(ivec3 chunk, vector<const BlockFace*>& mask, ChunkGeometry& geometry) {
+	ivec3 origin = chunk * SIZE;
+	ivec3 size = min(ivec3(SIZE), ivec3(grid.getSizeX(), grid.getSizeY(), grid.getSizeZ()) - origin);
+	fill(mask.begin(), mask.end(), (const BlockFace*)NULL);
+
+	// Faces that are not merged go after the merged ones so overlays are still drawn on top
+	ChunkGeometry loose;
+	for (int y = 0; y < size.y; y++)
+		for (int z = 0; z < size.z; z++)
+			for (int x = 0; x < size.x; x++) {
+				ivec3 local = ivec3(x, y, z);
+				ivec3 pos = origin + local;
+				const BlockModel& model = models[grid.get(pos.x, pos.y, pos.z)];
+				for (vector<BlockFace>::const_iterator it = model.faces.begin(); it != model.faces.end(); it++) {
+					if (it->cull_face >= 0) {
+						ivec3 neighbor = pos + DIRECTIONS[it->cull_face];
+						if (models[grid.get(neighbor.x, neighbor.y, neighbor.z)].opaque_cube) continue;
+					}
+					if (it->merge_face >= 0) {
+						int a = it->merge_face / 2;
+						const BlockFace*& cell = mask[((it->merge_face * SIZE + local[a]) * SIZE + local[(a + 2) % 3]) * SIZE + local[(a + 1) % 3]];
+						if (cell == NULL) {
+							cell = &*it;
+							continue;
+						}
+					}
+					EmitQuad(it->vertices, vec3(pos), loose);
+				}
+			}
+
+	for (int direction = 0; direction < 6; direction++)
+		mergeFaces(origin, direction, mask, geometry);
+	GLuint base = geometry.vertices.size();
+	geometry.vertices.insert(geometry.vertices.end(), loose.vertices.begin(), loose.vertices.end());
+	for (vector<GLuint>::iterator it = loose.indices.begin(); it != loose.indices.end(); it++)
+		geometry.indices.push_back(base + *it);
+}
+
+void WorldMesher::mergeFaces(ivec3 origin, int direction, vector<const BlockFace*>& mask, ChunkGeometry& geometry) {
+	int a = direction / 2, u = (a + 1) % 3, v = (a + 2) % 3;
+	for (int slice = 0; slice < SIZE; slice++) {
+		const BlockFace** cells = &mask[(direction * SIZE + slice) * SIZE * SIZE];
+		for (int cv = 0; cv < SIZE; cv++)
+			for (int cu = 0; cu < SIZE; cu++) {
+				const BlockFace* face = cells[cv * SIZE + cu];
+				if (face == NULL) continue;
+				int width = 1, height = 1;
+				while (cu + width < SIZE && SameFace(cells[cv * SIZE + cu + width], face))
+					width++;
+				for (bool grow = true; grow && cv + height < SIZE; ) {
+					for (int i = 0; i < width && grow; i++)
+						grow = SameFace(cells[(cv + height) * SIZE + cu + i], face);
+					if (grow) height++;
+				}
+				for (int j = 0; j < height; j++)
+					for (int i = 0; i < width; i++)
+						cells[(cv + j) * SIZE + cu + i] = NULL;
+
+				// Corners keep the winding of the single face, uv keeps tiling past 1
+				ivec3 first = origin;
+				first[a] += slice;
+				first[u] += cu;
+				first[v] += cv;
+				ivec3 last = first;
+				last[u] += width - 1;
+				last[v] += height - 1;
+				const ChunkVertex& anchor = face->vertices[0];
+				vec2 anchor_pos = vec2(first[u] + anchor.position[u], first[v] + anchor.position[v]);
+				ChunkVertex corners[4];
+				for (int i = 0; i < 4; i++) {
+					corners[i] = face->vertices[i];
+					vec3 rel = face->vertices[i].position;
+					vec3 p;
+					p[a] = first[a] + rel[a];
+					p[u] = rel[u] < 0 ? first[u] - 0.5f : last[u] + 0.5f;
+					p[v] = rel[v] < 0 ? first[v] - 0.5f : last[v] + 0.5f;
+					corners[i].position = p;
+					corners[i].uv = anchor.uv + face->uv_transform * (vec2(p[u], p[v]) - anchor_pos);
+				}
+				EmitQuad(corners, vec3(0, 0, 0), geometry);
+			}
+	}
+}
+
+void WorldMesher::mesh(const vector<ivec3>& chunks, vector<ChunkGeometry>& geometry) {
+	WorkerPool& pool = WorkerPool::shared();
+	masks.resize(pool.getWorkerCount());
+	geometry.clear();
+	geometry.resize(chunks.size());
+	pool.run(chunks.size(), [&](int i, int worker) {
+		vector<const BlockFace*>& mask = masks[worker];
+		mask.resize(6 * SIZE * SIZE * SIZE);
+		meshChunk(chunks[i], mask, geometry[i]);
+	});
+}
@@ -0,0 +1,66 @@
+#ifndef WORLD_MESHER_H
+#define WORLD_MESHER_H
+
+#include <vector>
+
+#include "../glad/glad.h"
+#include "schematic_loader.h"
+
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+// World space, baked once per chunk
+struct ChunkVertex {
+	vec3 position;
+	vec2 uv;
+	float layer; // Texture array layer
+	vec4 tint;
+};
+
+// Neighbor directions, faces are hidden by a full opaque cube on that side
+static const ivec3 DIRECTIONS[6] = {
+	ivec3(1, 0, 0), ivec3(-1, 0, 0),
+	ivec3(0, 1, 0), ivec3(0, -1, 0),
+	ivec3(0, 0, 1), ivec3(0, 0, -1),
+};
+
+// Model face baked around the block center, merge_face is the side of the cell it fully covers or -1
+struct BlockFace {
+	ChunkVertex vertices[4];
+	int cull_face = -1;
+	int merge_face = -1;
+	mat2 uv_transform = mat2(1.0f); // Plane axes to uv, a signed permutation for mergeable faces
+};
+
+// Faces of a palette entry baked once around the origin, the mesher only translates them
+struct BlockModel {
+	vector<BlockFace> faces;
+	bool opaque_cube = false; // Every side is fully covered by an opaque face
+};
+
+struct ChunkGeometry {
+	vector<ChunkVertex> vertices;
+	vector<GLuint> indices;
+};
+
+// A face is mergeable when it covers its whole cell side and its texture tiles across cells
+void ClassifyFace(BlockFace& face, const vector<bool>& opaque_layers, bool* opaque_sides);
+
+// Hidden face culling against full opaque cubes and greedy merging of identical full faces, chunks are meshed on the shared worker pool
+class WorldMesher {
+private:
+	static const int SIZE = BlockGrid::CHUNK_SIZE;
+	const BlockGrid& grid;
+	const vector<BlockModel>& models;
+	vector<vector<const BlockFace*> > masks; // Per worker: direction, slice, v, u
+	void meshChunk(ivec3 chunk, vector<const BlockFace*>& mask, ChunkGeometry& geometry);
+	void mergeFaces(ivec3 origin, int direction, vector<const BlockFace*>& mask, ChunkGeometry& geometry);
+public:
+	WorldMesher(const BlockGrid& grid, const vector<BlockModel>& models) : grid(grid), models(models) {}
+	// Fills geometry[i] with the mesh of chunks[i], in grid chunk coordinates
+	void mesh(const vector<ivec3>& chunks, vector<ChunkGeometry>& geometry);
+};
+
+#endif